@@ -4,13 +4,22 @@
 
 #include "EnergyFunction2.h"
 #include "RNAStructure.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <cstring>
 #include <sstream>
+#include <stdio.h>      /* sprintf */
 #include <stdlib.h>     /* atof */
 #include <math.h>       /* floor */
+#include <stdexcept>
+#include <memory>
+#include <algorithm>
+#include <sys/mman.h>   /* shm_open, mmap */
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 /**
  * All the information read from the
@@ -21,18 +30,328 @@ inline int min(int i, int j) {
   return (i < j) ? i : j;
 }
 
-Datatable::Datatable(const char* directory_path) {
+/** The temperature (degrees Celsius) of the free energies in the mfold .dat files. */
+static const double s_reference_temperature = 37.0;
+/** Absolute zero in degrees Celsius, used to convert to Kelvin for the rescaling. */
+static const double s_kelvin_offset = 273.15;
+
+/**
+ * Copy the directory path (minus a trailing '/') into a newly allocated string.
+ */
+static char * copy_dirpath(const char* directory_path) {
   size_t len = strlen(directory_path);
-  if (directory_path[len-1] == '/') {
+  if (len>0 && directory_path[len-1] == '/') {
     len--; /* Only copy up to but not including the final '/' if there is one */
   }
-  dirpath_ = new char[len+1];
-  strncpy(dirpath_,directory_path,len);
-  input_data();
+  char *dirpath = new char[len+1];
+  strncpy(dirpath,directory_path,len);
+  dirpath[len]='\0';
+  return dirpath;
+}
+
+Datatable::Datatable(const char* directory_path) :
+  suffix_(".dat"), temperature_(s_reference_temperature), enthalpy_(NULL),
+  tab_(new EnergyTables()), shm_base_(NULL), shm_length_(0) {
+  dirpath_ = copy_dirpath(directory_path);
+  try {
+    input_data();
+  } catch (...) {
+    /* the destructor does not run for a half-built object */
+    delete [] dirpath_;
+    delete tab_;
+    throw;
+  }
+}
+
+/**
+ * Read a parameter set whose files have the same layout as the .dat files
+ * but a different extension. This is used for the enthalpy tables (.dh).
+ * @param directory_path The path to the directory containing the datafiles.
+ * @param suffix The file extension, including the dot (e.g., ".dh").
+ */
+Datatable::Datatable(const char* directory_path, const char *suffix) :
+  suffix_(suffix), temperature_(s_reference_temperature), enthalpy_(NULL),
+  tab_(new EnergyTables()), shm_base_(NULL), shm_length_(0) {
+  dirpath_ = copy_dirpath(directory_path);
+  try {
+    input_data();
+  } catch (...) {
+    /* the destructor does not run for a half-built object */
+    delete [] dirpath_;
+    delete tab_;
+    throw;
+  }
+}
+
+/**
+ * Rescale 37 degree free energies to another temperature.
+ * With T in Kelvin, dG(T) = dH - T*dS and dS = (dH - dG(37))/310.15.
+ * Entries that are "infinity" in either table remain infinity.
+ */
+static void rescale_table(int *dg, const int *dh, size_t n, double ratio, int infinity) {
+  for (size_t k=0; k<n; ++k) {
+    if (dg[k]>=infinity || dh[k]>=infinity) {
+      dg[k] = infinity;
+    } else {
+      dg[k] = static_cast<int>(floor(dh[k] - ratio*(dh[k]-dg[k]) + 0.5));
+    }
+  }
 }
 
+#define RESCALE(table) \
+  rescale_table(reinterpret_cast<int*>(tab_->table), reinterpret_cast<const int*>(dh.tab_->table), \
+		sizeof(tab_->table)/sizeof(int), ratio, s_infinity)
+#define RESCALE_SCALAR(value) \
+  rescale_table(&tab_->value, &dh.tab_->value, 1, ratio, s_infinity)
+
+/**
+ * Derive the tables for the temperature celsius from the 37 degree
+ * free energies (dg) and the enthalpies (dh). Only at_temperature
+ * constructs Datatables this way.
+ */
+Datatable::Datatable(const Datatable &dg, const Datatable &dh, double celsius) :
+  suffix_(dg.suffix_), temperature_(celsius), enthalpy_(NULL),
+  tab_(new EnergyTables(*dg.tab_)), shm_base_(NULL), shm_length_(0) {
+  dirpath_ = copy_dirpath(dg.dirpath_);
+  /* start with an exact copy of the 37 degree data, then rescale every energy */
+  double ratio = (celsius + s_kelvin_offset)/(s_reference_temperature + s_kelvin_offset);
+  RESCALE(poppen_);
+  RESCALE_SCALAR(maxpen_);
+  RESCALE(eparam_);
+  RESCALE(dangle_);
+  RESCALE(inter_);
+  RESCALE(bulge_);
+  RESCALE(hairpin_);
+  RESCALE(stack_);
+  RESCALE(tstkh_);
+  RESCALE(tstki_);
+  RESCALE(iloop22_);
+  RESCALE(iloop21_);
+  RESCALE(iloop11_);
+  RESCALE(coax_);
+  RESCALE(tstackcoax_);
+  RESCALE(coaxstack_);
+  RESCALE(tstack_);
+  RESCALE(tstkm_);
+  RESCALE_SCALAR(auend_);
+  RESCALE_SCALAR(gubonus_);
+  RESCALE_SCALAR(cint_);
+  RESCALE_SCALAR(cslope_);
+  RESCALE_SCALAR(c3_);
+  RESCALE_SCALAR(efn2a_);
+  RESCALE_SCALAR(efn2b_);
+  RESCALE_SCALAR(efn2c_);
+  RESCALE_SCALAR(init_);
+  /* column 0 of the loop tables holds the sequence key, column 1 the energy */
+  for (int k=1; k<=tab_->numoftloops_; ++k)
+    RESCALE_SCALAR(tloop_[k][1]);
+  for (int k=1; k<=tab_->numoftriloops_; ++k)
+    RESCALE_SCALAR(triloop_[k][1]);
+  /* the extrapolation for large loops is purely entropic */
+  tab_->prelog_ = static_cast<float>(dg.tab_->prelog_*ratio);
+}
+
+#undef RESCALE
+#undef RESCALE_SCALAR
+
 Datatable::~Datatable() {
   delete [] dirpath_;
+  delete enthalpy_;
+  std::map<int, Datatable*>::iterator it;
+  for (it=temperature_cache_.begin(); it!=temperature_cache_.end(); ++it)
+    delete it->second;
+  if (shm_base_ != NULL)
+    munmap(shm_base_, shm_length_);
+  else
+    delete tab_;
+}
+
+/** Identifies a shared-memory segment written by Datatable::publish_shared. */
+static const char s_shm_magic[8] = "RNXTABS";
+/** Incremented whenever the layout of EnergyTables or of SharedTablesHeader changes. */
+static const uint32_t s_shm_format_version = 1;
+
+/**
+ * Layout of a shared-memory segment: this header, padded to 64 bytes,
+ * followed by one EnergyTables block.
+ */
+struct SharedTablesHeader {
+  /** s_shm_magic; written last, so that a half-written segment is never accepted. */
+  char magic[8];
+  uint32_t format_version;
+  /** sizeof(EnergyTables) in the publishing process. */
+  uint32_t tables_size;
+  /** Fingerprint of the EnergyTables block (see Datatable::get_fingerprint). */
+  uint64_t fingerprint;
+  double temperature;
+  char suffix[8];
+  char dirpath[maxfil];
+};
+
+static size_t shm_tables_offset() {
+  return (sizeof(SharedTablesHeader) + 63) & ~static_cast<size_t>(63);
+}
+
+/**
+ * 64-bit FNV-1a over the words of a block (whose size is a multiple of 8).
+ */
+static uint64_t fingerprint_block(const void *block, size_t len) {
+  const unsigned char *p = static_cast<const unsigned char*>(block);
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t k=0; k+8<=len; k+=8) {
+    uint64_t w;
+    memcpy(&w, p+k, 8);
+    h ^= w;
+    h *= 1099511628211ULL;
+  }
+  for (size_t k=len - len%8; k<len; ++k) {
+    h ^= p[k];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/**
+ * Set up a Datatable whose tables live in an already validated shared-memory mapping.
+ */
+Datatable::Datatable(void *shm_base, size_t shm_length) :
+  enthalpy_(NULL), shm_base_(shm_base), shm_length_(shm_length) {
+  const SharedTablesHeader *header = static_cast<const SharedTablesHeader*>(shm_base);
+  dirpath_ = copy_dirpath(header->dirpath);
+  suffix_ = header->suffix;
+  temperature_ = header->temperature;
+  tab_ = reinterpret_cast<EnergyTables*>(static_cast<char*>(shm_base) + shm_tables_offset());
+}
+
+/**
+ * A checksum of all parameter values. Two Datatables have the same fingerprint
+ * if and only if (barring hash collisions) they hold the same parameter set, so
+ * worker processes can use it to make sure they attach to the tables they expect.
+ */
+uint64_t Datatable::get_fingerprint() const {
+  return fingerprint_block(tab_, sizeof(EnergyTables));
+}
+
+/**
+ * Copy the parameter tables into the POSIX shared-memory segment "name"
+ * (e.g., "/rnx_tables"), replacing any segment of that name. Processes that
+ * are still attached to an older segment keep using it until they detach.
+ * Tables read from a directory path of maxfil or more characters are rejected.
+ * @param name Name of the segment (see shm_open).
+ */
+void Datatable::publish_shared(const char *name) const {
+  /* the header keeps the full directory and suffix, so that is_from works on attached tables */
+  if (strlen(dirpath_) >= sizeof(SharedTablesHeader().dirpath)
+      || suffix_.size() >= sizeof(SharedTablesHeader().suffix)) {
+    std::cerr << "[ERROR] Cannot publish the parameters of \"" << dirpath_ << "\" (" << suffix_
+	      << "): the path may have at most " << sizeof(SharedTablesHeader().dirpath)-1
+	      << " characters" << std::endl;
+    throw std::runtime_error("data directory path too long for a shared-memory segment");
+  }
+  size_t length = shm_tables_offset() + sizeof(EnergyTables);
+  shm_unlink(name); /* a fresh segment, so that attached readers are not affected */
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    perror("could not create shared-memory segment");
+    throw std::runtime_error(std::string("shm_open failed for ") + name);
+  }
+  if (ftruncate(fd, length) != 0) {
+    perror("could not size shared-memory segment");
+    close(fd);
+    throw std::runtime_error(std::string("ftruncate failed for ") + name);
+  }
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("could not map shared-memory segment");
+    throw std::runtime_error(std::string("mmap failed for ") + name);
+  }
+  SharedTablesHeader *header = static_cast<SharedTablesHeader*>(base);
+  memset(header, 0, sizeof(SharedTablesHeader));
+  header->format_version = s_shm_format_version;
+  header->tables_size = sizeof(EnergyTables);
+  header->fingerprint = get_fingerprint();
+  header->temperature = temperature_;
+  strncpy(header->suffix, suffix_.c_str(), sizeof(header->suffix)-1);
+  strncpy(header->dirpath, dirpath_, sizeof(header->dirpath)-1);
+  memcpy(static_cast<char*>(base) + shm_tables_offset(), tab_, sizeof(EnergyTables));
+  __sync_synchronize();
+  memcpy(header->magic, s_shm_magic, sizeof(s_shm_magic));
+  munmap(base, length);
+}
+
+/**
+ * Attach read-only to tables published with publish_shared. No data files are read.
+ * The segment is rejected (with an exception) if it was written with another table
+ * layout, if its contents do not match the stored fingerprint, or if fingerprint
+ * is not zero and differs from the fingerprint of the published parameter set.
+ * @param name Name of the segment (see shm_open).
+ * @param fingerprint The expected parameter set (see get_fingerprint), or 0 to accept any.
+ * @return A new Datatable (to be deleted by the caller) using the shared tables in place.
+ */
+Datatable* Datatable::attach_shared(const char *name, uint64_t fingerprint) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("no shared-memory segment ") + name);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < shm_tables_offset()) {
+    close(fd);
+    throw std::runtime_error(std::string("truncated shared-memory segment ") + name);
+  }
+  size_t length = st.st_size;
+  void *base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error(std::string("mmap failed for ") + name);
+  }
+  const SharedTablesHeader *header = static_cast<const SharedTablesHeader*>(base);
+  const char *problem = NULL;
+  if (memcmp(header->magic, s_shm_magic, sizeof(s_shm_magic)) != 0)
+    problem = "not an rnx parameter segment (or not completely written)";
+  else if (header->format_version != s_shm_format_version
+	   || header->tables_size != sizeof(EnergyTables)
+	   || length != shm_tables_offset() + sizeof(EnergyTables))
+    problem = "parameter tables were published by an incompatible version of rnx";
+  else if (fingerprint_block(static_cast<const char*>(base) + shm_tables_offset(),
+			     sizeof(EnergyTables)) != header->fingerprint)
+    problem = "parameter tables do not match their fingerprint";
+  else if (fingerprint != 0 && fingerprint != header->fingerprint)
+    problem = "a different parameter set was published";
+  if (problem != NULL) {
+    munmap(base, length);
+    std::cerr << "[ERROR] Cannot attach to shared-memory segment \"" << name << "\": "
+	      << problem << std::endl;
+    throw std::runtime_error(problem);
+  }
+  return new Datatable(base, length);
+}
+
+/**
+ * Remove the name of a published segment. Attached processes are not affected.
+ */
+void Datatable::unlink_shared(const char *name) {
+  shm_unlink(name);
+}
+
+/**
+ * @return true if the tables are mapped from a shared-memory segment.
+ */
+bool Datatable::is_shared() const {
+  return shm_base_ != NULL;
+}
+
+/**
+ * @param directory_path A data directory (a final '/' is ignored)
+ * @param suffix The extension of the parameter files
+ * @return true if the tables were read (directly or by the publisher of a
+ * shared-memory segment) from these files.
+ */
+bool Datatable::is_from(const char* directory_path, const char *suffix) const {
+  char *dirpath = copy_dirpath(directory_path);
+  bool same = strcmp(dirpath, dirpath_) == 0 && suffix_ == suffix;
+  delete [] dirpath;
+  return same;
 }
 
 /**
@@ -42,23 +361,437 @@ const char* Datatable::get_data_dir() const {
   return dirpath_;
 }
 
+/**
+ * @return the temperature (degrees Celsius) at which the energies of this table apply.
+ */
+double Datatable::get_temperature() const {
+  return temperature_;
+}
+
+/**
+ * Read the enthalpy tables (loop.dh, stack.dh, ..., the mfold .dh files).
+ * These have the same layout as the corresponding .dat files and
+ * are required by at_temperature. The enthalpies can be replaced only as
+ * long as no tables have been derived from them, since callers may hold
+ * references to the derived tables.
+ * @param directory_path The path to the directory containing the .dh files.
+ * @param suffix The extension of the enthalpy files (default: ".dh").
+ */
+void Datatable::load_enthalpies(const char* directory_path, const char *suffix) {
+  Datatable *dh = new Datatable(directory_path, suffix);
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  if (!temperature_cache_.empty()) {
+    delete dh;
+    std::cerr << "[ERROR] Cannot load enthalpies from \"" << directory_path << "\": tables for "
+	      << temperature_cache_.size() << " other temperature(s) were already derived" << std::endl;
+    throw std::runtime_error("enthalpies loaded after at_temperature");
+  }
+  delete enthalpy_;
+  enthalpy_ = dh;
+}
 
+bool Datatable::has_enthalpies() const {
+  return enthalpy_ != NULL;
+}
 
 /**
- * 5 is used in erg3 as a flag for intermolecular interaction
+ * Return the parameter tables rescaled to the given temperature.
+ * The derived tables are built once and cached (to a tenth of a degree),
+ * so that repeated requests for the same temperature cost a map lookup.
+ * This function may be called concurrently from several threads; tables for
+ * different temperatures are built in parallel, and the returned reference
+ * stays valid for the lifetime of this object.
+ * @param celsius The temperature in degrees Celsius.
+ * @return *this for 37 degrees, otherwise the cached derived tables.
  */
-void forceinterefn(int dbl, RNAStructure* ct, int **w) {
-  int i, j;
+const Datatable& Datatable::at_temperature(double celsius) const {
+  int key = static_cast<int>(floor(10.0*celsius + 0.5));
+  if (key == static_cast<int>(floor(10.0*temperature_ + 0.5)))
+    return *this;
+  const Datatable *dh;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    std::map<int, Datatable*>::const_iterator it = temperature_cache_.find(key);
+    if (it != temperature_cache_.end())
+      return *(it->second);
+    dh = enthalpy_;
+  }
+  if (dh == NULL) {
+    std::cerr << "[ERROR] Enthalpy tables are needed to rescale \"" << dirpath_
+	      << "\" to " << celsius << " degrees (see load_enthalpies)." << std::endl;
+    throw std::runtime_error("no enthalpy tables loaded");
+  }
+  /* Build outside of the lock so that other temperatures are not held up. */
+  Datatable *derived = new Datatable(*this, *dh, key/10.0);
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  std::pair<std::map<int, Datatable*>::iterator, bool> ins =
+    temperature_cache_.insert(std::make_pair(key, derived));
+  if (!ins.second)
+    delete derived; /* another thread was faster */
+  return *(ins.first->second);
+}
+
+
+
+void LoopDecomposition::clear() {
+  structure.clear();
+  type.clear();
+  i.clear();
+  j.clear();
+  size.clear();
+  energy.clear();
+}
+
+void LoopDecomposition::push_back(int s, LoopType t, int ci, int cj, int sz, int e) {
+  structure.push_back(s);
+  type.push_back(static_cast<unsigned char>(t));
+  i.push_back(ci);
+  j.push_back(cj);
+  size.push_back(sz);
+  energy.push_back(e);
+}
+
+void LoopDecomposition::append(const LoopDecomposition &other) {
+  structure.insert(structure.end(), other.structure.begin(), other.structure.end());
+  type.insert(type.end(), other.type.begin(), other.type.end());
+  i.insert(i.end(), other.i.begin(), other.i.end());
+  j.insert(j.end(), other.j.begin(), other.j.end());
+  size.insert(size.end(), other.size.begin(), other.size.end());
+  energy.insert(energy.end(), other.energy.begin(), other.energy.end());
+}
+
+/** @return The sum of the loop energies of structure s (its efn2 energy). */
+int LoopDecomposition::get_total_energy(int s) const {
+  int total = 0;
+  for (size_t k=0; k<structure.size(); k++)
+    if (structure[k]==s) total += energy[k];
+  return total;
+}
+
+/** @return A name for the loop type t ("exterior", "stack", ...). */
+const char *LoopDecomposition::type_name(int t) {
+  static const char *names[] = { "exterior", "stack", "hairpin", "bulge", "interior", "multi" };
+  if (t<0 || t>MULTI) return "unknown";
+  return names[t];
+}
+
+/**
+ * Write the records as tab-separated columns (with a header line),
+ * energies in kcal/mol.
+ */
+void LoopDecomposition::write_tsv(std::ostream &out) const {
+  char number[32];
+  out << "structure\ttype\ti\tj\tsize\tenergy\n";
+  for (size_t k=0; k<type.size(); k++) {
+    sprintf(number, "%0.2f", energy[k] / 100.0);
+    out << structure[k] << '\t' << type_name(type[k]) << '\t' << i[k] << '\t' << j[k]
+	<< '\t' << size[k] << '\t' << number << '\n';
+  }
+}
+
+/**
+ * Collect the constraints of ct, i.e. its intermolecular linker bases (numseq()==5).
+ * The storage is reused from the previous call.
+ */
+void ForceConstraints::assign(const RNAStructure *ct) {
   int numbases = ct->get_number_of_bases();
-  for(i=dbl+1; i<=numbases; i++) {
-    for (j=1; j<dbl; j++) {
-      w[j][i-j] = 5;
+  linker_.clear();
+  if (ct->intermolecular()) {
+    for (int i=0; i<3; i++) {
+      int l = ct->inter(i);
+      if (l>=1 && l<=numbases)
+	linker_.push_back(l);
     }
   }
 }
 
 
 
+EnergyEvaluator::EnergyEvaluator(const Datatable &dat) :
+  dat_(dat), model_(COAXIAL_STACKING), memoize_(false), cache_sequence_(0),
+  cache_hits_(0), cache_misses_(0) {
+}
+
+/**
+ * Select how the helix ends in multi-branch and exterior loops are scored.
+ * COAXIAL_STACKING (the default) is the efn2 model of mfold. D2_DANGLES and
+ * NO_DANGLES skip the coaxial stacking DP, for quick estimates when filtering
+ * many candidates.
+ */
+void EnergyEvaluator::set_model(DangleModel model) {
+  model_ = model;
+}
+
+/**
+ * Switch the memoization of hairpin and bulge/internal loop energies on or off.
+ * Switching it off also frees the cache.
+ */
+void EnergyEvaluator::set_memoize(bool memoize) {
+  memoize_ = memoize;
+  if (!memoize) {
+    LoopCache().swap(loop_cache_);
+    cache_sequence_ = 0;
+  }
+}
+
+/**
+ * @return A hash of everything besides the closing pairs that the energy of a
+ * hairpin or internal loop depends on: the sequence (including its linker bases).
+ */
+uint64_t EnergyEvaluator::sequence_hash(const RNAStructure *ct) {
+  uint64_t h = 1469598103934665603ULL; /* FNV-1a */
+  int numbases = ct->get_number_of_bases();
+  h = (h ^ static_cast<uint64_t>(numbases)) * 1099511628211ULL;
+  for (int k=1; k<=numbases; k++)
+    h = (h ^ static_cast<uint64_t>(ct->numseq(k))) * 1099511628211ULL;
+  return h;
+}
+
+/** erg3 for the hairpin closed by i.j, through the loop cache if memoization is on. */
+int EnergyEvaluator::hairpin_energy(const RNAStructure *ct, int i, int j) {
+  if (!memoize_)
+    return dat_.erg3(i, j, ct, fce_.at(i,j));
+  const LoopKey key = { i, j, 0, 0 };
+  LoopCache::const_iterator it = loop_cache_.find(key);
+  if (it != loop_cache_.end()) {
+    cache_hits_++;
+    return it->second;
+  }
+  int e = dat_.erg3(i, j, ct, fce_.at(i,j));
+  if (loop_cache_.size() >= s_max_cached_loops) loop_cache_.clear();
+  loop_cache_[key] = e;
+  cache_misses_++;
+  return e;
+}
+
+/** erg2 for the bulge/internal loop i.j, ip.jp, through the loop cache if memoization is on. */
+int EnergyEvaluator::internal_energy(const RNAStructure *ct, int i, int j, int ip, int jp) {
+  if (!memoize_)
+    return dat_.erg2(i, j, ip, jp, ct, fce_.at(i,ip), fce_.at(jp,j));
+  const LoopKey key = { i, j, ip, jp };
+  LoopCache::const_iterator it = loop_cache_.find(key);
+  if (it != loop_cache_.end()) {
+    cache_hits_++;
+    return it->second;
+  }
+  int e = dat_.erg2(i, j, ip, jp, ct, fce_.at(i,ip), fce_.at(jp,j));
+  if (loop_cache_.size() >= s_max_cached_loops) loop_cache_.clear();
+  loop_cache_[key] = e;
+  cache_misses_++;
+  return e;
+}
+
+/**
+ * Size the scratch space for structures of up to numbases bases, so that
+ * normally not even the first call to efn2 needs to allocate. The coax array
+ * is quadratic in the number of helices of a loop; it is sized for loops of up
+ * to s_reserved_branches helices and grows on demand beyond that.
+ * @param numbases length of the longest sequence that will be evaluated.
+ * @param numstructures largest number of structures in one RNAStructure.
+ */
+void EnergyEvaluator::reserve(int numbases, int numstructures) {
+  /* a loop has at most one helix per two bases, plus the closing helix */
+  int maxhelix = min(numbases/2 + 2, s_reserved_branches);
+  scratch_matrix(helix_store_, helix_rows_, maxhelix, 2);
+  scratch_matrix(coax_store_, coax_rows_, maxhelix, maxhelix);
+  energy_.reserve(numstructures + 1);
+}
+
+/**
+ * @return The number of bytes of scratch space currently held by the evaluator.
+ * This stays constant in the steady state.
+ */
+size_t EnergyEvaluator::get_scratch_size() const {
+  return sizeof(int) * (helix_store_.capacity() + coax_store_.capacity() + energy_.capacity())
+    + sizeof(int*) * (helix_rows_.capacity() + coax_rows_.capacity())
+    + codes_.capacity() + fce_.get_size();
+}
+
+/**
+ * Lay out an nrows x ncols matrix in store and point rows at its rows.
+ * Both vectors only ever grow, so once they are large enough this does not allocate.
+ * The contents of the matrix are not initialized.
+ */
+int **EnergyEvaluator::scratch_matrix(std::vector<int> &store, std::vector<int*> &rows,
+				      int nrows, int ncols) {
+  size_t nrows_alloc = nrows > 0 ? nrows : 1;
+  size_t needed = nrows_alloc * (ncols > 0 ? ncols : 1);
+  if (store.size() < needed) store.resize(needed);
+  if (rows.size() < nrows_alloc) rows.resize(nrows_alloc);
+  for (int r=0; r<nrows; r++)
+    rows[r] = &store[r*ncols];
+  return &rows[0];
+}
+
+/**
+ * @param structnum index (one-based) of a structure scored by the last call to efn2.
+ * @return 100 x the free energy of the structure.
+ */
+int EnergyEvaluator::get_energy(int structnum) const {
+  if (structnum<0 || structnum>=static_cast<int>(energy_.size())) {
+    throw std::out_of_range("structure was not evaluated by efn2");
+  }
+  return energy_[structnum];
+}
+
+/**
+ * Convenience wrapper that evaluates the structure(s) with a temporary
+ * EnergyEvaluator. Code that scores many structures, or that runs in
+ * several threads, should keep one EnergyEvaluator per thread instead.
+ * @param ct The RNA structure or structures derived from a CT file.
+ * @param structnum indicates which structure to calculate the free energy (0: all).
+ */
+void Datatable::efn2(const RNAStructure *ct, int structnum) const {
+  EnergyEvaluator evaluator(*this);
+  evaluator.efn2(ct, structnum);
+}
+
+/**
+ * Decompose all structures of ct on the pool. The records are appended to loops
+ * ordered by structure, as decompose would produce them one structure after the other.
+ */
+void decompose_batch(const Datatable &dat, const RNAStructure *ct, ThreadPool &pool,
+		     LoopDecomposition *loops) {
+  int y = ct->get_number_of_structures();
+  std::vector<EnergyEvaluator> evaluators(pool.size(), EnergyEvaluator(dat));
+  std::vector<LoopDecomposition> parts(y);
+  pool.run(y, [&](int k, int worker) {
+      evaluators[worker].decompose(ct, k+1, &parts[k]);
+    });
+  for (int k=0; k<y; k++)
+    loops->append(parts[k]);
+}
+
+/**
+ * Score all structures of ct in parallel and store the energies in ct
+ * (RNAStructure::set_energy). Each worker of the pool evaluates with its own
+ * EnergyEvaluator against the shared Datatable.
+ * @param dat The parameter tables.
+ * @param ct The structures to score; receives the energies.
+ * @param pool The worker threads.
+ * @param sort If true, reorder the structures of ct by energy afterwards (RNAStructure::sortstructures).
+ */
+void efn2_batch(const Datatable &dat, RNAStructure *ct, ThreadPool &pool, bool sort) {
+  int y = ct->get_number_of_structures();
+  std::vector<int> energy(y+1, 0);
+  EnergyEvaluator prototype(dat);
+  prototype.set_memoize(true); /* the structures share most of their loops */
+  std::vector<EnergyEvaluator> evaluators(pool.size(), prototype);
+  const RNAStructure *cct = ct;
+  pool.run(y, [&](int k, int worker) {
+      energy[k+1] = evaluators[worker].evaluate(cct, k+1);
+    });
+  ct->set_energy(&energy[0], y+1);
+  if (sort)
+    ct->sortstructures();
+}
+
+
+/**
+ * Score many sequences against the one structure of plan on the pool (see
+ * EnergyEvaluator::evaluate_plan). The sequences are handed to the workers in
+ * blocks of the given size.
+ * @param dat The parameter tables.
+ * @param plan The loops of the target structure.
+ * @param sequences The candidate sequences, each as long as the target structure.
+ * @param pool The worker threads.
+ * @param energies Receives 100 x the free energy of each sequence (resized to match).
+ * @param block Number of sequences scored together by one worker.
+ */
+void efn2_plan_batch(const Datatable &dat, const LoopPlan &plan,
+		     const std::vector<std::string> &sequences, ThreadPool &pool,
+		     std::vector<int> *energies, int block) {
+  if (block < 1) {
+    throw std::invalid_argument("block size must be positive");
+  }
+  for (size_t s=0; s<sequences.size(); s++) {
+    if (static_cast<int>(sequences[s].size()) != plan.get_number_of_bases())
+      throw std::invalid_argument("sequence does not match the length of the target structure");
+  }
+  int n = static_cast<int>(sequences.size());
+  energies->assign(n, 0);
+  std::vector<EnergyEvaluator> evaluators(pool.size(), EnergyEvaluator(dat));
+  int nblocks = (n + block - 1) / block;
+  pool.run(nblocks, [&](int k, int worker) {
+      int first = k * block;
+      int count = std::min(block, n - first);
+      evaluators[worker].evaluate_plan(plan, &sequences[first], count, &(*energies)[first]);
+    });
+}
+
+/**
+ * Score a stream of candidate structures, one per line in the form
+ * sequence<TAB>dot-bracket. Each line is written to out with the free energy
+ * (kcal/mol) appended as a third column, in the order of the input. Lines are
+ * read in chunks of the given size that are scored on the pool, each worker with
+ * its own EnergyEvaluator and RNAStructure; the buffers are reused from chunk to
+ * chunk, so that memory does not grow with the length of the stream. Empty
+ * lines are skipped; a malformed line is reported on std::cerr and written
+ * with the energy "NA".
+ * @param dat The parameter tables.
+ * @param in The candidates.
+ * @param out Receives the candidates with their energies.
+ * @param pool The worker threads.
+ * @param chunk Number of lines that are read and scored together.
+ * @return The number of lines that were written.
+ */
+long efn2_stream(const Datatable &dat, std::istream &in, std::ostream &out, ThreadPool &pool,
+		 int chunk) {
+  if (chunk < 1) {
+    throw std::invalid_argument("chunk size must be positive");
+  }
+  std::vector<EnergyEvaluator> evaluators(pool.size(), EnergyEvaluator(dat));
+  std::vector<std::unique_ptr<RNAStructure> > structures(pool.size());
+  std::vector<std::string> lines(chunk);
+  std::vector<std::string> errors(chunk);
+  std::vector<int> energy(chunk);
+  std::vector<char> valid(chunk);
+  char number[2*numlen];
+  long written = 0;
+  while (in) {
+    int n = 0;
+    while (n < chunk && getline(in, lines[n])) {
+      if (!lines[n].empty())
+	n++;
+    }
+    pool.run(n, [&](int k, int worker) {
+	const std::string &line = lines[k];
+	size_t tab = line.find('\t');
+	valid[k] = 0;
+	if (tab == std::string::npos) {
+	  errors[k] = "missing tab between sequence and structure";
+	  return;
+	}
+	size_t end = line.find_first_of("\t\r", tab+1);
+	std::string sequence = line.substr(0, tab);
+	std::string structure = line.substr(tab+1, end == std::string::npos ? end : end-tab-1);
+	try {
+	  if (structures[worker])
+	    structures[worker]->assign(sequence, structure);
+	  else
+	    structures[worker].reset(new RNAStructure(sequence, structure));
+	  energy[k] = evaluators[worker].evaluate(structures[worker].get(), 1);
+	  valid[k] = 1;
+	} catch (const std::invalid_argument &e) {
+	  errors[k] = e.what();
+	}
+      });
+    for (int k=0; k<n; k++) {
+      out << lines[k] << '\t';
+      if (valid[k]) {
+	sprintf(number, "%0.2f", (double) energy[k] / 100.0);
+	out << number << '\n';
+      } else {
+	std::cerr << "[ERROR] Could not evaluate line " << (written+1) << ": " << errors[k] << std::endl;
+	out << "NA\n";
+      }
+      written++;
+    }
+  }
+  out.flush();
+  return written;
+}
+
 /**
  * The energy calculator of Zuker
  * calculates the free energy of each structural conformation in a structure
@@ -77,42 +810,14 @@ void forceinterefn(int dbl, RNAStructure* ct, int **w) {
  * @param structnum indicates which structure to calculate the free energy
  * the default, 0, indicates "all" structures
  */
-void Datatable::efn2(RNAStructure *ct, int structnum){
-  int i, j, k, open, null, stz, count, sum, sum1, ip = 0, jp = 0;
-  
-  Structstack stack; //  a place to keep track of where efn2 is located in a structure
-  int **coax; // Note this local array is to be distinguished from the class variable coax_ \todo: Refactor name!
-  int **helix;
-  int **fce;
-  int *energy;
-  int numbases;
-  bool inter; //  indicates whether there is an intermolecular interaction involved in a multi-branch loop
-  bool flag;
+void EnergyEvaluator::efn2(const RNAStructure *ct, int structnum) {
+  int count;
   int start, stop; // start and stop refer to the indices of the structures to be analysed.
   /* #1 -- Initialize variables and arrays */
-  numbases=ct->get_number_of_bases();
   int y = ct->get_number_of_structures();
-  energy = new int[y+1];  // analogous to Ct->energy_, dont forget to trasfer back.
+  energy_.assign(y+1, 0);  // analogous to Ct->energy_, dont forget to trasfer back.
   // y+1 because we use one-based numbering.
-  /* Copy from ct */
-  int **basepr = ct->basepr();
-  
- 
-  fce = new int *[numbases+1];
-  for (i=0; i<=numbases; i++)
-    fce[i] = new int [numbases + 1-i];
-
-  for (i=0; i<=numbases; i++) {
-    for (j=i; j<=numbases; j++) {
-      fce[i][j-i] = 0;
-    }
-  }
-
-  if (ct->intermolecular()) {//this indicates an intermolecular folding
-    for (i=0; i<3; i++) {
-      forceinterefn(ct->inter(i), ct, fce);
-    }
-  }
+  prepare(ct);
   if (structnum!=0) {
     start = structnum;
     stop = structnum;
@@ -122,426 +827,733 @@ void Datatable::efn2(RNAStructure *ct, int structnum){
   }
   /** #2 -Iterate over structures */
   for (count=start; count<=stop; count++){ 
-    energy[count]=0;
-    //push(&stack, 1, ct->numofbases, 1, 0); 
-    stack.push(1,numbases,1,0); //put whole structure onto the stack
+    energy_[count] = score(ct, count);
+  }
+}
+
+/**
+ * Evaluate a single structure of ct without touching the results of efn2, e.g.,
+ * for batch evaluation where each structure is scored by some worker thread.
+ * @param ct The RNA structure or structures derived from a CT file.
+ * @param structnum index (one-based) of the structure to evaluate.
+ * @return 100 x the free energy of the structure.
+ */
+int EnergyEvaluator::evaluate(const RNAStructure *ct, int structnum) {
+  prepare(ct);
+  return score(ct, structnum);
+}
+
+/**
+ * Steps #3 to #7 of efn2 for structure number count of ct. fce_ must
+ * already hold the constraints of ct.
+ * @return 100 x the free energy of the structure.
+ */
+int EnergyEvaluator::score(const RNAStructure *ct, int count) {
+  int i, j, k, open, null, stz, sum, ip = 0, jp = 0;
+  Structstack stack; //  a place to keep track of where efn2 is located in a structure
+  int numbases;
+  int energy = 0;
+  numbases=ct->get_number_of_bases();
+  const int * const *basepr = ct->basepr();
+  //push(&stack, 1, ct->numofbases, 1, 0); 
+  stack.push(1,numbases,1,0); //put whole structure onto the stack
     
-  subroutine: //loop starts here ("goto" to speed operation)
-    stack.pull( &i, &j, &open, &null, &stz); // take a substructure off stack
-    while (stz!=1){ // note stz is never used anywhere and appears superfluous. ? Delete it ??
-      while (basepr[count][i]==j) { //#3 are i and j paired?
-	while (basepr[count][i+1]==j-1) {//are i, j and i+1, j-1 stacked?
-	  energy[count]=energy[count] + erg1(i, j, i+1, j-1, ct);
-	  i++;
-	  j--;
-	}
-	sum = 0;
-	k = i + 1;
-	// #4) now efn2 is past the paired region, so define
-	// the intervening non-paired segment between [i+2,j-1)
-	// given that we have a stack at i,j,i+1,j-1 above
-	while (k<j) {
-	  if (basepr[count][k]>k) { /* i.e., there is a base pairing from k to some j with j>k */
-	    sum++;
-	    ip = k;
-	    k = basepr[count][k] + 1;
-	    jp = k-1;
-	  } else if (basepr[count][k]==0) {
-	    k++;
-	  }
-	}
-	// when we get here, i and j are paired but i+1 and j-1 are not!
-	// sum now has the number of base pairings between i and j above.
-	if (sum==0) { // #5) hairpin loop
-	  energy[count]=energy[count]+erg3(i,j,ct,fce[i][j-i]);
-	  goto subroutine;
+ subroutine: //loop starts here ("goto" to speed operation)
+  stack.pull( &i, &j, &open, &null, &stz); // take a substructure off stack
+  while (stz!=1){ // note stz is never used anywhere and appears superfluous. ? Delete it ??
+    while (basepr[count][i]==j) { //#3 are i and j paired?
+      while (basepr[count][i+1]==j-1) {//are i, j and i+1, j-1 stacked?
+	energy=energy + dat_.erg1(i, j, i+1, j-1, ct);
+	i++;
+	j--;
+      }
+      sum = 0;
+      k = i + 1;
+      // #4) now efn2 is past the paired region, so define
+      // the intervening non-paired segment between [i+2,j-1)
+      // given that we have a stack at i,j,i+1,j-1 above
+      while (k<j) {
+	if (basepr[count][k]>k) { /* i.e., there is a base pairing from k to some j with j>k */
+	  sum++;
+	  ip = k;
+	  k = basepr[count][k] + 1;
+	  jp = k-1;
+	} else if (basepr[count][k]==0) {
+	  k++;
 	}
-	else if (sum==1) { /* #6 If there is a bulge/internal loop */
-	  energy[count] = energy[count] +
-	    erg2(i, j, ip, jp, ct, fce[i][ip-i], fce[jp][j-jp]);
-	  i = ip;
-	  j = jp;
+      }
+      // when we get here, i and j are paired but i+1 and j-1 are not!
+      // sum now has the number of base pairings between i and j above.
+      if (sum==0) { // #5) hairpin loop
+	energy=energy+hairpin_energy(ct,i,j);
+	goto subroutine;
+      }
+      else if (sum==1) { /* #6 If there is a bulge/internal loop */
+	energy = energy + internal_energy(ct, i, j, ip, jp);
+	i = ip;
+	j = jp;
+      }
+      else { /* #7) multi-branch loop*/
+	energy = energy + multi_loop(ct, basepr[count], i, j, &stack);
+	goto subroutine;
+      }
+    }
+    //this is the exterior loop: , i = 1
+    energy = energy + exterior_loop(ct, basepr[count], i, &stack);
+    goto subroutine;
+  }
+  return energy;
+}
+
+
+/**
+ * Bind the evaluator to the constraints of ct, as needed by loop_energy and
+ * exterior_energy (efn2 and evaluate do this themselves).
+ */
+void EnergyEvaluator::prepare(const RNAStructure *ct) {
+  fce_.assign(ct);
+  if (memoize_) {
+    uint64_t h = sequence_hash(ct);
+    if (h != cache_sequence_) {
+      loop_cache_.clear();
+      cache_sequence_ = h;
+    }
+  }
+}
+
+/**
+ * The energy of the loop closed by the base pair i.j alone: a stack (erg1) if i+1.j-1
+ * is paired, otherwise a hairpin (erg3), bulge/internal loop (erg2) or multi-branch loop,
+ * depending on the number of pairs directly enclosed by i.j. The sum of loop_energy over
+ * all pairs plus exterior_energy equals the efn2 energy of the structure. The cost is
+ * proportional to the size of the loop, not to the length of the sequence.
+ * @param ct The RNA structure (for the sequence); prepare(ct) must have been called.
+ * @param bp A pair table (bp[k] is the partner of base k, or 0) with bp[i]==j.
+ * @param i 5' base of the closing pair.
+ * @param j 3' base of the closing pair.
+ * @return 100 x the free energy of the loop.
+ */
+int EnergyEvaluator::loop_energy(const RNAStructure *ct, const int *bp, int i, int j) {
+  LoopDecomposition::LoopType type;
+  int size;
+  return classify_loop(ct, bp, i, j, &type, &size);
+}
+
+/**
+ * loop_energy, also reporting the type and the number of unpaired bases of the loop.
+ */
+int EnergyEvaluator::classify_loop(const RNAStructure *ct, const int *bp, int i, int j,
+				   LoopDecomposition::LoopType *type, int *size) {
+  int k, sum = 0, unpaired = 0, ip = 0, jp = 0;
+  if (bp[i+1]==j-1 && i+1<j-1) {
+    *type = LoopDecomposition::STACK;
+    *size = 0;
+    return dat_.erg1(i, j, i+1, j-1, ct);
+  }
+  k = i + 1;
+  while (k<j) {
+    if (bp[k]>k) {
+      sum++;
+      ip = k;
+      k = bp[k] + 1;
+      jp = k-1;
+    } else {
+      unpaired++;
+      k++;
+    }
+  }
+  *size = unpaired;
+  if (sum==0) {
+    *type = LoopDecomposition::HAIRPIN;
+    return hairpin_energy(ct, i, j);
+  } else if (sum==1) {
+    *type = (ip==i+1 || jp==j-1) ? LoopDecomposition::BULGE : LoopDecomposition::INTERIOR;
+    return internal_energy(ct, i, j, ip, jp);
+  }
+  *type = LoopDecomposition::MULTI;
+  return multi_loop(ct, bp, i, j, NULL);
+}
+
+/**
+ * The energy of the exterior loop of a structure, see loop_energy. Like efn2, this is
+ * zero if the first base is paired with the last one.
+ * @param ct The RNA structure (for the sequence); prepare(ct) must have been called.
+ * @param bp A pair table (bp[k] is the partner of base k, or 0).
+ * @return 100 x the free energy of the exterior loop.
+ */
+int EnergyEvaluator::exterior_energy(const RNAStructure *ct, const int *bp) {
+  if (bp[1]==ct->get_number_of_bases())
+    return 0;
+  return exterior_loop(ct, bp, 1, NULL);
+}
+
+/**
+ * Append one record per loop of structure structnum of ct to loops (see LoopDecomposition):
+ * the exterior loop first, then the loops closed by each pair in the order of their 5' base.
+ * @param ct The RNA structure or structures derived from a CT file.
+ * @param structnum index (one-based) of the structure.
+ * @param loops receives the records.
+ */
+void EnergyEvaluator::decompose(const RNAStructure *ct, int structnum, LoopDecomposition *loops) {
+  const int *bp = ct->basepr()[structnum];
+  int numbases = ct->get_number_of_bases();
+  LoopDecomposition::LoopType type;
+  int size, unpaired = 0;
+  prepare(ct);
+  for (int k=1; k<=numbases; k++) {
+    if (bp[k]==0) unpaired++;
+    else k = bp[k]; /* skip over the helix */
+  }
+  loops->push_back(structnum, LoopDecomposition::EXTERIOR, 0, 0, unpaired, exterior_energy(ct, bp));
+  for (int k=1; k<=numbases; k++) {
+    if (bp[k]>k) {
+      int e = classify_loop(ct, bp, k, bp[k], &type, &size);
+      loops->push_back(structnum, type, k, bp[k], size, e);
+    }
+  }
+}
+
+/**
+ * Decompose structure structnum of target into its loops, classified as in
+ * EnergyEvaluator::loop_energy: the stacks, and the hairpin, bulge/interior and
+ * multi-branch loops with their closing (and for bulge/interior loops inner) pairs.
+ * @param target The RNA structure(s); only the pairs of structure structnum are used.
+ * @param structnum index (one-based) of the structure.
+ */
+LoopPlan::LoopPlan(const RNAStructure *target, int structnum) :
+  numbases_(target->get_number_of_bases()),
+  structure_(target->get_dot_parens_structure(structnum)),
+  pairs_(numbases_+2, 0) {
+  const int *bp = target->basepr()[structnum];
+  for (int k=1; k<=numbases_; k++)
+    pairs_[k] = bp[k];
+  for (int i=1; i<=numbases_; i++) {
+    int j = pairs_[i];
+    if (j<=i)
+      continue;
+    if (pairs_[i+1]==j-1 && i+1<j-1) {
+      stack_i_.push_back(i);
+      stack_j_.push_back(j);
+      continue;
+    }
+    int k = i+1, sum = 0, ip = 0, jp = 0;
+    while (k<j) {
+      if (pairs_[k]>k) {
+	sum++;
+	ip = k;
+	k = pairs_[k] + 1;
+	jp = k-1;
+      } else {
+	k++;
+      }
+    }
+    if (sum==0) {
+      loop_type_.push_back(LoopDecomposition::HAIRPIN);
+      ip = jp = 0;
+    } else if (sum==1) {
+      loop_type_.push_back((ip==i+1 || jp==j-1) ? LoopDecomposition::BULGE : LoopDecomposition::INTERIOR);
+    } else {
+      loop_type_.push_back(LoopDecomposition::MULTI);
+      ip = jp = 0;
+    }
+    loop_i_.push_back(i);
+    loop_j_.push_back(j);
+    loop_ip_.push_back(ip);
+    loop_jp_.push_back(jp);
+  }
+}
+
+/**
+ * Score count sequences against the structure of plan. The energies equal those
+ * of efn2 for each sequence folded into the plan's structure. The exterior, hairpin,
+ * bulge/interior and multi-branch loops are scored one sequence at a time; the stacks
+ * are then added loop by loop across all sequences from a base-major copy of the
+ * encoded sequences, which turns them into straight runs of lookups in the stack table.
+ * Blocks of a few hundred sequences keep the encoded bases in cache.
+ * @param plan The loops of the target structure.
+ * @param sequences The candidate sequences, each as long as the target structure.
+ * @param count Number of sequences.
+ * @param energies Receives 100 x the free energy of each sequence (count entries).
+ */
+void EnergyEvaluator::evaluate_plan(const LoopPlan &plan, const std::string *sequences,
+				    int count, int *energies) {
+  if (count<=0)
+    return;
+  int numbases = plan.numbases_;
+  const int *bp = &plan.pairs_[0];
+  size_t nloops = plan.loop_type_.size();
+  codes_.resize(static_cast<size_t>(numbases+1) * count);
+  /* the pairs come from the plan: ct only holds the encoded sequence */
+  RNAStructure ct;
+  for (int s=0; s<count; s++) {
+    ct.assign_sequence(sequences[s]);
+    prepare(&ct);
+    int energy = exterior_energy(&ct, bp);
+    for (size_t l=0; l<nloops; l++) {
+      int i = plan.loop_i_[l];
+      int j = plan.loop_j_[l];
+      switch (plan.loop_type_[l]) {
+      case LoopDecomposition::HAIRPIN:
+	energy += hairpin_energy(&ct, i, j);
+	break;
+      case LoopDecomposition::MULTI:
+	energy += multi_loop(&ct, bp, i, j, NULL);
+	break;
+      default:
+	energy += internal_energy(&ct, i, j, plan.loop_ip_[l], plan.loop_jp_[l]);
+      }
+    }
+    energies[s] = energy;
+    for (int k=1; k<=numbases; k++)
+      codes_[static_cast<size_t>(k)*count + s] = static_cast<unsigned char>(ct.numseq(k));
+  }
+  /* stack_[a][b][c][d] as a flat table: index ((a*6+b)*6+c)*6+d */
+  const int *table = &dat_.tab_->stack_[0][0][0][0];
+  const int eparam = dat_.tab_->eparam_[1];
+  const unsigned char *codes = &codes_[0];
+  size_t nstacks = plan.stack_i_.size();
+  for (size_t t=0; t<nstacks; t++) {
+    int i = plan.stack_i_[t];
+    int j = plan.stack_j_[t];
+    const unsigned char *a = codes + static_cast<size_t>(i)*count;
+    const unsigned char *b = codes + static_cast<size_t>(j)*count;
+    const unsigned char *c = codes + static_cast<size_t>(i+1)*count;
+    const unsigned char *d = codes + static_cast<size_t>(j-1)*count;
+    for (int s=0; s<count; s++)
+      energies[s] += table[((a[s]*6 + b[s])*6 + c[s])*6 + d[s]] + eparam;
+  }
+}
+
+/**
+ * The dangling ends of the helices of a loop in the d2 model (D2_DANGLES): every
+ * helix gets its 5' and 3' dangling end (where the adjacent base exists), whether
+ * or not a neighbouring helix competes for the same base. This is a straight loop
+ * over the helices, without any of the case analysis of the coaxial stacking DP.
+ * (NO_DANGLES has no stacking energy at all.)
+ * @param helix helix[k][1] and helix[k][0] are the 5' and the 3' base of helix k
+ * (for the closing helix of a multi-branch loop, its i and j), as in multi_loop/exterior_loop.
+ * @param n number of helices.
+ * @param exterior true for the exterior loop, where the dangles may run off the ends.
+ */
+static int d2_dangle_energy(const Datatable &dat, const RNAStructure *ct, int **helix, int n, bool exterior) {
+  int energy = 0;
+  int numbases = ct->get_number_of_bases();
+  for (int ip=0; ip<n; ip++) {
+    if (!exterior || helix[ip][0] < numbases)
+      energy += min(0, dat.erg4(helix[ip][0], helix[ip][1], helix[ip][0]+1, 1, ct, false));
+    if (!exterior || helix[ip][1] > 1)
+      energy += min(0, dat.erg4(helix[ip][0], helix[ip][1], helix[ip][1]-1, 2, ct, false));
+  }
+  return energy;
+}
+
+/**
+ * #7) The energy of the multi-branch loop closed by i.j: the terminal AU penalties
+ * of the branches, the loop initiation (efn2a_, efn2b_, efn2c_) and the optimal
+ * combination of dangling ends and coaxial stacking of its helices.
+ * @param ct The RNA structure (for the sequence).
+ * @param bp The pair table of the structure (bp[k] is the partner of base k, or 0).
+ * @param i 5' base of the closing pair.
+ * @param j 3' base of the closing pair.
+ * @param stack If not NULL, the branches are pushed onto this stack (used by efn2 to visit them).
+ * @return 100 x the free energy of the loop.
+ */
+int EnergyEvaluator::multi_loop(const RNAStructure *ct, const int *bp, int i, int j, Structstack *stack) {
+  int k, ip, sum, sum1;
+  int **coax; // Note this local array is to be distinguished from the class variable coax_ \todo: Refactor name!
+  int **helix;
+  const ForceConstraints &fce = fce_;
+  bool inter; //  indicates whether there is an intermolecular interaction involved in a multi-branch loop
+  bool flag;
+  int energy = 0;
+  /* count the helices that branch off the loop */
+  sum = 0;
+  k = i + 1;
+  while (k<j) {
+    if (bp[k]>k) {
+      sum++;
+      k = bp[k] + 1;
+    } else {
+      k++;
+    }
+  }
+  sum = sum + 1; //total helixes = sum + 1
+  //initialize array helix and array coax
+  helix = scratch_matrix(helix_store_, helix_rows_, sum+1, 2);
+  //find each helix and store info in array helix
+  //    also place these helixes onto the stack
+  //    and calculate energy of the intervening unpaired nucs
+  helix[0][0] = i;
+  helix[0][1] = j;
+  inter = false;
+  sum1 = 0;
+  for (k=1; k<sum; k++) {
+    ip = helix[k-1][0]+1;
+    while (bp[ip]==0) ip++;
+    if (fce.at(helix[k-1][0],ip)==5)
+      inter = true;
+    //add the terminal AU penalty if necessary
+    energy = energy + dat_.penalty(ip, bp[ip], ct);
+    helix[k][1] = ip;
+    helix[k][0] = bp[ip];
+    if (stack) stack->push(ip, bp[ip], 1, 0);
+    sum1 = sum1+(ip - helix[k-1][0]-1);
+  }
+  helix[sum][0] = helix[0][0];
+  helix[sum][1] = helix[0][1];
+  sum1 = sum1 + helix[sum][1]-helix[sum-1][0]-1;
+  if (inter) {//intermolecular interaction
+    energy = energy+dat_.tab_->init_;
+    //give the initiation penalty
+  }
+  else {//not an intermolecular interaction, treat like a normal
+	//      multibranch loop:
+
+	//give the multibranch loop bonus:
+    energy = energy + dat_.tab_->efn2a_;
+
+    //give the energy for each entering helix
+    energy = energy + sum*dat_.tab_->efn2c_;
+
+    if (sum1<=6) {
+      energy=energy +sum1*dat_.tab_->efn2b_;
+    }
+    else {
+      //June 10, 2008. M. Zuker corrects bug. 11. --> 110. !
+      energy=energy +6*dat_.tab_->efn2b_ + int(110.*log(double(((sum1)/6.))) + 0.5);
+    }
+  }
+  if (model_ == D2_DANGLES)
+    return energy + d2_dangle_energy(dat_, ct, helix, sum, false);
+  else if (model_ == NO_DANGLES)
+    return energy;
+  //Now calculate the energy of stacking:
+  coax = scratch_matrix(coax_store_, coax_rows_, sum+1, sum+1);
+  for (k=0; k<=sum; k++) { //k+1 is number of helixes considered
+    if (k==0) { //this is the energy of stacking bases
+      for (ip=0; ip<sum; ip++) {
+	coax[ip][ip] = 0;
+	flag = false;
+	if (((ip==0) && ((helix[0][1]-helix[sum-1][0])>1))||
+	    ((ip!=0)&&((helix[ip][1]-helix[ip-1][0])>1)))
+	  flag=true;
+	if (((helix[ip+1][1] - helix[ip][0]) > 1)&&flag) {
+	  //use tstackm numbers
+	  //n5 = ct->numseq[helix[ip][0]+1];
+	  //n3 = ct->numseq[helix[ip][1]-1];
+	  coax[ip][ip] = dat_.tab_->tstkm_[ct->numseq(helix[ip][0])]
+	    [ct->numseq(helix[ip][1])]
+	    [ct->numseq(helix[ip][0]+1)]
+	    [ct->numseq(helix[ip][1]-1)];
+
 	}
-	else { /* #7) multi-branch loop*/
-	  sum = sum + 1; //total helixes = sum + 1
-	  //initialize array helix and array coax
-	  helix = new int *[sum+1];
-	  for (k=0; k<=sum; k++) helix[k] = new int [2];
-	  coax = new int *[sum+1];
-	  for (k=0; k<=sum; k++) coax[k] = new int [sum+1];
-	  //find each helix and store info in array helix
-	  //	also place these helixes onto the stack
-	  //	and calculate energy of the intervening unpaired nucs
-	  helix[0][0] = i;
-	  helix[0][1] = j;
-	  inter = false;
-	  sum1 = 0;
-	  for (k=1; k<sum; k++) {
-	    ip = helix[k-1][0]+1;
-	    while (basepr[count][ip]==0) ip++;
-	    if (fce[helix[k-1][0]][ip-helix[k-1][0]]==5)
-	      inter = true;
-	    //add the terminal AU penalty if necessary
-	    energy[count] = energy[count] + penalty(ip, basepr[count][ip], ct);
-	    helix[k][1] = ip;
-	    helix[k][0] = basepr[count][ip];
-	    stack.push(ip, basepr[count][ip], 1, 0);
-	    sum1 = sum1+(ip - helix[k-1][0]-1);
-	  }
-	  helix[sum][0] = helix[0][0];
-	  helix[sum][1] = helix[0][1];
-	  sum1 = sum1 + helix[sum][1]-helix[sum-1][0]-1;
-	  if (inter) {//intermolecular interaction
-	    energy[count] = energy[count]+init_;
-	    //give the initiation penalty
+	else {//do not use tstackm numbers, use individual terminal
+	  //    stack numbers
+	  if ((helix[ip+1][1] - helix[ip][0])>1) {
+	    coax[ip][ip] = 
+	      min(0, dat_.erg4(helix[ip][0], helix[ip][1],
+			  helix[ip][0]+1, 1, ct, false));
 	  }
-	  else {//not an intermolecular interaction, treat like a normal
-            	//	multibranch loop:
-	    
-            	//give the multibranch loop bonus:
-	    energy[count] = energy[count] + efn2a_;
-	    
-	    //give the energy for each entering helix
-	    energy[count] = energy[count] + sum*efn2c_;
-	    
-	    if (sum1<=6) {
-	      energy[count]=energy[count] +sum1*efn2b_;
+	  if (ip==0) {
+	    if ((helix[0][1]-helix[sum-1][0])>1) {
+	      coax[ip][ip] = coax[ip][ip] + 
+		min(0,dat_.erg4(helix[ip][0], helix[ip][1], helix[ip][1]-1,
+			   2, ct, false));
 	    }
-	    else {
-	      //June 10, 2008. M. Zuker corrects bug. 11. --> 110. !
-	      energy[count]=energy[count] +6*efn2b_ + int(110.*log(double(((sum1)/6.))) + 0.5);
+	  } else {
+	    if ((helix[ip][1]-helix[ip-1][0])>1) {
+	      coax[ip][ip] = coax[ip][ip] + 
+		min(0,dat_.erg4(helix[ip][0], helix[ip][1], helix[ip][1]-1,
+			   2, ct, false));
 	    }
 	  }
-	  //Now calculate the energy of stacking:
-	  for (k=0; k<=sum; k++) { //k+1 is number of helixes considered
-	    if (k==0) { //this is the energy of stacking bases
-	      for (ip=0; ip<sum; ip++) {
-		coax[ip][ip] = 0;
-		flag = false;
-		if (((ip==0) && ((helix[0][1]-helix[sum-1][0])>1))||
-		    ((ip!=0)&&((helix[ip][1]-helix[ip-1][0])>1)))
-		  flag=true;
-		if (((helix[ip+1][1] - helix[ip][0]) > 1)&&flag) {
-		  //use tstackm numbers
-		  //n5 = ct->numseq[helix[ip][0]+1];
-		  //n3 = ct->numseq[helix[ip][1]-1];
-		  coax[ip][ip] = tstkm_[ct->numseq(helix[ip][0])]
+	}
+      }
+      coax[sum][sum] = coax[0][0];
+    }
+    else if (k==1) {//now consider whether coaxial stacking is
+      //more favorable than just stacked bases
+
+      for (ip=0; ip<sum; ip++) {
+	//cout << ip << "\n";
+	//see if they're close enough to stack
+	if ((helix[ip+1][1] - helix[ip][0])==1) {
+	  //flush stacking:
+	  coax[ip][ip+1] = min((coax[ip][ip] + coax[ip+1][ip+1]),
+			       dat_.tab_->coax_[ct->numseq(helix[ip][1])]
+			       [ct->numseq(helix[ip][0])]
+			       [ct->numseq(helix[ip+1][1])]
+			       [ct->numseq(helix[ip+1][0])]);
+	}
+
+
+	else if (((helix[ip+1][1] - helix[ip][0])==2)) {
+	  //possible intervening mismatch:
+	  coax[ip][ip+1] = coax[ip][ip]+coax[ip+1][ip+1];
+	  if (ip!=0) {
+	    if ((helix[ip][1] - helix[ip-1][0])>1) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][0])]
 		    [ct->numseq(helix[ip][1])]
 		    [ct->numseq(helix[ip][0]+1)]
-		    [ct->numseq(helix[ip][1]-1)];
-
-		}
-		else {//do not use tstackm numbers, use individual terminal
-		  //	stack numbers
-		  if ((helix[ip+1][1] - helix[ip][0])>1) {
-		    coax[ip][ip] = 
-		      min(0, erg4(helix[ip][0], helix[ip][1],
-				  helix[ip][0]+1, 1, ct, false));
-		  }
-		  if (ip==0) {
-		    if ((helix[0][1]-helix[sum-1][0])>1) {
-		      coax[ip][ip] = coax[ip][ip] + 
-			min(0,erg4(helix[ip][0], helix[ip][1], helix[ip][1]-1,
-				   2, ct, false));
-		    }
-		  } else {
-		    if ((helix[ip][1]-helix[ip-1][0])>1) {
-		      coax[ip][ip] = coax[ip][ip] + 
-			min(0,erg4(helix[ip][0], helix[ip][1], helix[ip][1]-1,
-				   2, ct, false));
-		    }
-		  }
-		}
-	      }
-	      coax[sum][sum] = coax[0][0];
+		    [ct->numseq(helix[ip][1]-1)]+
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip][1]-1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])]);
 	    }
-	    else if (k==1) {//now consider whether coaxial stacking is
-	      //more favorable than just stacked bases
-	   
-	      for (ip=0; ip<sum; ip++) {
-		//cout << ip << "\n";
-		//see if they're close enough to stack
-		if ((helix[ip+1][1] - helix[ip][0])==1) {
-		  //flush stacking:
-		  coax[ip][ip+1] = min((coax[ip][ip] + coax[ip+1][ip+1]),
-				       coax_[ct->numseq(helix[ip][1])]
-				       [ct->numseq(helix[ip][0])]
-				       [ct->numseq(helix[ip+1][1])]
-				       [ct->numseq(helix[ip+1][0])]);
-		}
-	     
-		
-		else if (((helix[ip+1][1] - helix[ip][0])==2)) {
-		  //possible intervening mismatch:
-		  coax[ip][ip+1] = coax[ip][ip]+coax[ip+1][ip+1];
-		  if (ip!=0) {
-		    if ((helix[ip][1] - helix[ip-1][0])>1) {
-		      coax[ip][ip+1] = 
-			min(coax[ip][ip+1],
-			    tstackcoax_[ct->numseq(helix[ip][0])]
-			    [ct->numseq(helix[ip][1])]
-			    [ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip][1]-1)]+
-			    coaxstack_[ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip][1]-1)]
-			    [ct->numseq(helix[ip+1][1])]
-			    [ct->numseq(helix[ip+1][0])]);
-		    }
-		  } else {
-		    //ip==0
-		    if ((helix[0][1]-helix[sum-1][0])>1) {
-		      coax[ip][ip+1] = 
-			min(coax[ip][ip+1],
-			    tstackcoax_[ct->numseq(helix[ip][1])]
-			    [ct->numseq(helix[ip][0])]
-			    [ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip][1]-1)] +
-			    coaxstack_[ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip][1]-1)]
-			    [ct->numseq(helix[ip+1][1])]
-			    [ct->numseq(helix[ip+1][0])]);
-		    }
-		  }
-	
-		  if (ip!=(sum-1)) {
-		    if ((helix[ip+2][1]-helix[ip+1][0])>1) {
-		      coax[ip][ip+1] = 
-			min(coax[ip][ip+1],
-			    tstackcoax_[ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip+1][0]+1)]
-			    [ct->numseq(helix[ip+1][1])]
-			    [ct->numseq(helix[ip+1][0])] +
-			    coaxstack_[ct->numseq(helix[ip][0])]
-			    [ct->numseq(helix[ip][1])]
-			    [ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip+1][0]+1)]);
-		    }
-		  }
-	
-		  else {
-		    //ip = sum - 1
-		    if ((helix[1][1]-helix[0][0])>1) {
-		      coax[ip][ip+1] = 
-			min(coax[ip][ip+1],
-			    tstackcoax_[ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip+1][0]+1)]
-			    [ct->numseq(helix[ip+1][1])]
-			    [ct->numseq(helix[ip+1][0])] +
-			    coaxstack_[ct->numseq(helix[ip][0])]
-			    [ct->numseq(helix[ip][1])]
-			    [ct->numseq(helix[ip][0]+1)]
-			    [ct->numseq(helix[ip+1][0]+1)]);
-		    }
-		  }
-		}
-		else {//no possible stacks
-		  coax[ip][ip+1] = coax[ip][ip] + coax[ip+1][ip+1];
-		}
-	      }
+	  } else {
+	    //ip==0
+	    if ((helix[0][1]-helix[sum-1][0])>1) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][1])]
+		    [ct->numseq(helix[ip][0])]
+		    [ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip][1]-1)] +
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip][1]-1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])]);
 	    }
-	 
-	    else if (k>1&&k<sum) {
-	      for (i=0; (i+k)<=sum; i++) {
-		coax[i][i+k] = coax[i][i]+coax[i+1][i+k];
-		for (j=1; j<k; j++) {
-		  coax[i][i+k] = min(coax[i][i+k],
-				     coax[i][i+j]+coax[i+j+1][i+k]);
-		}
-	      }
+	  }
+
+	  if (ip!=(sum-1)) {
+	    if ((helix[ip+2][1]-helix[ip+1][0])>1) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])] +
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0])]
+		    [ct->numseq(helix[ip][1])]
+		    [ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]);
 	    }
-	    else if (k==sum) {
-	      energy[count]=energy[count] + 
-		min(coax[0][sum-1],coax[1][sum]);
-	   
+	  }
+
+	  else {
+	    //ip = sum - 1
+	    if ((helix[1][1]-helix[0][0])>1) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])] +
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0])]
+		    [ct->numseq(helix[ip][1])]
+		    [ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]);
 	    }
 	  }
-	  for (k=0; k<=sum; k++) delete[] helix[k];
-	  delete[] helix;
-	  for (k=0; k<=sum; k++) delete[] coax[k];
-	  delete[] coax;
-	  goto subroutine;
-	} /* matches  else: multi-branch loop */
+	}
+	else {//no possible stacks
+	  coax[ip][ip+1] = coax[ip][ip] + coax[ip+1][ip+1];
+	}
       }
-      //this is the exterior loop: , i = 1
+    }
 
-      //Find the number of helixes exiting the loop, store this in sum:
-      sum = 0;
-      while (i<numbases) { 	
-	if (basepr[count][i]!=0) {
-	  sum++;
-	  i = basepr[count][i];
+    else if (k>1&&k<sum) {
+      for (i=0; (i+k)<=sum; i++) {
+	coax[i][i+k] = coax[i][i]+coax[i+1][i+k];
+	for (j=1; j<k; j++) {
+	  coax[i][i+k] = min(coax[i][i+k],
+			     coax[i][i+j]+coax[i+j+1][i+k]);
 	}
-	i++;
       }
+    }
+    else if (k==sum) {
+      energy=energy + 
+	min(coax[0][sum-1],coax[1][sum]);
 
-      //initialize array helix and array coax
-      helix = new int *[sum];
-      for (k=0; k<sum; k++) helix[k] = new int [2];
-
-      coax = new int *[sum];
-      for (k=0; k<sum; k++) coax[k] = new int [sum];
-
-
-      //find each helix and store info in array helix
-      //	also place these helixes onto the stack
-      ip = 1;
-      for (k=0; k<sum; k++) {
-	while (basepr[count][ip]==0) ip++;
-	//add terminal au penalty if necessary
-	energy[count]=energy[count]+
-	  penalty(ip, basepr[count][ip], ct);
-	helix[k][1] = ip;
-	helix[k][0] = basepr[count][ip];
-	stack.push(ip, basepr[count][ip], 1, 0);
-	ip = basepr[count][ip]+1;
-      }
+    }
+  }
+  return energy;
+}
 
-      //Now calculate the energy of stacking:
-
-      for (k=0; k<sum; k++) {//k+1 indicates the number of helixes consider
-      	if (k==0) { //this is the energy of stacking bases
-	  for (ip=0; ip<sum; ip++) {
-	    coax[ip][ip] = 0;
-	    if (ip<sum-1) {//not at 3' end of structure
-	      if ((helix[ip+1][1] - helix[ip][0])>1) {
-		//try 3' dangle
-		coax[ip][ip] = 
-		  min(0, erg4(helix[ip][0], helix[ip][1], helix[ip][0]+1, 1, 
-			      ct, false));
-	      }
-	    }
-	    else { //at 3' end of structure
-	      if ((numbases - helix[ip][0])>=1) {
-		//try 3' dangle
-		coax[ip][ip] = 
-		  min(0, erg4(helix[ip][0], helix[ip][1], helix[ip][0]+1, 1, 
-			      ct, false));
-	      }
-	    }
-	    if (ip==0) {
-	      if ((helix[0][1])>1) {
-		coax[ip][ip] = coax[ip][ip] + 
-		  min(0, erg4(helix[ip][0], helix[ip][1],helix[ip][1]-1, 2, 
-			      ct, false));
-	      }
-	    }
-	    else {
-	      if ((helix[ip][1]-helix[ip-1][0])>=1) {
-		coax[ip][ip] = coax[ip][ip] + 
-		  min(0, erg4(helix[ip][0], helix[ip][1],helix[ip][1]-1, 2, 
-			      ct, false));
-	      }
-	    }
+/**
+ * The energy of the exterior loop, i.e., the terminal AU penalties and the optimal
+ * combination of dangling ends and coaxial stacking of the helices that are
+ * not enclosed by any base pair.
+ * @param ct The RNA structure (for the sequence).
+ * @param bp The pair table of the structure (bp[k] is the partner of base k, or 0).
+ * @param i The first base of the sequence (1).
+ * @param stack If not NULL, the helices are pushed onto this stack (used by efn2 to visit them).
+ * @return 100 x the free energy of the loop.
+ */
+int EnergyEvaluator::exterior_loop(const RNAStructure *ct, const int *bp, int i, Structstack *stack) {
+  int j, k, ip, sum;
+  int **coax;
+  int **helix;
+  int energy = 0;
+  int numbases = ct->get_number_of_bases();
+  //Find the number of helixes exiting the loop, store this in sum:
+  sum = 0;
+  while (i<numbases) {      
+    if (bp[i]!=0) {
+      sum++;
+      i = bp[i];
+    }
+    i++;
+  }
+
+  //initialize array helix and array coax
+  helix = scratch_matrix(helix_store_, helix_rows_, sum, 2);
+
+
+  //find each helix and store info in array helix
+  //        also place these helixes onto the stack
+  ip = 1;
+  for (k=0; k<sum; k++) {
+    while (bp[ip]==0) ip++;
+    //add terminal au penalty if necessary
+    energy=energy+
+      dat_.penalty(ip, bp[ip], ct);
+    helix[k][1] = ip;
+    helix[k][0] = bp[ip];
+    if (stack) stack->push(ip, bp[ip], 1, 0);
+    ip = bp[ip]+1;
+  }
+
+  if (model_ == D2_DANGLES)
+    return energy + d2_dangle_energy(dat_, ct, helix, sum, true);
+  else if (model_ == NO_DANGLES)
+    return energy;
+  //Now calculate the energy of stacking:
+  coax = scratch_matrix(coax_store_, coax_rows_, sum, sum);
+
+  for (k=0; k<sum; k++) {//k+1 indicates the number of helixes consider
+    if (k==0) { //this is the energy of stacking bases
+      for (ip=0; ip<sum; ip++) {
+	coax[ip][ip] = 0;
+	if (ip<sum-1) {//not at 3' end of structure
+	  if ((helix[ip+1][1] - helix[ip][0])>1) {
+	    //try 3' dangle
+	    coax[ip][ip] = 
+	      min(0, dat_.erg4(helix[ip][0], helix[ip][1], helix[ip][0]+1, 1, 
+			  ct, false));
+	  }
+	}
+	else { //at 3' end of structure
+	  if ((numbases - helix[ip][0])>=1) {
+	    //try 3' dangle
+	    coax[ip][ip] = 
+	      min(0, dat_.erg4(helix[ip][0], helix[ip][1], helix[ip][0]+1, 1, 
+			  ct, false));
+	  }
+	}
+	if (ip==0) {
+	  if ((helix[0][1])>1) {
+	    coax[ip][ip] = coax[ip][ip] + 
+	      min(0, dat_.erg4(helix[ip][0], helix[ip][1],helix[ip][1]-1, 2, 
+			  ct, false));
+	  }
+	}
+	else {
+	  if ((helix[ip][1]-helix[ip-1][0])>=1) {
+	    coax[ip][ip] = coax[ip][ip] + 
+	      min(0, dat_.erg4(helix[ip][0], helix[ip][1],helix[ip][1]-1, 2, 
+			  ct, false));
 	  }
 	}
-	else if (k==1) {//now consider whether coaxial stacking is
-	  //more favorable than just stacked bases
-	  for (ip=0; ip<sum-1; ip++) {
-	    //see if they're close enough to stack
-	    if ((helix[ip+1][1] - helix[ip][0])==1) {
-	      //flush stacking:
-	      coax[ip][ip+1] = min((coax[ip][ip] + coax[ip+1][ip+1]),
-				   coax_[ct->numseq(helix[ip][1])]
-				   [ct->numseq(helix[ip][0])]
-				   [ct->numseq(helix[ip+1][1])]
-				   [ct->numseq(helix[ip+1][0])] );
+      }
+    }
+    else if (k==1) {//now consider whether coaxial stacking is
+      //more favorable than just stacked bases
+      for (ip=0; ip<sum-1; ip++) {
+	//see if they're close enough to stack
+	if ((helix[ip+1][1] - helix[ip][0])==1) {
+	  //flush stacking:
+	  coax[ip][ip+1] = min((coax[ip][ip] + coax[ip+1][ip+1]),
+			       dat_.tab_->coax_[ct->numseq(helix[ip][1])]
+			       [ct->numseq(helix[ip][0])]
+			       [ct->numseq(helix[ip+1][1])]
+			       [ct->numseq(helix[ip+1][0])] );
+	}
+	else if (((helix[ip+1][1] - helix[ip][0])==2)) {
+	  //possible intervening mismatch:
+	  coax[ip][ip+1] = coax[ip][ip]+coax[ip+1][ip+1];
+	  if (ip!=0) {
+	    if ((helix[ip][1] - helix[ip-1][0])>1) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][0])]
+		    [ct->numseq(helix[ip][1])]
+		    [ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip][1]-1)] +
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip][1]-1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])]);
 	    }
-	    else if (((helix[ip+1][1] - helix[ip][0])==2)) {
-	      //possible intervening mismatch:
-	      coax[ip][ip+1] = coax[ip][ip]+coax[ip+1][ip+1];
-	      if (ip!=0) {
-		if ((helix[ip][1] - helix[ip-1][0])>1) {
-		  coax[ip][ip+1] = 
-		    min(coax[ip][ip+1],
-			tstackcoax_[ct->numseq(helix[ip][0])]
-			[ct->numseq(helix[ip][1])]
-			[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip][1]-1)] +
-			coaxstack_[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip][1]-1)]
-			[ct->numseq(helix[ip+1][1])]
-			[ct->numseq(helix[ip+1][0])]);
-		}
-	      }
-	      else {
-		//ip==0
-		if ((helix[0][1])>1) {
-		  coax[ip][ip+1] = 
-		    min(coax[ip][ip+1],
-			tstackcoax_[ct->numseq(helix[ip][1])]
-			[ct->numseq(helix[ip][0])]
-			[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip][1]-1)] +
-			coaxstack_[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip][1]-1)]
-			[ct->numseq(helix[ip+1][1])]
-			[ct->numseq(helix[ip+1][0])]);
-		}
-	      }
-	     
-	      if (ip!=(sum-2)) {
-		if ((helix[ip+2][1]-helix[ip+1][0])>1) {
-		  coax[ip][ip+1] = 
-		    min(coax[ip][ip+1],
-			tstackcoax_[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip+1][0]+1)]
-			[ct->numseq(helix[ip+1][1])]
-			[ct->numseq(helix[ip+1][0])] +
-			coaxstack_[ct->numseq(helix[ip][0])]
-			[ct->numseq(helix[ip][1])]
-			[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip+1][0]+1)]);
-		}
-	      }
-	      else {
-		//ip = sum - 2
-		if (helix[sum-1][0]< numbases) {
-		  coax[ip][ip+1] = 
-		    min(coax[ip][ip+1],
-			tstackcoax_[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip+1][0]+1)]
-			[ct->numseq(helix[ip+1][1])]
-			[ct->numseq(helix[ip+1][0])] +
-			coaxstack_[ct->numseq(helix[ip][0])]
-			[ct->numseq(helix[ip][1])]
-			[ct->numseq(helix[ip][0]+1)]
-			[ct->numseq(helix[ip+1][0]+1)]);
-		}
-	      }
+	  }
+	  else {
+	    //ip==0
+	    if ((helix[0][1])>1) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][1])]
+		    [ct->numseq(helix[ip][0])]
+		    [ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip][1]-1)] +
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip][1]-1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])]);
 	    }
-	    else {//no possible stacks
-	      coax[ip][ip+1] = coax[ip][ip] + coax[ip+1][ip+1];
+	  }
+
+	  if (ip!=(sum-2)) {
+	    if ((helix[ip+2][1]-helix[ip+1][0])>1) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])] +
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0])]
+		    [ct->numseq(helix[ip][1])]
+		    [ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]);
 	    }
 	  }
-	}
-	else if (k>1) {
-	  for (i=0; (i+k)<sum; i++) {
-	    coax[i][i+k] = coax[i][i]+coax[i+1][i+k];
-	    for (j=1; j<k; j++) {
-	      coax[i][i+k] = min(coax[i][i+k], coax[i][i+j]+coax[i+j+1][i+k]);
+	  else {
+	    //ip = sum - 2
+	    if (helix[sum-1][0]< numbases) {
+	      coax[ip][ip+1] = 
+		min(coax[ip][ip+1],
+		    dat_.tab_->tstackcoax_[ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]
+		    [ct->numseq(helix[ip+1][1])]
+		    [ct->numseq(helix[ip+1][0])] +
+		    dat_.tab_->coaxstack_[ct->numseq(helix[ip][0])]
+		    [ct->numseq(helix[ip][1])]
+		    [ct->numseq(helix[ip][0]+1)]
+		    [ct->numseq(helix[ip+1][0]+1)]);
 	    }
 	  }
 	}
-	if (k==(sum-1)) {
-	  energy[count] = energy[count] + coax[0][sum-1];
+	else {//no possible stacks
+	  coax[ip][ip+1] = coax[ip][ip] + coax[ip+1][ip+1];
+	}
+      }
+    }
+    else if (k>1) {
+      for (i=0; (i+k)<sum; i++) {
+	coax[i][i+k] = coax[i][i]+coax[i+1][i+k];
+	for (j=1; j<k; j++) {
+	  coax[i][i+k] = min(coax[i][i+k], coax[i][i+j]+coax[i+j+1][i+k]);
 	}
       }
-      for (k=0; k<sum; k++) delete[] helix[k];
-      delete[] helix;
-      for (k=0; k<sum; k++) delete[] coax[k];
-      delete[] coax;
-      // NEED TO TRANSER energy BACK TO ct
-      goto subroutine;
+    }
+    if (k==(sum-1)) {
+      energy = energy + coax[0][sum-1];
     }
   }
-
-	/*  xxx
-  for (i=0; i<=ct->numofbases; i++)
-    delete[] fce[i];
-  delete[] fce;
-  return;
- */
-     
+  return energy;
 }
 
 
@@ -553,7 +1565,7 @@ void Datatable::efn2(RNAStructure *ct, int structnum){
  * for the base in the ith position  of the sequence,
  * with A = 1; C = 2; G = 3; U = 4
  */
-int Datatable::erg1(int i, int j, int ip, int jp, RNAStructure *ct)
+int Datatable::erg1(int i, int j, int ip, int jp, const RNAStructure *ct) const
 {
 
   int energy;
@@ -564,8 +1576,8 @@ int Datatable::erg1(int i, int j, int ip, int jp, RNAStructure *ct)
     energy = s_infinity;
   }
   else {
-    energy = stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)]
-      + eparam_[1];
+    energy = tab_->stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)]
+      + tab_->eparam_[1];
   }
   return energy;
 }
@@ -573,17 +1585,17 @@ int Datatable::erg1(int i, int j, int ip, int jp, RNAStructure *ct)
 
 /**calculate the energy of a bulge/internal loop.
  * where i is paired to j; ip is paired to jp; ip > i; j > jp. 
- * Note that a and b are flags that are coming from fce[i][ip-i], fce[jp][j-jp]
- * in the first call to erg2 in efn2 above.
+ * Note that a and b are the flags ForceConstraints::at(i,ip) and at(jp,j)
+ * (see the call to erg2 in efn2 above).
  * @param i The loop is defined by i and j which are paired with each other
  * @param j The loop is defined by i and j which are paired with each other 
  * @param ip ip is paired to jp with i < ip < jp < j
  * @param jp ip is paired to jp with i < ip < jp < j
  * @param ct The structure being tested
- * @param a ??
- * @param b ??
+ * @param a constraint flag of the segment i..ip (5: intermolecular linker)
+ * @param b constraint flag of the segment jp..j
  */
-int Datatable::erg2(int i, int j, int ip, int jp, RNAStructure *ct, int a, int b)
+int Datatable::erg2(int i, int j, int ip, int jp, const RNAStructure *ct, int a, int b) const
 {
   int energy = 0, size, size1, size2, loginc, lopsid, energy2; //tlink, count, key, e[4]
   int numbases;
@@ -612,30 +1624,30 @@ int Datatable::erg2(int i, int j, int ip, int jp, RNAStructure *ct, int a, int b
       //the loop is actually between two strands (ie: intermolecular)
       if (size2>1) {//free energy is that of two terminal mismatches
 	//and the intermolecular initiation
-	energy = init_ + tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
-	  tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)];
+	energy = tab_->init_ + tab_->tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
+	  tab_->tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)];
       } 
       else if (size2==1) {//find the best terminal mismatch and terminal
 	//stack free energies combination
-	energy = init_ + tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
+	energy = tab_->init_ + tab_->tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
 	  erg4 (jp, ip, ip-1, 2, ct, false)+penalty(jp, ip, ct);
-	energy2 = init_ + tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
+	energy2 = tab_->init_ + tab_->tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
 	  erg4 (i, j, i+1, 1, ct, false)+penalty(i, j, ct);
 	energy = min (energy, energy2);
 	//if ((ct->numseq[i+1]!=5)&&(ct->numseq[ip-1]!=5)) {
 	//now consider if coaxial stacking is better:
-	energy2 = init_ + tstackcoax_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)]
-	  + coaxstack_[ct->numseq(jp+1)][ct->numseq(ip-1)][ct->numseq(j)][ct->numseq(i)]+penalty(i, j, ct)+penalty(jp, ip, ct);
+	energy2 = tab_->init_ + tab_->tstackcoax_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)]
+	  + tab_->coaxstack_[ct->numseq(jp+1)][ct->numseq(ip-1)][ct->numseq(j)][ct->numseq(i)]+penalty(i, j, ct)+penalty(jp, ip, ct);
 	energy = min(energy, energy2);
-	energy2 = init_ + tstackcoax_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(j-1)][ct->numseq(ip-1)]
-	  + coaxstack_[ct->numseq(j-1)][ct->numseq(ip-1)][ct->numseq(j)][ct->numseq(i)]+penalty(i, j, ct)+penalty(jp, ip, ct);
+	energy2 = tab_->init_ + tab_->tstackcoax_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(j-1)][ct->numseq(ip-1)]
+	  + tab_->coaxstack_[ct->numseq(j-1)][ct->numseq(ip-1)][ct->numseq(j)][ct->numseq(i)]+penalty(i, j, ct)+penalty(jp, ip, ct);
 	energy = min(energy, energy2);
 	//}
       }
       else if (size2==0) {//just have dangling ends or flush stacking
-	energy = init_ + erg4 (jp, ip, ip-1, 2, ct, false) +
+	energy = tab_->init_ + erg4 (jp, ip, ip-1, 2, ct, false) +
 	  erg4 (i, j, i+1, 1, ct, false)+penalty(i, j, ct)+penalty(jp, ip, ct);
-	energy2 = init_ + coax_[ct->numseq(ip)][ct->numseq(jp)][ct->numseq(j)][ct->numseq(i)]+penalty(i, j, ct)+penalty(jp, ip, ct);
+	energy2 = tab_->init_ + tab_->coax_[ct->numseq(ip)][ct->numseq(jp)][ct->numseq(j)][ct->numseq(i)]+penalty(i, j, ct)+penalty(jp, ip, ct);
 	energy = min(energy, energy2);
       }
       return energy;
@@ -645,33 +1657,33 @@ int Datatable::erg2(int i, int j, int ip, int jp, RNAStructure *ct, int a, int b
       //the loop is actually between two strands (ie: intermolecular)
       if (size1>1) {//free energy is that of two terminal mismatches
 	//and the intermolecular initiation
-	energy = init_ + tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
-	  tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)];
+	energy = tab_->init_ + tab_->tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
+	  tab_->tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)];
       }
       else if (size1==1) {//find the best terminal mismatch and terminal
 	//stack free energies combination
-	energy = init_ + tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
+	energy = tab_->init_ + tab_->tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
 	  erg4 (ip, jp, jp+1, 1, ct, false)+penalty(ip, jp, ct);
-	energy2 = init_ + tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
+	energy2 = tab_->init_ + tab_->tstack_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
 	  erg4(i, j, j-1, 2, ct, false)+penalty(i, j, ct);
 
 	energy = min (energy, energy2);
 	//if ((ct->numseq[i+1]!=5)&&(ct->numseq[ip-1]!=5)) {
 	//now consider if coaxial stacking is better:
-	energy2 = init_ + tstackcoax_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
-	  + coaxstack_[ct->numseq(i+1)][ct->numseq(j-1)][ct->numseq(ip)][ct->numseq(jp)]
+	energy2 = tab_->init_ + tab_->tstackcoax_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
+	  + tab_->coaxstack_[ct->numseq(i+1)][ct->numseq(j-1)][ct->numseq(ip)][ct->numseq(jp)]
 	  + penalty(i, j, ct) + penalty(jp, ip, ct);
 	energy = min(energy, energy2);
-	energy2 = init_ + tstackcoax_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip-1)][ct->numseq(j-1)]
-	  + coaxstack_[ct->numseq(ip-1)][ct->numseq(j-1)][ct->numseq(ip)][ct->numseq(jp)]
+	energy2 = tab_->init_ + tab_->tstackcoax_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip-1)][ct->numseq(j-1)]
+	  + tab_->coaxstack_[ct->numseq(ip-1)][ct->numseq(j-1)][ct->numseq(ip)][ct->numseq(jp)]
 	  + penalty(i, j, ct) + penalty(jp, ip, ct);
 	energy = min(energy, energy2);
 	//}
       }
       else if (size1==0) {//just have dangling ends or flush stacking
-	energy = init_ + erg4 (jp, ip, jp+1, 1, ct, false) +
+	energy = tab_->init_ + erg4 (jp, ip, jp+1, 1, ct, false) +
 	  erg4 (i, j, j-1, 2, ct, false) + penalty(i, j, ct) + penalty(jp, ip, ct);
-	energy2 = init_ + coax_[ct->numseq(j)][ct->numseq(i)][ct->numseq(ip)][ct->numseq(j)]
+	energy2 = tab_->init_ + tab_->coax_[ct->numseq(j)][ct->numseq(i)][ct->numseq(ip)][ct->numseq(j)]
 	   + penalty(i, j, ct) + penalty(jp, ip, ct);
 	energy = min(energy, energy2);
       }
@@ -685,19 +1697,19 @@ int Datatable::erg2(int i, int j, int ip, int jp, RNAStructure *ct, int a, int b
   if (size1==0||size2==0) {//bulge loop
     size = size1+size2;
     if (size==1) {
-      energy = stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)]
-	+ bulge_[size] + eparam_[2];
-      // std::cout << " stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)]=" <<  stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)] << std::endl;
-      //std::cout << " bulge_[size]="<< bulge_[size] << "  and eparam_[2]=" << eparam_[2] << std::endl;
+      energy = tab_->stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)]
+	+ tab_->bulge_[size] + tab_->eparam_[2];
+      // std::cout << " tab_->stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)]=" <<  tab_->stack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][ct->numseq(jp)] << std::endl;
+      //std::cout << " tab_->bulge_[size]="<< tab_->bulge_[size] << "  and tab_->eparam_[2]=" << tab_->eparam_[2] << std::endl;
     }
     else if (size>30) {
-      loginc = int(prelog_*log(double ((size)/30.0)));
-      energy = bulge_[30] + loginc + eparam_[2];
+      loginc = int(tab_->prelog_*log(double ((size)/30.0)));
+      energy = tab_->bulge_[30] + loginc + tab_->eparam_[2];
       energy = energy + penalty(i, j, ct) + penalty(jp, ip, ct);
 
     }
     else {
-      energy = bulge_[size] + eparam_[2];
+      energy = tab_->bulge_[size] + tab_->eparam_[2];
       energy = energy + penalty(i, j, ct) + penalty(jp, ip, ct);
     }
   }
@@ -707,50 +1719,49 @@ int Datatable::erg2(int i, int j, int ip, int jp, RNAStructure *ct, int a, int b
 
     if (size>30) {
 
-      loginc = int( prelog_*log((double ((size))/30.0)));
-      if ((size1==1||size2==1) && gail_) {
-	energy = tstki_[ct->numseq(i)][ct->numseq(j)][1][1] +
-	  tstki_[ct->numseq(jp)][ct->numseq(ip)][1][1] +
-	  inter_[30] + loginc + eparam_[3] +
-	  min(maxpen_, (lopsid*poppen_[min(2, min(size1, size2))]));
+      loginc = int( tab_->prelog_*log((double ((size))/30.0)));
+      if ((size1==1||size2==1) && tab_->gail_) {
+	energy = tab_->tstki_[ct->numseq(i)][ct->numseq(j)][1][1] +
+	  tab_->tstki_[ct->numseq(jp)][ct->numseq(ip)][1][1] +
+	  tab_->inter_[30] + loginc + tab_->eparam_[3] +
+	  min(tab_->maxpen_, (lopsid*tab_->poppen_[min(2, min(size1, size2))]));
       }
       else {
-	energy = tstki_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
-	  tstki_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
-	  inter_[30] + loginc + eparam_[3] +
-	  min(maxpen_, (lopsid*poppen_[min(2, min(size1, size2))]));
+	energy = tab_->tstki_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
+	  tab_->tstki_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
+	  tab_->inter_[30] + loginc + tab_->eparam_[3] +
+	  min(tab_->maxpen_, (lopsid*tab_->poppen_[min(2, min(size1, size2))]));
       }
     }
     else if ((size1==2)&&(size2==2)) {//2x2 internal loop
-      energy = iloop22_[ct->numseq(i)][ct->numseq(ip)][ct->numseq(j)][ct->numseq(jp)]
+      energy = tab_->iloop22_[ct->numseq(i)][ct->numseq(ip)][ct->numseq(j)][ct->numseq(jp)]
 	[ct->numseq(i+1)][ct->numseq(i+2)][ct->numseq(j-1)][ct->numseq(j-2)];
     }
     else if ((size1==1)&&(size2==2)) {//2x1 internal loop
-      energy = iloop21_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)]
+      energy = tab_->iloop21_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)]
 	[ct->numseq(j-1)][ct->numseq(jp+1)][ct->numseq(ip)][ct->numseq(jp)];
-      std::cout << "2x1" << std::endl;
     }
    
     else if ((size1==2)&&(size2==1)) {//1x2 internal loop
-      energy = iloop21_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)][ct->numseq(i+1)][ct->numseq(j)][ct->numseq(i)];
+      energy = tab_->iloop21_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)][ct->numseq(i+1)][ct->numseq(j)][ct->numseq(i)];
     }
     else if (size==2) //a single mismatch
-      energy = iloop11_[ct->numseq(i)][ct->numseq(i+1)][ct->numseq(ip)][ct->numseq(j)][ct->numseq(j-1)][ct->numseq(jp)];
-    else if ((size1==1||size2==1)&& gail_) { //this loop is lopsided
+      energy = tab_->iloop11_[ct->numseq(i)][ct->numseq(i+1)][ct->numseq(ip)][ct->numseq(j)][ct->numseq(j-1)][ct->numseq(jp)];
+    else if ((size1==1||size2==1)&& tab_->gail_) { //this loop is lopsided
       //note, we treat this case as if we had a loop composed of all As
       //if and only if the gail rule is set to 1 in miscloop.dat
-      // recall gail_==1 for Grossly Asymmetric Interior Loop Rule being used.
-      energy = tstki_[ct->numseq(i)][ct->numseq(j)][1][1] +
-	tstki_[ct->numseq(jp)][ct->numseq(ip)][1][1] +
-	inter_[size] + eparam_[3] +
-	min(maxpen_, (lopsid*poppen_[min(2, min(size1, size2))]));
+      // recall tab_->gail_==1 for Grossly Asymmetric Interior Loop Rule being used.
+      energy = tab_->tstki_[ct->numseq(i)][ct->numseq(j)][1][1] +
+	tab_->tstki_[ct->numseq(jp)][ct->numseq(ip)][1][1] +
+	tab_->inter_[size] + tab_->eparam_[3] +
+	min(tab_->maxpen_, (lopsid*tab_->poppen_[min(2, min(size1, size2))]));
     }
     
     else {
-      energy = tstki_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
-	tstki_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
-	inter_[size] + eparam_[3] +
-	min(maxpen_, (lopsid*poppen_[min(2, min(size1, size2))]));
+      energy = tab_->tstki_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] +
+	tab_->tstki_[ct->numseq(jp)][ct->numseq(ip)][ct->numseq(jp+1)][ct->numseq(ip-1)] +
+	tab_->inter_[size] + tab_->eparam_[3] +
+	min(tab_->maxpen_, (lopsid*tab_->poppen_[min(2, min(size1, size2))]));
     }
 
   }
@@ -771,9 +1782,9 @@ int Datatable::erg2(int i, int j, int ip, int jp, RNAStructure *ct, int a, int b
  * @param i Last paired base prior to a hairpin over (i+1)..(j-1) 
  * @param j First paired base following a hairpin over (i+1)..(j-1)
  * @param ct The Structure object being investigated
- * @param dbl A flag This can come from fce and be 5 (force interfere, intermolecular interactions)
+ * @param dbl A flag from ForceConstraints::at(i,j), 5 for intermolecular interactions
  */
-int Datatable::erg3(int i, int j, RNAStructure *ct, int dbl)
+int Datatable::erg3(int i, int j, const RNAStructure *ct, int dbl) const
 {
   int energy, size, loginc, tlink, count, key, k;
   int numbases;
@@ -788,9 +1799,9 @@ int Datatable::erg3(int i, int j, RNAStructure *ct, int dbl)
 
   else if (dbl==5) {//intermolecular interaction
     //intermolecular "hairpin" free energy is that of intermolecular
-    //	initiation (init_) plus the stacked mismatch
+    //	initiation (tab_->init_) plus the stacked mismatch
 
-    energy = init_ + tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)];
+    energy = tab_->init_ + tab_->tstack_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)];
     return energy;
   }
   numbases = ct->get_number_of_bases();
@@ -806,13 +1817,13 @@ int Datatable::erg3(int i, int j, RNAStructure *ct, int dbl)
 
   if (size>30) {
     //cout << "erg3:  i = "<<i<<"   j = "<<j<<"   "<<log(double ((size)/30.0))<<"\n";
-    loginc = static_cast<int>(prelog_*log(static_cast<double>(size)/30.0));
+    loginc = static_cast<int>(tab_->prelog_*log(static_cast<double>(size)/30.0));
    
-    energy = tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
-      + hairpin_[30]+loginc+eparam_[4];
+    energy = tab_->tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
+      + tab_->hairpin_[30]+loginc+tab_->eparam_[4];
   }
   else if (size<3) {
-    energy = hairpin_[size] + eparam_[4];
+    energy = tab_->hairpin_[size] + tab_->eparam_[4];
     if (ct->numseq(i)==4||ct->numseq(j)==4)
       energy = energy+6;
   }
@@ -820,40 +1831,40 @@ int Datatable::erg3(int i, int j, RNAStructure *ct, int dbl)
     tlink = 0;
     key = (ct->numseq(j))*3125 + (ct->numseq(i+4))*625 +
       (ct->numseq(i+3))*125 + (ct->numseq(i+2))*25+(ct->numseq(i+1))*5+(ct->numseq(i));
-    for (count=1; count<=numoftloops_ && tlink==0; count++) {
-      if (key==tloop_[count][0])
-	tlink = tloop_[count][1]; /* sets to energy of one of the sequences in tlink */
+    for (count=1; count<=tab_->numoftloops_ && tlink==0; count++) {
+      if (key==tab_->tloop_[count][0])
+	tlink = tab_->tloop_[count][1]; /* sets to energy of one of the sequences in tlink */
     }
     /* tlink is either zero or is an additive factor for a "special" sequence 
      * (there are about 30 in our data from tloop.dat). */
-    energy = tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
-      + hairpin_[size] + eparam_[4] + tlink;
+    energy = tab_->tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
+      + tab_->hairpin_[size] + tab_->eparam_[4] + tlink;
   }
   else if (size==3) {
     tlink = 0;
     key = (ct->numseq(j))*625 +
       (ct->numseq(i+3))*125 + (ct->numseq(i+2))*25+(ct->numseq(i+1))*5+(ct->numseq(i));
-    for (count=1; count<=numoftriloops_ && tlink==0; count++) {
-      if (key==triloop_[count][0])
-	tlink = triloop_[count][1];
+    for (count=1; count<=tab_->numoftriloops_ && tlink==0; count++) {
+      if (key==tab_->triloop_[count][0])
+	tlink = tab_->triloop_[count][1];
     }
     /* Why is energy computed twice differently? */
-    energy = tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)];
-    energy = hairpin_[size] + eparam_[4] + tlink +penalty(i, j, ct);
+    energy = tab_->tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)];
+    energy = tab_->hairpin_[size] + tab_->eparam_[4] + tlink +penalty(i, j, ct);
   }
  
   else { /** loop that is longer than 4 nucleotides 
 	     but less than 30 nucleotides in length*/
-    energy = tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
-      + hairpin_[size] + eparam_[4];
+    energy = tab_->tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]
+      + tab_->hairpin_[size] + tab_->eparam_[4];
    
     /* std::cout << "\nct->numseq(" << i << ")=" << ct->numseq(i) << " for i=" << i << ":" << ct->nucleotide_at(i) << std::endl;
     std::cout << "ct->numseq(" << j << ")=" << ct->numseq(j) << " for j=" << j << ":" << ct->nucleotide_at(j) << std::endl;
     std::cout << "ct->numseq(" << i+1 << ")=" << ct->numseq(i+1) << " for i+1=" << i+1 << ":" << ct->nucleotide_at(i+1) << std::endl;
     std::cout << "ct->numseq(" << j-1 << ")=" << ct->numseq(j-1) << " for j-1=" << j-1 << ":" << ct->nucleotide_at(j-1) << std::endl;
-    std::cout << "tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]=" << tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] << std::endl;
-    std::cout << "hairpin_[soze="<<size<<"]=" << hairpin_[size] << std::endl;
-    std::cout << "prelog_="<<prelog_ << std::endl;
+    std::cout << "tab_->tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)]=" << tab_->tstkh_[ct->numseq(i)][ct->numseq(j)][ct->numseq(i+1)][ct->numseq(j-1)] << std::endl;
+    std::cout << "tab_->hairpin_[soze="<<size<<"]=" << tab_->hairpin_[size] << std::endl;
+    std::cout << "tab_->prelog_="<<tab_->prelog_ << std::endl;
     std::cout << "loginc=" << loginc << std::endl;
     */
   }
@@ -873,7 +1884,7 @@ int Datatable::erg3(int i, int j, RNAStructure *ct, int dbl)
   if (ct->numseq(i)==3&&ct->numseq(j)==4) { /* if: i is G and j is U */
     if (( i>2 && i<numbases) || ( i>numbases+2 ))
       if (ct->numseq(i-1)==3 && ct->numseq(i-2)==3) { /* if: two preceding bases are G */
-	energy = energy + gubonus_;
+	energy = energy + tab_->gubonus_;
 	//if (ct->numseq[i+1]==4&&ct->numseq[j-1]==4)
 	//	energy = energy - data->uubonus;
 	//if (ct->numseq[i+1]==3&&ct->numseq[j-1]==1)
@@ -890,8 +1901,8 @@ int Datatable::erg3(int i, int j, RNAStructure *ct, int dbl)
     if (ct->numseq(i+k) != 2) tlink = 0;
   }
   if (tlink==1) {  //this is a poly c loop so penalize
-    if (size==3) energy = energy + c3_;
-    else energy = energy + cint_ + size*cslope_;
+    if (size==3) energy = energy + tab_->c3_;
+    else energy = energy + tab_->cint_ + size*tab_->cslope_;
   }
   return energy;
 }
@@ -902,7 +1913,7 @@ int Datatable::erg3(int i, int j, RNAStructure *ct, int dbl)
  * jp = 1 => 3' dangle<br/>
  * jp = 2 => 5' dangle
  */
-int Datatable::erg4(int i, int j, int ip, int jp, RNAStructure *ct, bool lfce) const
+int Datatable::erg4(int i, int j, int ip, int jp, const RNAStructure *ct, bool lfce) const
 {
   int energy;
   
@@ -910,7 +1921,7 @@ int Datatable::erg4(int i, int j, int ip, int jp, RNAStructure *ct, bool lfce) c
 
   if (ip==5) return 0; //dangling nuc is an intermolecular linker
 
-  energy = dangle_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][jp];
+  energy = tab_->dangle_[ct->numseq(i)][ct->numseq(j)][ct->numseq(ip)][jp];
   return energy;
 }
 
@@ -926,107 +1937,109 @@ bool file_exists(const char * path) {
   if ((check = fopen(path, "r")) == NULL) {
     std::cerr << path << " missing\n";
     return false;
-  } else
-    return true;
+  }
+  fclose(check);
+  return true;
 }
 
 
 void Datatable::input_data() {
-  std::string files[] = {"loop.dat","stack.dat", "tstackh.dat",
-			 "tstacki.dat", "tloop.dat", "miscloop.dat",
-			 "dangle.dat","int22.dat","int21.dat",
-			 "coaxial.dat","triloop.dat", "tstackcoax.dat",
-			 "coaxstack.dat","tstack.dat","tstackm.dat",
-			 "int11.dat",};
+  std::string files[] = {"loop","stack", "tstackh",
+			 "tstacki", "tloop", "miscloop",
+			 "dangle","int22","int21",
+			 "coaxial","triloop", "tstackcoax",
+			 "coaxstack","tstack","tstackm",
+			 "int11",};
   int n_elem = sizeof(files)/sizeof(files[0]);
   for (unsigned int i=0;i<n_elem;++i) {
     std::stringstream ss;
-    ss << dirpath_ << "/" << files[i];
+    ss << dirpath_ << "/" << files[i] << suffix_;
     std::string s = ss.str();
     if (! file_exists(s.c_str())) {
       std::cerr << "Error, could not find file " << s << std::endl;
-      //exit(1);
+      /* the parsers below would never find their records in a missing file */
+      throw std::runtime_error("missing thermodynamic data file " + s);
     }
   }
   /* If we get here, all of the files we need can be found. */
   /* 1) loop */
   std::stringstream ss;
-  ss << dirpath_ << "/loop.dat";
+  ss << dirpath_ << "/loop" << suffix_;
   std::string s = ss.str();
   input_loop_dat(s);
   /* 2) stack */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/stack.dat";
+  ss << dirpath_ << "/stack" << suffix_;
   s = ss.str();
   input_stack_dat(s);
   /* 3) tstackh */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/tstackh.dat";
+  ss << dirpath_ << "/tstackh" << suffix_;
   s = ss.str();
   input_tstackh_dat(s);
   /* 4) tstacki */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/tstacki.dat";
+  ss << dirpath_ << "/tstacki" << suffix_;
   s = ss.str();
   input_tstacki_dat(s);
   /* 5) tloop */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/tloop.dat";
+  ss << dirpath_ << "/tloop" << suffix_;
   s = ss.str();
   input_tloop_dat(s);
   /* 6) miscloop */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/miscloop.dat";
+  ss << dirpath_ << "/miscloop" << suffix_;
   s = ss.str();
   input_miscloop_dat(s);
   /* 7) dangle */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/dangle.dat";
+  ss << dirpath_ << "/dangle" << suffix_;
   s = ss.str();
   input_dangle_dat(s);
   /* 8) int22 */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/int22.dat";
+  ss << dirpath_ << "/int22" << suffix_;
   s = ss.str();
   input_int22_dat(s);
   /* 9) int21 */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/int21.dat";
+  ss << dirpath_ << "/int21" << suffix_;
   s = ss.str();
   input_int21_dat(s);
   /* 10) coaxial */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/coaxial.dat";
+  ss << dirpath_ << "/coaxial" << suffix_;
   s = ss.str();
   input_coaxial_dat(s);
   /* 10) tstackcoax */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/tstackcoax.dat";
+  ss << dirpath_ << "/tstackcoax" << suffix_;
   s = ss.str();
   input_tstackcoax_dat(s);
   /* 11) coaxstack */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/coaxstack.dat";
+  ss << dirpath_ << "/coaxstack" << suffix_;
   s = ss.str();
   input_coaxstack_dat(s);
   /* 12) tstack */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/tstack.dat";
+  ss << dirpath_ << "/tstack" << suffix_;
   s = ss.str();
   input_tstack_dat(s);
   /* 12) tstackm */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/tstackm.dat";
+  ss << dirpath_ << "/tstackm" << suffix_;
   s = ss.str();
   input_tstackm_dat(s);
   /* 11) int11 */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/int11.dat";
+  ss << dirpath_ << "/int11" << suffix_;
   s = ss.str();
   input_int11_dat(s);
   /** 12) triloop.dat */
   ss.str(std::string()); /* reset */
-  ss << dirpath_ <<  "/triloop.dat";
+  ss << dirpath_ << "/triloop" << suffix_;
   s = ss.str();
   input_triloop_dat(s);
    
@@ -1054,23 +2067,23 @@ void Datatable::input_loop_dat(const std::string &path){
     infile >> token; //get past the size column in table
     infile >> token;
     if (token == "."){
-      inter_[i] = s_infinity;
+      tab_->inter_[i] = s_infinity;
     } else {
-      inter_[i] = static_cast<int> (floor (100.0*(atof(token.c_str()))+.5)) ;
+      tab_->inter_[i] = static_cast<int> (floor (100.0*(atof(token.c_str()))+.5)) ;
     }
     //std::cout << i << ")" << inter[i] << std::endl;
     infile >> token;
     if (token ==  ".") {
-      bulge_[i] = s_infinity;
+      tab_->bulge_[i] = s_infinity;
     } else {
-      bulge_[i] = (int) floor(100.0*(atof(token.c_str()))+.5);
+      tab_->bulge_[i] = (int) floor(100.0*(atof(token.c_str()))+.5);
     }
     //std::cout <<"bulge = "<<data->bulge[i]<<"\n";
     infile >> token;
     if (token ==  ".") {
-      hairpin_[i] = s_infinity;
+      tab_->hairpin_[i] = s_infinity;
     } else {
-      hairpin_[i] = (int) floor(100.0*(atof(token.c_str()))+.5);
+      tab_->hairpin_[i] = (int) floor(100.0*(atof(token.c_str()))+.5);
     }
   }
 }
@@ -1107,7 +2120,7 @@ void Datatable::input_loop_dat(const std::string &path){
   * column of 4 by 4  tables, and in the Xthrow and the Yth column of that table.
   * The file <b>stack.dat</b> has four rows and four columns. If we index this
   * arrangement with w,x, and if we index the rows and columns of the individual
-  * tables with y, z, then stack_[w][x][y][z] will give the correct values (see above). Note
+  * tables with y, z, then tab_->stack_[w][x][y][z] will give the correct values (see above). Note
   * that 1-based numbering is being used.
   *
   */
@@ -1129,16 +2142,16 @@ void Datatable::input_stack_dat(const std::string &path) {
       for (j=0; j<=5; j++) {
 	for (l=0; l<=5; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)) {
-	    stack_[i][j][k][l]=0;
+	    tab_->stack_[i][j][k][l]=0;
 	  }
 	  else if ((i==5)||(j==5)||(k==5)||(l==5)) {
-	    stack_[i][j][k][l] = s_infinity;
+	    tab_->stack_[i][j][k][l] = s_infinity;
 	  } else {
 	    infile >> token;
 	    if (token != "."){
-	      stack_[i][j][k][l] =(int) floor(100.0*(atof(token.c_str()))+.5);
+	      tab_->stack_[i][j][k][l] =(int) floor(100.0*(atof(token.c_str()))+.5);
 	    } else {
-	      stack_[i][j][k][l] = s_infinity;
+	      tab_->stack_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -1171,17 +2184,17 @@ void Datatable::input_tstackh_dat(const std::string &path) {
       for (j=0; j<=5; j++) {
 	for (l=0; l<=5; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)) {
-	    tstkh_[i][j][k][l]=0;
+	    tab_->tstkh_[i][j][k][l]=0;
 	  } else if ((i==5)||(j==5)) {
-	    tstkh_[i][j][k][l] = s_infinity;
+	    tab_->tstkh_[i][j][k][l] = s_infinity;
 	  } else if ((i!=5)&&(j!=5)&&((k==5)||(l==5))) {
-	    tstkh_[i][j][k][l] = 0;
+	    tab_->tstkh_[i][j][k][l] = 0;
 	  } else {
 	    infile >> token;
 	    if (token !=  ".") {
-	      tstkh_[i][j][k][l] = static_cast<int> (floor(100.0*(atof(token.c_str()))+.5));
+	      tab_->tstkh_[i][j][k][l] = static_cast<int> (floor(100.0*(atof(token.c_str()))+.5));
 	    } else {
-	      tstkh_[i][j][k][l] = s_infinity;
+	      tab_->tstkh_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -1214,17 +2227,17 @@ void Datatable::input_tstacki_dat(const std::string &path) {
       for (j=0; j<=5; j++) {
 	for (l=0; l<=5; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)) {
-	    tstki_[i][j][k][l]=0;
+	    tab_->tstki_[i][j][k][l]=0;
 	  } else if ((i==5)||(j==5)) {
-	    tstki_[i][j][k][l] = s_infinity;
+	    tab_->tstki_[i][j][k][l] = s_infinity;
 	  } else if ((i!=5)&&(j!=5)&&((k==5)||(l==5))) {
-	    tstki_[i][j][k][l] = 0;
+	    tab_->tstki_[i][j][k][l] = 0;
 	  } else {
 	    infile>> token;
 	    if (token != "."){
-	      tstki_[i][j][k][l]=(int)floor(100.0*(atof(token.c_str()))+.5);
+	      tab_->tstki_[i][j][k][l]=(int)floor(100.0*(atof(token.c_str()))+.5);
 	    } else {
-	      tstki_[i][j][k][l] = s_infinity;
+	      tab_->tstki_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -1253,7 +2266,7 @@ void Datatable::input_miscloop_dat(const std::string &path) {
     infile >> token;
 
   infile >> temp;
-  prelog_ = atof(temp.c_str()) * 100.0;
+  tab_->prelog_ = atof(temp.c_str()) * 100.0;
   //data->prelog = (data->prelog)*100.0;
   // 1.07857764 *100 = 107.857764 
 
@@ -1261,7 +2274,7 @@ void Datatable::input_miscloop_dat(const std::string &path) {
   while(token != "-->")
     infile >> token;
   infile >> temp;
-  maxpen_ = static_cast<int>( atof(temp.c_str())*100.0 + .5);
+  tab_->maxpen_ = static_cast<int>( atof(temp.c_str())*100.0 + .5);
 
 
   infile >> token;
@@ -1270,30 +2283,30 @@ void Datatable::input_miscloop_dat(const std::string &path) {
 
   for (count=1; count<= 4; count ++){
     infile >> temp;
-    poppen_[count] = static_cast<int> (atof(temp.c_str())*100.0 + .5);
+    tab_->poppen_[count] = static_cast<int> (atof(temp.c_str())*100.0 + .5);
   } 										
     
   infile >> token;
   while(token != "-->")
     infile >> token;
   // assign some variables that are"hard-wired" into code
-  eparam_[1] = 0; 						
-  eparam_[2] = 0; 					
-  eparam_[3] = 0;
-  eparam_[4] = 0;
+  tab_->eparam_[1] = 0; 						
+  tab_->eparam_[2] = 0; 					
+  tab_->eparam_[3] = 0;
+  tab_->eparam_[4] = 0;
   
   infile >> temp;
-  eparam_[5] = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5) );  //constant multi-loop penalty
+  tab_->eparam_[5] = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5) );  //constant multi-loop penalty
 
   infile >> temp;
-  eparam_[6] = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5) ); //(int) floor (temp*100.0+.5);
+  tab_->eparam_[6] = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5) ); //(int) floor (temp*100.0+.5);
 
-  eparam_[7] = 30;
-  eparam_[8] = 30;
-  eparam_[9] = -500;
+  tab_->eparam_[7] = 30;
+  tab_->eparam_[8] = 30;
+  tab_->eparam_[9] = -500;
 
   infile >> temp;
-  eparam_[10] =  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5) ); //(int) floor (temp*100.0+.5);
+  tab_->eparam_[10] =  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5) ); //(int) floor (temp*100.0+.5);
 
 
   infile >> token;
@@ -1309,13 +2322,13 @@ void Datatable::input_miscloop_dat(const std::string &path) {
     exit(1);
   }
  
-  efn2a_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5));  //constant multi-loop penalty for efn2
+  tab_->efn2a_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5));  //constant multi-loop penalty for efn2
 
   infile >> temp;
-  efn2b_=  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5));  //(int) floor(temp*100.0+.5);
+  tab_->efn2b_=  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5));  //(int) floor(temp*100.0+.5);
 
   infile >> temp;
-  efn2c_=  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5));  //(int) floor(temp*100.0+.5);
+  tab_->efn2c_=  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5));  //(int) floor(temp*100.0+.5);
 
   //now read the terminal AU penalty:
   infile >> token;
@@ -1323,35 +2336,35 @@ void Datatable::input_miscloop_dat(const std::string &path) {
     infile >> token;
   infile >> temp;
 
-  auend_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
+  tab_->auend_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
 
   //now read the GGG hairpin bonus:
   infile>>token;
   while(token != "-->")
     infile>>token;
   infile >> temp;
-  gubonus_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
+  tab_->gubonus_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
  
   //now read the poly c hairpin penalty slope:
   infile >> token;
   while(token != "-->")
     infile>>token;
   infile >> temp;
-  cslope_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
+  tab_->cslope_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
 
   //now read the poly c hairpin penalty intercept:
   infile>>token;
   while(token != "-->")
     infile>>token;
   infile >> temp;
-  cint_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
+  tab_->cint_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
 
   //now read the poly c penalty for a loop of 3:
   infile >>token;
   while(token !=  "-->")
     infile>>token;
   infile >> temp;
-  c3_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
+  tab_->c3_ = static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
 
   // Intermolecular initiation free energy 
 
@@ -1359,14 +2372,14 @@ void Datatable::input_miscloop_dat(const std::string &path) {
   while(token != "-->")
     infile>>token;
   infile >> temp;
-  init_ =  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
+  tab_->init_ =  static_cast<int> ( floor (atof(temp.c_str())*100.0+.5)); //(int) floor (temp*100.0+.5);
   
   //now read the GAIL rule indicator
   infile >> token;
   while(token != "-->")
     infile>>token;
   infile>> temp;
-  gail_ =  static_cast<int> ( floor (atof(temp.c_str()) +.5)); //(int) floor (temp+.5);
+  tab_->gail_ =  static_cast<int> ( floor (atof(temp.c_str()) +.5)); //(int) floor (temp+.5);
 }
 
 
@@ -1417,52 +2430,52 @@ void Datatable::input_tloop_dat(const std::string &path) {
    /*	Read info from tloops */
   for (count=1; count<=3; count++)
     infile >> token; //get past text in file
-  numoftloops_=0;
+  tab_->numoftloops_=0;
   infile >> token;
 
 
   for (count=1; count<=s_maxtloop&&!infile.eof(); count++){
     //cout << lineoftext;
-    numoftloops_++;
+    tab_->numoftloops_++;
     strcpy(base, token.c_str());
     strcpy(base+1, "\0");
-    tloop_[numoftloops_][0] = tonumi(base);
+    tab_->tloop_[tab_->numoftloops_][0] = tonumi(base);
     //std::cout << base << " ";
-    //std::cout << tloop_[numoftloops_][0] << "\n";
+    //std::cout << tab_->tloop_[tab_->numoftloops_][0] << "\n";
 
     //strcpy(base, token[1]);
     base[0] = token[1];
     strcpy(base+1, "\0");
-    tloop_[numoftloops_][0] = tloop_[numoftloops_][0]+  5*tonumi(base);
+    tab_->tloop_[tab_->numoftloops_][0] = tab_->tloop_[tab_->numoftloops_][0]+  5*tonumi(base);
     //std::cout << base << " ";
-    //std::cout << tloop_[numoftloops_][0] << "\n";
+    //std::cout << tab_->tloop_[tab_->numoftloops_][0] << "\n";
 
     //strcpy(base, token+2);
     base[0] = token[2];
     strcpy(base+1, "\0");
-    tloop_[numoftloops_][0] = tloop_[numoftloops_][0]+  25*tonumi(base);
+    tab_->tloop_[tab_->numoftloops_][0] = tab_->tloop_[tab_->numoftloops_][0]+  25*tonumi(base);
     //cout << base << "\n";
     //cout << data->tloop[data->numoftloops][0] << "\n";
     //strcpy(base, token+3);
     base[0] = token[3];
     strcpy(base+1, "\0");
-    tloop_[numoftloops_][0] = tloop_[numoftloops_][0]+  125*tonumi(base);
+    tab_->tloop_[tab_->numoftloops_][0] = tab_->tloop_[tab_->numoftloops_][0]+  125*tonumi(base);
     //cout << base << "\n";
     //cout << data->tloop[data->numoftloops][0] << "\n";
     //strcpy(base, lineoftext+4);
     base[0] = token[4];
     strcpy(base+1, "\0");
-    tloop_[numoftloops_][0] = tloop_[numoftloops_][0]+  625*tonumi(base);
+    tab_->tloop_[tab_->numoftloops_][0] = tab_->tloop_[tab_->numoftloops_][0]+  625*tonumi(base);
     //cout << base << "\n";
     //cout << data->tloop[data->numoftloops][0] << "\n";
     //strcpy(base, lineoftext+5);
     base[0] = token[5];
     strcpy(base+1, "\0");
-    tloop_[numoftloops_][0] = tloop_[numoftloops_][0]+ 3125*tonumi(base);
+    tab_->tloop_[tab_->numoftloops_][0] = tab_->tloop_[tab_->numoftloops_][0]+ 3125*tonumi(base);
     infile >> temp;
-    tloop_[numoftloops_][1] = (int) floor (100.0*atof(temp)+0.5);
-    //std::cout<< "ntloops[0]="<< numoftloops_ << ": "<<base <<  ":"<< tloop_[numoftloops_][0] << std::endl;
-    //std::cout<< "ntloops[1]="<< numoftloops_ << ": "<<  tloop_[numoftloops_][1] << std::endl;
+    tab_->tloop_[tab_->numoftloops_][1] = (int) floor (100.0*atof(temp)+0.5);
+    //std::cout<< "ntloops[0]="<< tab_->numoftloops_ << ": "<<base <<  ":"<< tab_->tloop_[tab_->numoftloops_][0] << std::endl;
+    //std::cout<< "ntloops[1]="<< tab_->numoftloops_ << ": "<<  tab_->tloop_[tab_->numoftloops_][1] << std::endl;
     infile >> token;
   }
 
@@ -1509,18 +2522,18 @@ void Datatable::input_dangle_dat(const std::string &path) {
       for (j=0; j<=5; j++) {
 	for (k=0; k<=5; k++) {
 	  if ((i==0)||(j==0)||(k==0)) {
-	    dangle_[i][j][k][l] = 0;
+	    tab_->dangle_[i][j][k][l] = 0;
 	  } else if ((i==5)||(j==5)) {
-	    dangle_[i][j][k][l] = s_infinity;
+	    tab_->dangle_[i][j][k][l] = s_infinity;
 	  } else if ((i!=5)&&(j!=5)&&(k==5)) { /* note there was only one "&" (j!=5)&(k==5) in original code! */
-	    dangle_[i][j][k][l] = 0;
+	    tab_->dangle_[i][j][k][l] = 0;
 	  } else {
 	    infile >> token;
 	    //cout << lineoftext<<"\n";
 	    if (token !=  "."){
-	      dangle_[i][j][k][l] = static_cast<int> ( floor (100.0*(atof(token.c_str()))+.5));
+	      tab_->dangle_[i][j][k][l] = static_cast<int> ( floor (100.0*(atof(token.c_str()))+.5));
 	    } else {
-	      dangle_[i][j][k][l] = s_infinity;
+	      tab_->dangle_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -1586,7 +2599,7 @@ void Datatable::input_int22_dat(const std::string &path) {
 	for (l=1; l<=4; l++) {
 	  for (m=1; m<=4; m++) {
 	    infile >> temp;
-	    iloop22_[a][b][c][d][j][l][k][m] = static_cast<int> (floor(100.0*atof(temp)+0.5));
+	    tab_->iloop22_[a][b][c][d][j][l][k][m] = static_cast<int> (floor(100.0*atof(temp)+0.5));
 	  }
 	}
       }
@@ -1597,8 +2610,8 @@ void Datatable::input_int22_dat(const std::string &path) {
 /**
  * Read from int21.dat,  the 2x1 internal loop data
  * The indexing system of iloop21 is as follows:
- * iloop21_[a][b][c][d][e][f][g] corresponds to:
- *  iloop21_[jp][ip][jp+1][ip-1][i+1][j][i];
+ * tab_->iloop21_[a][b][c][d][e][f][g] corresponds to:
+ *  tab_->iloop21_[jp][ip][jp+1][ip-1][i+1][j][i];
  * Note that in this arrangement, "i" is the based-paired
  * nucleotide "on the bottom right".
  * \verbatim
@@ -1684,7 +2697,7 @@ void Datatable::input_int21_dat(const std::string &path){
 	  }
 	  for (d=1; d<=4; d++) {
 	    infile >> temp;
-	    iloop21_[a][b][c][d][e][f][g]= static_cast<int> ( floor(100.0*atof(temp)+0.5));
+	    tab_->iloop21_[a][b][c][d][e][f][g]= static_cast<int> ( floor(100.0*atof(temp)+0.5));
 	  }
 	}
       }
@@ -1716,7 +2729,7 @@ void Datatable::input_int21_dat(const std::string &path){
    .   -2.1    .   -1.0    .     .     .     .     .   -1.4    .    0.3    .     .     .     .   
  -0.9    .   -1.3    .     .     .     .     .   -0.6    .   -0.5    .     .     .     .     .    
 \endverbatim
-* It is placed in coax_[j][i][k][l].
+* It is placed in tab_->coax_[j][i][k][l].
 * There are four blocks (indexed by j). The overall column is indexed by i. The individual 4x4 block is
 * indexed by k and l.
 */
@@ -1740,16 +2753,16 @@ void Datatable::input_coaxial_dat(const std::string &path){
       for (j=0; j<=5; j++) {
 	for (l=0; l<=5; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)) {
-	    coax_[j][i][k][l]=0;
+	    tab_->coax_[j][i][k][l]=0;
 	  } else if ((i==5)||(j==5)||(k==5)||(l==5)) {
-	    coax_[j][i][k][l] = s_infinity;
+	    tab_->coax_[j][i][k][l] = s_infinity;
 	  } else {
 	    infile >> token;
 	    if (token != "."){
-	      coax_[j][i][k][l] = static_cast<int> ( floor(100.0*(atof(token.c_str()))+.5));
-	      //std::cout << "i=" << i << " j=" << j << " k=" << k << " l="<< l << " coax=" << coax_[j][i][k][l] << std::endl;
+	      tab_->coax_[j][i][k][l] = static_cast<int> ( floor(100.0*(atof(token.c_str()))+.5));
+	      //std::cout << "i=" << i << " j=" << j << " k=" << k << " l="<< l << " coax=" << tab_->coax_[j][i][k][l] << std::endl;
 	    } else {
-	      coax_[j][i][k][l] = s_infinity;
+	      tab_->coax_[j][i][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -1781,34 +2794,34 @@ void Datatable::input_triloop_dat(const std::string &path) {
 
   for (count=1; count<=3; count++)
     infile >> token; //get past text in file
-  numoftriloops_=0;
+  tab_->numoftriloops_=0;
   infile >> token;
 
   for (count=1; count<=s_maxtloop && !infile.eof(); count++){
     //std::cout << token<<"\n";
-    numoftriloops_++;
+    tab_->numoftriloops_++;
     //strcpy(base, token.c_str());
     base[0]=token[0];
     strcpy(base+1, "\0");
-    triloop_[numoftriloops_][0] = tonumi(base);
+    tab_->triloop_[tab_->numoftriloops_][0] = tonumi(base);
     //strcpy(base, lineoftext+1);
     base[0]=token[1];
     strcpy(base+1, "\0");
-    triloop_[numoftriloops_][0] = triloop_[numoftriloops_][0]+  5*tonumi(base);
+    tab_->triloop_[tab_->numoftriloops_][0] = tab_->triloop_[tab_->numoftriloops_][0]+  5*tonumi(base);
     //strcpy(base, lineoftext+2);
     base[0]=token[2];
     strcpy(base+1, "\0");
-    triloop_[numoftriloops_][0] = triloop_[numoftriloops_][0]+ 25*tonumi(base);
+    tab_->triloop_[tab_->numoftriloops_][0] = tab_->triloop_[tab_->numoftriloops_][0]+ 25*tonumi(base);
     //strcpy(base, lineoftext+3);
     base[0]=token[3];
     strcpy(base+1, "\0");
-    triloop_[numoftriloops_][0] = triloop_[numoftriloops_][0]+ 125*tonumi(base);
+    tab_->triloop_[tab_->numoftriloops_][0] = tab_->triloop_[tab_->numoftriloops_][0]+ 125*tonumi(base);
     //strcpy(base, lineoftext+4);
     base[0]=token[4];
     strcpy(base+1, "\0");
-    triloop_[numoftriloops_][0] = triloop_[numoftriloops_][0]+ 625*tonumi(base);
+    tab_->triloop_[tab_->numoftriloops_][0] = tab_->triloop_[tab_->numoftriloops_][0]+ 625*tonumi(base);
     infile >> temp;
-    triloop_[numoftriloops_][1] = static_cast<int> (floor (100.0*atof(temp)+0.5));
+    tab_->triloop_[tab_->numoftriloops_][1] = static_cast<int> (floor (100.0*atof(temp)+0.5));
     //cout << data->triloop[data->numoftriloops][1]<< "  "<<data->triloop[data->numoftriloops][0]<<"\n";
 
     infile >> token;
@@ -1839,14 +2852,14 @@ void Datatable::input_tstackcoax_dat(const std::string &path) {
       for (j=0; j<=5; j++) {
 	for (l=0; l<=5; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)||(i==5)||(j==5)||(k==5)||(l==5)) {
-	    tstackcoax_[i][j][k][l]=0;
+	    tab_->tstackcoax_[i][j][k][l]=0;
 	  } else {
 	    infile >> token;
 	    if (token !=  "."){
-	      tstackcoax_[i][j][k][l] = static_cast<int> (floor(100.0*(atof(token.c_str()))+.5));
-	      //std::cout << "i="<<i << " j=" << j << " k="<<k<< " l="<<l << " tstackcoax=" << tstackcoax_[i][j][k][l] << std::endl;
+	      tab_->tstackcoax_[i][j][k][l] = static_cast<int> (floor(100.0*(atof(token.c_str()))+.5));
+	      //std::cout << "i="<<i << " j=" << j << " k="<<k<< " l="<<l << " tstackcoax=" << tab_->tstackcoax_[i][j][k][l] << std::endl;
 	    }  else {
-	      tstackcoax_[i][j][k][l] = s_infinity;
+	      tab_->tstackcoax_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -1896,14 +2909,14 @@ void Datatable::input_coaxstack_dat(const std::string &path) {
       for (j=0; j<=4; j++) {
 	for (l=0; l<=4; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)||(i==5)||(j==5)||(k==5)||(l==5)) {
-	    coaxstack_[i][j][k][l]=0;
+	    tab_->coaxstack_[i][j][k][l]=0;
 	  } else {
 	    infile >> token;
 	    if (token !=  "."){
-	      coaxstack_[i][j][k][l] = static_cast<int> ( floor(100.0*(atof(token.c_str()))+.5));
-	      //std::cout << "i="<<i << " j=" << j << " k="<<k<< " l="<<l << " coaxstack=" << coaxstack_[i][j][k][l] << std::endl;
+	      tab_->coaxstack_[i][j][k][l] = static_cast<int> ( floor(100.0*(atof(token.c_str()))+.5));
+	      //std::cout << "i="<<i << " j=" << j << " k="<<k<< " l="<<l << " coaxstack=" << tab_->coaxstack_[i][j][k][l] << std::endl;
 	    } else {
-	      coaxstack_[i][j][k][l] = s_infinity;
+	      tab_->coaxstack_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -1916,10 +2929,10 @@ void Datatable::input_coaxstack_dat(const std::string &path) {
 
 /**
  * this function calculates whether a terminal pair i, j requires the end penalty
- * It returns the value of auend_ if either position i or j is a U (then the other
+ * It returns the value of tab_->auend_ if either position i or j is a U (then the other
  * position would be an A). Otherwise it returns zero.
  */
-int Datatable::penalty(int i, int j, RNAStructure* ct) {
+int Datatable::penalty(int i, int j, const RNAStructure* ct) const {
 
   /*if ((ct->numseq[i]==1)||(ct->numseq[j]==1)) {
   //this is an A-U pair
@@ -1935,7 +2948,7 @@ int Datatable::penalty(int i, int j, RNAStructure* ct) {
   return data->auend;
   } */
   if (ct->numseq(i)==4||ct->numseq(j)==4)
-    return auend_;
+    return tab_->auend_;
   else return 0; //no end penalty
 
 
@@ -1947,7 +2960,7 @@ int Datatable::penalty(int i, int j, RNAStructure* ct) {
  */
 int Datatable::penalty2(int i, int j) const {
   if (i==4||j==4)
-    return auend_;
+    return tab_->auend_;
   else return 0; //no end penalty
 }
 
@@ -1979,25 +2992,25 @@ void Datatable::input_tstack_dat(const std::string &path) {
       for (j=0; j<=5; j++) {
 	for (l=0; l<=5; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)) {
-	    tstack_[i][j][k][l]=0;
+	    tab_->tstack_[i][j][k][l]=0;
 	  } else if ((i==5)||(j==5)) {
-	    tstack_[i][j][k][l] = s_infinity;
+	    tab_->tstack_[i][j][k][l] = s_infinity;
 	  } else if ((k==5)||(l==5)) {
 	    //include "5", linker for intermolecular for case of flush ends
 	    if ((k==5)&&(l==5)) {//flush end
-	      tstack_[i][j][k][l]=0;
+	      tab_->tstack_[i][j][k][l]=0;
 	    } else if (k==5) {//5' dangling end
 	      //look up number for dangling end
-	      tstack_[i][j][k][l] = dangle_[i][j][l][2]+penalty2(i, j);
+	      tab_->tstack_[i][j][k][l] = tab_->dangle_[i][j][l][2]+penalty2(i, j);
 	    } else if (l==5) {//3' dangling end
-	      tstack_[i][j][k][l] = dangle_[i][j][k][1]+penalty2(i, j);
+	      tab_->tstack_[i][j][k][l] = tab_->dangle_[i][j][k][1]+penalty2(i, j);
 	    }
 	  } else {
 	    infile>> token;
 	    if (token != "."){
-	      tstack_[i][j][k][l] =(int) floor (100.0*(atof(token.c_str()))+.5);
+	      tab_->tstack_[i][j][k][l] =(int) floor (100.0*(atof(token.c_str()))+.5);
 	    } else {
-	      tstack_[i][j][k][l] = s_infinity;
+	      tab_->tstack_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -2029,13 +3042,13 @@ void Datatable::input_tstackm_dat(const std::string &path) {
       for (j=0; j<=4; j++) {
 	for (l=0; l<=4; l++) {
 	  if ((i==0)||(j==0)||(k==0)||(l==0)) {
-	    tstkm_[i][j][k][l]=0;
+	    tab_->tstkm_[i][j][k][l]=0;
 	  } else {
 	    infile>> token;
 	    if (token !=  "."){
-	      tstkm_[i][j][k][l] = static_cast<int> (floor(100.0*(atof(token.c_str()))+.5));
+	      tab_->tstkm_[i][j][k][l] = static_cast<int> (floor(100.0*(atof(token.c_str()))+.5));
 	    } else {
-	      tstkm_[i][j][k][l] = s_infinity;
+	      tab_->tstkm_[i][j][k][l] = s_infinity;
 	    }
 	  }
 	}
@@ -2116,7 +3129,7 @@ void Datatable::input_int11_dat(const std::string &path){
 	}
 	for (e=1; e<=4; e++) {
 	  infile >> temp;
-	  iloop11_[a][b][c][d][e][f]= static_cast<int>(floor(100.0*atof(temp)+0.5));
+	  tab_->iloop11_[a][b][c][d][e][f]= static_cast<int>(floor(100.0*atof(temp)+0.5));
 	}
       }
     }
@@ -2151,8 +3164,8 @@ int Datatable::get_tetraloop_energy(const char *seq) const {
   base[0]=seq[5];
   y = y + 3125*tonumi(base);
   for (int i=1;i<s_maxtloop;++i) {
-    if (tloop_[i][0] == y)
-      return tloop_[i][1];
+    if (tab_->tloop_[i][0] == y)
+      return tab_->tloop_[i][1];
   }
   return 0;
 }
@@ -2160,85 +3173,85 @@ int Datatable::get_tetraloop_energy(const char *seq) const {
 
 
 int Datatable::get_destabilizing_energy_internal_loop(unsigned int loop_size) const {
-  return inter_[loop_size];
+  return tab_->inter_[loop_size];
 }
 
 int Datatable::get_destabilizing_energy_bulge_loop(unsigned int loop_size) const {
-  return bulge_[loop_size];
+  return tab_->bulge_[loop_size];
 }
 
 int Datatable::get_destabilizing_energy_hairpin_loop(unsigned int loop_size) const {
-  return hairpin_[loop_size];
+  return tab_->hairpin_[loop_size];
 }
 
 int Datatable::get_stack_energy(int w, int x, int y, int z) const {
-  return stack_[w][x][y][z];
+  return tab_->stack_[w][x][y][z];
 }
 
 /**
  * @return terminal stacking energy of base-pair or mismatch 
  */
 int Datatable::get_tstackh_energy(int w, int x, int y, int z) const {
-  return tstkh_[w][x][y][z];
+  return tab_->tstkh_[w][x][y][z];
 }
 
 /**
  * @return terminal stacking energy of base-pair or mismatch 
  */
 int Datatable::get_tstacki_energy(int w, int x, int y, int z) const {
-  return tstki_[w][x][y][z];
+  return tab_->tstki_[w][x][y][z];
 }
 
 float Datatable::get_prelog() const {
-  return prelog_;
+  return tab_->prelog_;
 }
 
 int Datatable::get_maxpen() const {
-  return maxpen_;
+  return tab_->maxpen_;
 }
 
 int Datatable::get_poppen(unsigned int i) const{
-  return poppen_[i];
+  return tab_->poppen_[i];
 }
 
 /**
  * This value corresponds to multibranched loops 
  offset in the miscloop file (3.4, should be 340). */
 int Datatable::get_constant_multiloop_penalty() const {
-  return eparam_[5];
+  return tab_->eparam_[5];
 }
 
 /** constant multi-loop penalty for efn2 */
 int Datatable::get_constant_efn2_multiloop_penalty() const {
-  return efn2a_;
+  return tab_->efn2a_;
 }
 
-/** @return terminal AU penalty (auend_, from miscloop.dat)  */
+/** @return terminal AU penalty (tab_->auend_, from miscloop.dat)  */
 int Datatable::get_terminal_AU_penalty() const {
-  return auend_;
+  return tab_->auend_;
 }
 
 int Datatable::get_GU_bonus() const {
-  return gubonus_;
+  return tab_->gubonus_;
 }
 
 int Datatable::get_c_hairpin_intercept() const {
-  return  cint_;
+  return  tab_->cint_;
 }
  
 int Datatable::get_c_hairpin_slope() const {
-  return cslope_;
+  return tab_->cslope_;
 }
 int Datatable::get_c_hairpin_of_3() const{
-  return c3_;
+  return tab_->c3_;
 }
 
 int Datatable::get_intermolecular_initiation_free_energy() const {
-  return init_;
+  return tab_->init_;
 }
   
 int Datatable::get_GAIL() const {
-  return gail_;
+  return tab_->gail_;
 }
 
 /**
@@ -2249,18 +3262,18 @@ int Datatable::get_GAIL() const {
  * \param l Refers to the overall four-block (l=1 first four, l=2 second four).
  */
  int Datatable::get_dangle_energy(int i, int j, int k, int l) const {
-  return dangle_[i][j][k][l];
+  return tab_->dangle_[i][j][k][l];
 }
 
 
 int Datatable::get_iloop22(int a, int b, int c, int d, int j, int k, int l, int m) const {
-  return iloop22_[a][b][c][d][j][k][l][m];
+  return tab_->iloop22_[a][b][c][d][j][k][l][m];
 }
 
 int Datatable::get_coaxial_energy(int i, int j, int k, int l) const {
-  return coax_[i][j][k][l];
+  return tab_->coax_[i][j][k][l];
 }
 
 int Datatable::get_tstack_coaxial_energy(int i, int j, int k, int l) const {
-    return tstackcoax_[i][j][k][l];
+    return tab_->tstackcoax_[i][j][k][l];
   }
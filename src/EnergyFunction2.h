@@ -36,6 +36,14 @@
  *
  * The program first reads in all of these files in the indicated order.
  *
+ * A loaded parameter set can be published into a POSIX shared-memory segment
+ * (publish_shared), which other processes on the same machine attach to read-only
+ * (attach_shared) without parsing any files.
+ *
+ * The .dat files hold free energies at 37 degrees. If the enthalpy files of
+ * mfold (loop.dh, stack.dh, ..., same layout as the .dat files) are loaded with
+ * load_enthalpies, at_temperature derives (and caches) tables for other temperatures.
+ *
  * \note Still prototyping.
  *
  * \author Peter Robinson
@@ -52,6 +60,12 @@
  */
 
 #include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <iosfwd>
+#include <mutex>
+#include <stdint.h>
 #if !defined(DEFINES_H)
 #define DEFINES_H
 #define maxfil 100    //maximum length of file names
@@ -70,15 +84,24 @@
 
 
 class RNAStructure;
+class EnergyEvaluator;
+class ThreadPool;
+class Structstack;
 
 
-class Datatable {
-  /** A large number (infinity for the minimisation operations). */
-  static const int s_infinity = 9999999;
+/**
+ * \struct EnergyTables
+ *
+ * \brief The numerical contents of the thermodynamic data files.
+ *
+ * A plain block of integers (and one float) without any pointers, so that
+ * one loaded parameter set can be copied, rescaled, or placed in shared memory
+ * and used in place by other processes (see Datatable::publish_shared).
+ * All energies are 100 x kcal/mol.
+ */
+struct EnergyTables {
   /** maximum tetraloops allowed (info read from tloop). */
   static const int s_maxtloop = 100;
-  /**  The path to the directory containing the thermodynamic datafiles. */
-  char * dirpath_;
   /** the f(m) array (see Ninio for details)  */
   int poppen_[5];
   /** asymmetric internal loops: the ninio equation the maximum correction (miscloop.dat) */
@@ -158,14 +181,63 @@ class Datatable {
   /** Extrapolation for large loops based on polymer theory 
    * internal, bulge or hairpin loops > 30: dS(T)=dS(30)+param*ln(n/30) (from miscloop.dat) */
   float prelog_;
+};
+
+
+/**
+ * \class Datatable
+ *
+ * \brief The thermodynamic parameters read from the dat folder.
+ *
+ * Thread safety: once constructed (and after load_enthalpies, if used), a Datatable is
+ * not modified any more. All const member functions, including efn2/erg1-erg4 and
+ * at_temperature, may be called concurrently from any number of threads on one shared
+ * object. The per-call working storage of efn2 lives in an EnergyEvaluator, of which
+ * each thread should own its own instance.
+ */
+class Datatable {
+  friend class EnergyEvaluator;
+  /** A large number (infinity for the minimisation operations). */
+  static const int s_infinity = 9999999;
+  /** maximum tetraloops allowed (info read from tloop). */
+  static const int s_maxtloop = EnergyTables::s_maxtloop;
+  /**  The path to the directory containing the thermodynamic datafiles. */
+  char * dirpath_;
+  /** The extension of the parameter files that were read (".dat" for free energies, ".dh" for enthalpies). */
+  std::string suffix_;
+  /** The temperature (degrees Celsius) at which the energies in this table apply. */
+  double temperature_;
+  /** Enthalpy tables (mfold .dh files) with the same layout as this table, or NULL if not loaded. */
+  Datatable *enthalpy_;
+  /** Tables rescaled to other temperatures, keyed by tenths of a degree Celsius (see at_temperature). */
+  mutable std::map<int, Datatable*> temperature_cache_;
+  /** Guards temperature_cache_ so that sweeps over temperature can run in parallel. */
+  mutable std::mutex cache_mutex_;
+  /** The parameter tables proper (owned, or mapped from a shared-memory segment). */
+  EnergyTables *tab_;
+  /** Start of the shared-memory mapping the tables were attached from (NULL if the tables are owned). */
+  void *shm_base_;
+  /** Length in bytes of the shared-memory mapping. */
+  size_t shm_length_;
   /**
    * @param directory_path The path to the directory containing the thermodynamic datafiles.
    */
 public:
   Datatable(const char* directory_path);
+  Datatable(const char* directory_path, const char *suffix);
   ~Datatable();
 
   const char* get_data_dir() const;
+  double get_temperature() const;
+  void load_enthalpies(const char* directory_path, const char *suffix = ".dh");
+  bool has_enthalpies() const;
+  const Datatable& at_temperature(double celsius) const;
+  uint64_t get_fingerprint() const;
+  void publish_shared(const char *name) const;
+  static Datatable* attach_shared(const char *name, uint64_t fingerprint = 0);
+  static void unlink_shared(const char *name);
+  bool is_shared() const;
+  bool is_from(const char* directory_path, const char *suffix = ".dat") const;
 
   int get_destabilizing_energy_internal_loop(unsigned int loop_size) const;
   int get_destabilizing_energy_bulge_loop(unsigned int loop_size) const;
@@ -191,12 +263,16 @@ public:
   int get_coaxial_energy(int i, int j, int k, int l) const;
   int get_tstack_coaxial_energy(int i, int j, int k, int l) const;
 
-  void efn2(RNAStructure *ct, int structnum);
-  int erg1(int i, int j, int ip, int jp, RNAStructure *ct);
-  int erg2(int i, int j, int ip, int jp, RNAStructure *ct, int a, int b);
-  int erg3(int i, int j, RNAStructure *ct, int dbl);
-  int erg4(int i, int j, int ip, int jp, RNAStructure *ct, bool lfce) const;
+  void efn2(const RNAStructure *ct, int structnum) const;
+  int erg1(int i, int j, int ip, int jp, const RNAStructure *ct) const;
+  int erg2(int i, int j, int ip, int jp, const RNAStructure *ct, int a, int b) const;
+  int erg3(int i, int j, const RNAStructure *ct, int dbl) const;
+  int erg4(int i, int j, int ip, int jp, const RNAStructure *ct, bool lfce) const;
 private:
+  Datatable(const Datatable &dg, const Datatable &dh, double celsius);
+  Datatable(void *shm_base, size_t shm_length);
+  Datatable(const Datatable &);
+  Datatable& operator=(const Datatable &);
   void input_data();
   void input_loop_dat(const std::string &path);
   void input_stack_dat(const std::string &path);
@@ -214,7 +290,7 @@ private:
   void input_tstack_dat(const std::string &path);
   void input_tstackm_dat(const std::string &path);
   void input_int11_dat(const std::string &path);
-  int penalty(int i, int j, RNAStructure* ct);
+  int penalty(int i, int j, const RNAStructure* ct) const;
 //this function calculates whether a terminal pair i, j requires the end penalty
   int penalty2(int i, int j) const;
  
@@ -227,5 +303,251 @@ private:
 
 
 
+
+/**
+ * \struct LoopDecomposition
+ *
+ * \brief The energy of each loop of one or more structures, as parallel flat arrays.
+ *
+ * Record k describes one loop: the structure it belongs to, its type, the closing pair
+ * i.j (0.0 for the exterior loop), its size (number of unpaired bases in the loop) and
+ * its energy (100 x kcal/mol). The energies of the records of a structure add up to its
+ * efn2 energy. EnergyEvaluator::decompose appends to the arrays, so that the loops of
+ * many structures can be gathered into one table and exported column by column; the
+ * arrays keep their capacity across clear().
+ */
+struct LoopDecomposition {
+  /** The kinds of loops. */
+  enum LoopType { EXTERIOR, STACK, HAIRPIN, BULGE, INTERIOR, MULTI };
+  std::vector<int> structure;
+  std::vector<unsigned char> type;
+  std::vector<int> i;
+  std::vector<int> j;
+  std::vector<int> size;
+  std::vector<int> energy;
+
+  size_t get_number_of_loops() const { return type.size(); }
+  void clear();
+  void push_back(int s, LoopType t, int ci, int cj, int sz, int e);
+  void append(const LoopDecomposition &other);
+  int get_total_energy(int s) const;
+  static const char *type_name(int t);
+  void write_tsv(std::ostream &out) const;
+};
+
+
+
+/**
+ * \class ForceConstraints
+ *
+ * \brief The folding constraints that efn2 takes into account, in O(n) space.
+ *
+ * mfold keeps these in a dense triangular array fce[i][j-i] that is zero almost everywhere.
+ * efn2 only ever sets the flag 5 there (forceinterefn), for the segments that span an
+ * intermolecular linker. at(i,j) answers the same query in constant time from the (at
+ * most three) linker positions:
+ * - 5 if an intermolecular linker lies strictly between i and j,
+ * - 0 otherwise.
+ */
+class ForceConstraints {
+  /** Positions of the intermolecular linker bases (numseq()==5). */
+  std::vector<int> linker_;
+ public:
+  void assign(const RNAStructure *ct);
+  /**
+   * @param i first base of a segment
+   * @param j last base of the segment (j>=i)
+   * @return the mfold constraint flag of the segment, i.e., the former fce[i][j-i].
+   */
+  int at(int i, int j) const {
+    for (size_t k=0; k<linker_.size(); k++)
+      if (linker_[k]>i && linker_[k]<j)
+	return 5;
+    return 0;
+  }
+  /** @return The number of bytes used by the constraints. */
+  size_t get_size() const {
+    return sizeof(int) * linker_.capacity();
+  }
+};
+
+
+
+/**
+ * \class LoopPlan
+ *
+ * \ingroup Folding
+ *
+ * \brief The loops of one target structure, decomposed once, to score many sequences against it.
+ *
+ * efn2 finds the loops of a structure by walking it with a Structstack. When many
+ * candidate sequences are scored against the same structure (inverse folding), the
+ * plan does this walk once. The stacked pairs, which make up most of a structure,
+ * are kept apart from the other loops: their energy depends only on four bases, so
+ * that EnergyEvaluator::evaluate_plan scores each stack for a whole block of
+ * sequences at a time with table lookups.
+ */
+class LoopPlan {
+  /** number of bases of the target structure */
+  int numbases_;
+  /** the target structure in dot-bracket notation */
+  std::string structure_;
+  /** pairs_[k] is the partner of base k (one-based) or 0 */
+  std::vector<int> pairs_;
+  /** 5' base i of the stacks i.j on i+1.j-1 */
+  std::vector<int> stack_i_;
+  /** 3' base j of the stacks i.j on i+1.j-1 */
+  std::vector<int> stack_j_;
+  /** type of each other loop (hairpin, bulge, interior or multi-branch loop) */
+  std::vector<unsigned char> loop_type_;
+  /** closing pair i.j of each other loop */
+  std::vector<int> loop_i_;
+  std::vector<int> loop_j_;
+  /** inner pair ip.jp of the bulge/interior loops (0 otherwise) */
+  std::vector<int> loop_ip_;
+  std::vector<int> loop_jp_;
+ public:
+  LoopPlan(const RNAStructure *target, int structnum = 1);
+  int get_number_of_bases() const { return numbases_; }
+  const std::string& get_structure() const { return structure_; }
+  size_t get_number_of_stacks() const { return stack_i_.size(); }
+  size_t get_number_of_loops() const { return loop_type_.size(); }
+  friend class EnergyEvaluator;
+};
+
+
+
+/**
+ * \class EnergyEvaluator
+ *
+ * \ingroup Folding
+ *
+ * \brief Per-thread context for evaluating structures with efn2.
+ *
+ * The evaluator holds a reference to an immutable Datatable, which may be shared
+ * by the evaluators of all threads, together with the working storage
+ * and the results of the last evaluation. An evaluator must not be used by
+ * two threads at the same time; create one per worker thread instead.
+ * The RNAStructure passed to efn2 is only read, so several evaluators can also
+ * score the same structure concurrently.
+ *
+ * The scratch arrays of efn2 (the force constraints and the per-loop helix and coax arrays)
+ * are kept between calls and only grow, to the size needed by the largest structure
+ * seen so far. Once an evaluator has scored a structure of the maximal length (or has
+ * been sized with reserve), further calls to efn2 do not touch the heap.
+ *
+ * With set_memoize(true), the evaluator remembers the energies of the hairpin and
+ * bulge/internal loops it has computed, keyed by their closing pairs. The structures
+ * of a suboptimal ensemble share most of these loops, so that scoring the whole
+ * ensemble mostly costs the loops that differ. The cache belongs to one sequence and is
+ * dropped automatically when a structure with another sequence is evaluated.
+ */
+class EnergyEvaluator {
+ public:
+  /** How the ends of the helices in multi-branch and exterior loops are scored. */
+  enum DangleModel {
+    /** dangling ends, terminal mismatches and coaxial stacking, optimized over the loop (efn2) */
+    COAXIAL_STACKING,
+    /** 5' and 3' dangling ends on every helix, no coaxial stacking */
+    D2_DANGLES,
+    /** no stacking on the helix ends */
+    NO_DANGLES
+  };
+ private:
+  /** Number of helices per loop for which reserve() sizes the coax array. */
+  static const int s_reserved_branches = 64;
+  /** The (shared, read-only) parameter tables. */
+  const Datatable &dat_;
+  /** The model for the helix ends (see set_model). */
+  DangleModel model_;
+  /** 100 x the free energy of each structure of the last call to efn2 (one-based). */
+  std::vector<int> energy_;
+  /** The constraints (intermolecular linkers) of the structure being evaluated. */
+  ForceConstraints fce_;
+  /** Storage of the helix[k][2] array of the loop being evaluated. */
+  std::vector<int> helix_store_;
+  /** Row pointers into helix_store_. */
+  std::vector<int*> helix_rows_;
+  /** Storage of the coax[k][l] array (coaxial stacking DP) of the loop being evaluated. */
+  std::vector<int> coax_store_;
+  /** Row pointers into coax_store_. */
+  std::vector<int*> coax_rows_;
+  /** Upper bound of the number of entries of the loop cache; it is cleared when this is reached. */
+  static const size_t s_max_cached_loops = 1 << 20;
+  /** Whether hairpin and bulge/internal loop energies are memoized (see set_memoize). */
+  bool memoize_;
+  /** The closing pairs i.j and ip.jp of a cached loop (ip = jp = 0 for a hairpin). */
+  struct LoopKey {
+    int i, j, ip, jp;
+    bool operator==(const LoopKey &other) const {
+      return i == other.i && j == other.j && ip == other.ip && jp == other.jp;
+    }
+  };
+  /** Mixes all four indices, so that long sequences do not collide. */
+  struct LoopKeyHash {
+    size_t operator()(const LoopKey &k) const {
+      uint64_t h = (static_cast<uint64_t>(static_cast<uint32_t>(k.i)) << 32 | static_cast<uint32_t>(k.j))
+	* 0x9e3779b97f4a7c15ULL;
+      h ^= (static_cast<uint64_t>(static_cast<uint32_t>(k.ip)) << 32 | static_cast<uint32_t>(k.jp))
+	+ (h >> 29);
+      h *= 0xbf58476d1ce4e5b9ULL;
+      return static_cast<size_t>(h ^ (h >> 31));
+    }
+  };
+  typedef std::unordered_map<LoopKey, int, LoopKeyHash> LoopCache;
+  /** Loop energies keyed by their closing pairs, valid for the sequence with hash cache_sequence_. */
+  LoopCache loop_cache_;
+  /** Hash of the sequence and constraints the cached loops belong to. */
+  uint64_t cache_sequence_;
+  /** Number of loop energies taken from the cache. */
+  unsigned long cache_hits_;
+  /** Number of loop energies computed and added to the cache. */
+  unsigned long cache_misses_;
+  /** Encoded bases of a block of sequences scored by evaluate_plan, base-major (codes_[k*count+s]). */
+  std::vector<unsigned char> codes_;
+ public:
+  explicit EnergyEvaluator(const Datatable &dat);
+  const Datatable& get_datatable() const { return dat_; }
+  void reserve(int numbases, int numstructures = 1);
+  void efn2(const RNAStructure *ct, int structnum);
+  int evaluate(const RNAStructure *ct, int structnum);
+  void prepare(const RNAStructure *ct);
+  int loop_energy(const RNAStructure *ct, const int *bp, int i, int j);
+  int exterior_energy(const RNAStructure *ct, const int *bp);
+  void decompose(const RNAStructure *ct, int structnum, LoopDecomposition *loops);
+  void evaluate_plan(const LoopPlan &plan, const std::string *sequences, int count, int *energies);
+  int get_energy(int structnum) const;
+  const std::vector<int>& get_energies() const { return energy_; }
+  size_t get_scratch_size() const;
+  void set_model(DangleModel model);
+  DangleModel get_model() const { return model_; }
+  void set_memoize(bool memoize);
+  bool get_memoize() const { return memoize_; }
+  unsigned long get_cache_hits() const { return cache_hits_; }
+  unsigned long get_cache_misses() const { return cache_misses_; }
+ private:
+  int hairpin_energy(const RNAStructure *ct, int i, int j);
+  int internal_energy(const RNAStructure *ct, int i, int j, int ip, int jp);
+  static uint64_t sequence_hash(const RNAStructure *ct);
+  int score(const RNAStructure *ct, int structnum);
+  int classify_loop(const RNAStructure *ct, const int *bp, int i, int j,
+		    LoopDecomposition::LoopType *type, int *size);
+  int multi_loop(const RNAStructure *ct, const int *bp, int i, int j, Structstack *stack);
+  int exterior_loop(const RNAStructure *ct, const int *bp, int i, Structstack *stack);
+  static int **scratch_matrix(std::vector<int> &store, std::vector<int*> &rows, int nrows, int ncols);
+};
+
+
+
+void efn2_batch(const Datatable &dat, RNAStructure *ct, ThreadPool &pool, bool sort = false);
+void decompose_batch(const Datatable &dat, const RNAStructure *ct, ThreadPool &pool,
+		     LoopDecomposition *loops);
+void efn2_plan_batch(const Datatable &dat, const LoopPlan &plan,
+		     const std::vector<std::string> &sequences, ThreadPool &pool,
+		     std::vector<int> *energies, int block = 256);
+long efn2_stream(const Datatable &dat, std::istream &in, std::ostream &out, ThreadPool &pool,
+		 int chunk = 4096);
+
+
 #endif
 /* eof */
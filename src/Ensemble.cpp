@@ -0,0 +1,302 @@
+#include "Ensemble.h"
+#include "RNAStructure.h"
+
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+
+/** The first four bytes of an ensemble file. */
+static const char s_magic[4] = { 'R', 'N', 'X', 'E' };
+/** The version of the format written by EnsembleWriter. */
+static const uint32_t s_version = 1;
+/** Length of the fixed header (magic, version, bases, reserved, structures, index offset). */
+static const size_t s_header_length = 32;
+
+static void put_fixed(std::string *buf, uint64_t value, int nbytes) {
+  for (int b=0; b<nbytes; b++) {
+    buf->push_back(static_cast<char>(value & 0xff));
+    value >>= 8;
+  }
+}
+
+static uint64_t get_fixed(const unsigned char *p, int nbytes) {
+  uint64_t value = 0;
+  for (int b=nbytes-1; b>=0; b--)
+    value = (value << 8) | p[b];
+  return value;
+}
+
+static void put_varint(std::string *buf, uint64_t value) {
+  while (value >= 0x80) {
+    buf->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  buf->push_back(static_cast<char>(value));
+}
+
+/**
+ * Decode a varint at p, which must end before end.
+ * @return The position after the varint.
+ */
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint64_t *value) {
+  uint64_t v = 0;
+  int shift = 0;
+  while (true) {
+    if (p>=end || shift>63)
+      throw std::runtime_error("corrupt record in ensemble file");
+    unsigned char c = *p++;
+    v |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (c < 0x80)
+      break;
+    shift += 7;
+  }
+  *value = v;
+  return p;
+}
+
+/** Map a signed integer to an unsigned one with small values for small magnitudes. */
+static inline uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+
+
+/**
+ * Create (or overwrite) the ensemble file at path for structures of sequence.
+ * @param path The output file.
+ * @param sequence The nucleotides that all structures added to the file belong to.
+ */
+EnsembleWriter::EnsembleWriter(const std::string &path, const std::string &sequence) :
+  out_(path.c_str(), std::ios::binary | std::ios::trunc), sequence_(sequence),
+  position_(0), closed_(false) {
+  if (!out_.is_open()) {
+    std::cerr << "[ERROR] Could not open ensemble file \"" << path << "\" for writing" << std::endl;
+    throw std::runtime_error("could not open ensemble file for writing");
+  }
+  /* the header is rewritten with the final counts by close() */
+  std::string header(s_magic, 4);
+  put_fixed(&header, s_version, 4);
+  put_fixed(&header, sequence_.size(), 4);
+  put_fixed(&header, 0, 4);
+  put_fixed(&header, 0, 8);
+  put_fixed(&header, 0, 8);
+  out_.write(header.data(), header.size());
+  out_.write(sequence_.data(), sequence_.size());
+  position_ = header.size() + sequence_.size();
+}
+
+EnsembleWriter::~EnsembleWriter() {
+  if (!closed_) {
+    try {
+      close();
+    } catch (const std::exception &e) {
+      std::cerr << "[ERROR] Could not finish ensemble file: " << e.what() << std::endl;
+    }
+  }
+}
+
+/**
+ * Append a structure.
+ * @param pairs pairs[k] is the partner of base k (one-based) or 0, for k=1..n.
+ * @param energy 100 x the free energy of the structure.
+ * @param label The label of the structure (e.g., the header line of the CT file).
+ */
+void EnsembleWriter::add(const int *pairs, int energy, const std::string &label) {
+  if (closed_) {
+    throw std::logic_error("ensemble file already closed");
+  }
+  int n = static_cast<int>(sequence_.size());
+  int npairs = 0;
+  for (int i=1; i<=n; i++)
+    if (pairs[i]>i) npairs++;
+  record_.clear();
+  put_varint(&record_, zigzag(energy));
+  put_varint(&record_, label.size());
+  record_.append(label);
+  put_varint(&record_, npairs);
+  int previous = 0;
+  for (int i=1; i<=n; i++) {
+    if (pairs[i]>i) {
+      put_varint(&record_, i - previous);
+      put_varint(&record_, pairs[i] - i);
+      previous = i;
+    }
+  }
+  offsets_.push_back(position_);
+  out_.write(record_.data(), record_.size());
+  position_ += record_.size();
+}
+
+/** Append structure structnum of ct, with its energy and label. */
+void EnsembleWriter::add(const RNAStructure *ct, int structnum) {
+  if (ct->get_number_of_bases() != static_cast<int>(sequence_.size())) {
+    throw std::invalid_argument("structure does not match the length of the ensemble sequence");
+  }
+  add(ct->basepr()[structnum], ct->get_energy(structnum), ct->get_ith_label(structnum));
+}
+
+/** Append all structures of ct. */
+void EnsembleWriter::add_all(const RNAStructure *ct) {
+  for (int s=1; s<=ct->get_number_of_structures(); s++)
+    add(ct, s);
+}
+
+/**
+ * Write the index and the final header. The file is complete only after this
+ * (the destructor calls it if necessary).
+ */
+void EnsembleWriter::close() {
+  if (closed_)
+    return;
+  closed_ = true;
+  std::string index;
+  index.reserve(8*offsets_.size());
+  for (size_t k=0; k<offsets_.size(); k++)
+    put_fixed(&index, offsets_[k], 8);
+  out_.write(index.data(), index.size());
+  std::string counts;
+  put_fixed(&counts, offsets_.size(), 8);
+  put_fixed(&counts, position_, 8);
+  out_.seekp(16);
+  out_.write(counts.data(), counts.size());
+  out_.close();
+  if (out_.fail()) {
+    throw std::runtime_error("error while writing ensemble file");
+  }
+}
+
+/** @return The sequence of ct as a string of nucleotides. */
+std::string EnsembleWriter::sequence_of(const RNAStructure *ct) {
+  std::string sequence(ct->get_number_of_bases(), 'N');
+  for (int k=1; k<=ct->get_number_of_bases(); k++)
+    sequence[k-1] = ct->nucleotide_at(k);
+  return sequence;
+}
+
+
+
+/**
+ * Map the ensemble file at path and check its header and index.
+ * @throws std::runtime_error if the file cannot be read or is not an ensemble file.
+ */
+EnsembleReader::EnsembleReader(const std::string &path) :
+  file_(path.c_str()), numbases_(0), numstructures_(0), index_(NULL) {
+  if (!file_.is_open()) {
+    std::cerr << "[ERROR] Could not open ensemble file \"" << path << "\"" << std::endl;
+    throw std::runtime_error("could not open ensemble file");
+  }
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(file_.data());
+  size_t size = file_.size();
+  if (size < s_header_length || memcmp(p, s_magic, 4) != 0) {
+    std::cerr << "[ERROR] \"" << path << "\" is not an ensemble file" << std::endl;
+    throw std::runtime_error("not an ensemble file");
+  }
+  if (get_fixed(p+4, 4) != s_version) {
+    throw std::runtime_error("unsupported version of the ensemble format");
+  }
+  uint64_t n = get_fixed(p+8, 4);
+  uint64_t count = get_fixed(p+16, 8);
+  uint64_t index = get_fixed(p+24, 8);
+  if (s_header_length + n > size || index < s_header_length + n || index > size
+      || count > (size - index) / 8) {
+    throw std::runtime_error("truncated or incomplete ensemble file");
+  }
+  numbases_ = static_cast<int>(n);
+  numstructures_ = static_cast<long>(count);
+  sequence_.assign(file_.data() + s_header_length, n);
+  index_ = p + index;
+}
+
+/** @return The start of the record of structure k (one-based). */
+const unsigned char *EnsembleReader::record(long k) const {
+  if (k<1 || k>numstructures_) {
+    throw std::out_of_range("structure index out of range");
+  }
+  uint64_t offset = get_fixed(index_ + 8*(k-1), 8);
+  const unsigned char *p = reinterpret_cast<const unsigned char*>(file_.data()) + offset;
+  if (p >= index_) {
+    throw std::runtime_error("corrupt index in ensemble file");
+  }
+  return p;
+}
+
+/**
+ * Decode the energy and (if label is not NULL) the label of structure k.
+ * @return The position of the pair list of the record.
+ */
+const unsigned char *EnsembleReader::decode_header(long k, int *energy, std::string *label) const {
+  const unsigned char *p = record(k);
+  uint64_t v, len;
+  p = get_varint(p, index_, &v);
+  *energy = static_cast<int>(unzigzag(v));
+  p = get_varint(p, index_, &len);
+  if (len > static_cast<uint64_t>(index_ - p)) {
+    throw std::runtime_error("corrupt record in ensemble file");
+  }
+  if (label != NULL)
+    label->assign(reinterpret_cast<const char*>(p), len);
+  return p + len;
+}
+
+/**
+ * Decode the pairs of structure k.
+ * @param k index of the structure (one-based).
+ * @param pairs Receives the pair table: pairs[i] is the partner of base i or 0, for i=1..n
+ * (room for n+1 entries).
+ */
+void EnsembleReader::get_pairs(long k, int *pairs) const {
+  int energy;
+  const unsigned char *p = decode_header(k, &energy, NULL);
+  uint64_t npairs, delta, span;
+  p = get_varint(p, index_, &npairs);
+  for (int i=0; i<=numbases_; i++)
+    pairs[i] = 0;
+  uint64_t i = 0;
+  for (uint64_t m=0; m<npairs; m++) {
+    p = get_varint(p, index_, &delta);
+    p = get_varint(p, index_, &span);
+    i += delta;
+    if (delta==0 || i + span > static_cast<uint64_t>(numbases_) || span==0) {
+      throw std::runtime_error("corrupt pair list in ensemble file");
+    }
+    pairs[i] = static_cast<int>(i + span);
+    pairs[i+span] = static_cast<int>(i);
+  }
+}
+
+/** @return 100 x the free energy of structure k (one-based). */
+int EnsembleReader::get_energy(long k) const {
+  int energy;
+  decode_header(k, &energy, NULL);
+  return energy;
+}
+
+/** @return The label of structure k (one-based). */
+std::string EnsembleReader::get_label(long k) const {
+  int energy;
+  std::string label;
+  decode_header(k, &energy, &label);
+  return label;
+}
+
+/**
+ * Load the structures first..first+count-1 (one-based) into ct, replacing its
+ * contents, e.g., to score them with efn2.
+ */
+void EnsembleReader::read(long first, int count, RNAStructure *ct) const {
+  ct->assign_sequence(sequence_);
+  std::vector<int> pairs(numbases_+1);
+  std::string label;
+  int energy;
+  for (long k=first; k<first+count; k++) {
+    decode_header(k, &energy, &label);
+    get_pairs(k, &pairs[0]);
+    ct->add_structure(&pairs[0], energy, label);
+  }
+}
+
+/* eof */
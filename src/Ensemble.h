@@ -0,0 +1,107 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+/**
+ * \class EnsembleWriter
+ *
+ * \ingroup Folding
+ *
+ * \brief Writes structures of one sequence to the compact binary ensemble format.
+ *
+ * A CT file repeats the base and the neighbour columns on every line of every
+ * structure. The ensemble format stores the sequence once and each structure as
+ * the list of its pairs, delta coded as variable-length integers, followed by an
+ * index with the offset of each structure:
+ *
+ * \verbatim
+ * header   "RNXE" | version (u32) | number of bases n (u32) | 0 (u32)
+ *          number of structures (u64) | offset of the index (u64)
+ * sequence n bytes (the nucleotides, as in the second column of a CT file)
+ * records  per structure: energy (zigzag varint) | length of the label (varint) | label
+ *          number of pairs (varint) | for each pair i.j (i<j, by increasing i):
+ *          i minus the i of the previous pair (varint) | j-i (varint)
+ * index    per structure: file offset of its record (u64)
+ * \endverbatim
+ *
+ * All fixed width integers are little endian; varints are LEB128 (7 bits per byte,
+ * high bit set on all but the last byte). EnsembleReader reads the format back with
+ * random access to each structure.
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "MappedFile.h"
+
+class RNAStructure;
+
+class EnsembleWriter {
+  /** The output file. */
+  std::ofstream out_;
+  /** The sequence all structures belong to. */
+  std::string sequence_;
+  /** Offset of the record of each structure. */
+  std::vector<uint64_t> offsets_;
+  /** Current length of the file. */
+  uint64_t position_;
+  /** Encoding buffer for one record. */
+  std::string record_;
+  /** Whether close has been called. */
+  bool closed_;
+ public:
+  EnsembleWriter(const std::string &path, const std::string &sequence);
+  ~EnsembleWriter();
+  void add(const int *pairs, int energy = 0, const std::string &label = "");
+  void add(const RNAStructure *ct, int structnum);
+  void add_all(const RNAStructure *ct);
+  void close();
+  long get_number_of_structures() const { return static_cast<long>(offsets_.size()); }
+  static std::string sequence_of(const RNAStructure *ct);
+ private:
+  EnsembleWriter(const EnsembleWriter &);
+  EnsembleWriter& operator=(const EnsembleWriter &);
+};
+
+
+/**
+ * \class EnsembleReader
+ *
+ * \ingroup Folding
+ *
+ * \brief Random access to the structures of a binary ensemble file (see EnsembleWriter).
+ *
+ * The file is mapped into memory. Opening it only checks the header; each
+ * structure is decoded on demand from its offset in the index, so that a single
+ * structure of a large archive costs time proportional to its number of pairs.
+ * The reader is immutable after construction, and may be shared by several threads.
+ */
+class EnsembleReader {
+  /** The mapped file. */
+  MappedFile file_;
+  /** Number of bases of the sequence. */
+  int numbases_;
+  /** Number of structures. */
+  long numstructures_;
+  /** The sequence. */
+  std::string sequence_;
+  /** Start of the index in the mapping. */
+  const unsigned char *index_;
+ public:
+  explicit EnsembleReader(const std::string &path);
+  int get_number_of_bases() const { return numbases_; }
+  long get_number_of_structures() const { return numstructures_; }
+  const std::string& get_sequence() const { return sequence_; }
+  void get_pairs(long k, int *pairs) const;
+  int get_energy(long k) const;
+  std::string get_label(long k) const;
+  void read(long first, int count, RNAStructure *ct) const;
+ private:
+  const unsigned char *record(long k) const;
+  const unsigned char *decode_header(long k, int *energy, std::string *label) const;
+  EnsembleReader(const EnsembleReader &);
+  EnsembleReader& operator=(const EnsembleReader &);
+};
+
+#endif
+/* eof */
@@ -0,0 +1,184 @@
+#include "IncrementalEnergy.h"
+#include "RNAStructure.h"
+
+#include <stdexcept>
+
+
+/**
+ * Decompose structure structnum of ct into its loops.
+ * @param dat The parameter tables.
+ * @param ct The structure(s); provides the sequence throughout the life of the evaluator.
+ * @param structnum index (one-based) of the starting structure.
+ */
+IncrementalEvaluator::IncrementalEvaluator(const Datatable &dat, const RNAStructure *ct, int structnum) :
+  eval_(dat), ct_(ct), numbases_(ct->get_number_of_bases()), exterior_(0), energy_(0) {
+  if (structnum<1 || structnum>ct->get_number_of_structures()) {
+    throw std::out_of_range("no such structure in IncrementalEvaluator");
+  }
+  const int *pairs = ct->basepr()[structnum];
+  bp_.assign(pairs, pairs + numbases_ + 1);
+  bp_.push_back(0);
+  bp_[0] = 0;
+  decompose();
+}
+
+/**
+ * Start from a structure other than those of ct, e.g., the open chain for kinetics.
+ * @param dat The parameter tables.
+ * @param ct Provides the sequence throughout the life of the evaluator.
+ * @param pairs A pair table for the sequence of ct (pairs[k] is the partner of base k,
+ * or 0, for k=1..n; pairs[0] is ignored).
+ */
+IncrementalEvaluator::IncrementalEvaluator(const Datatable &dat, const RNAStructure *ct,
+					   const std::vector<int> &pairs) :
+  eval_(dat), ct_(ct), numbases_(ct->get_number_of_bases()), exterior_(0), energy_(0) {
+  if (static_cast<int>(pairs.size()) < numbases_+1) {
+    throw std::invalid_argument("pair table is shorter than the sequence");
+  }
+  bp_.assign(pairs.begin(), pairs.begin() + numbases_ + 1);
+  bp_.push_back(0);
+  bp_[0] = 0;
+  decompose();
+}
+
+/** Evaluate every loop of the structure in bp_. */
+void IncrementalEvaluator::decompose() {
+  loop_.assign(numbases_ + 2, 0);
+  eval_.prepare(ct_);
+  exterior_ = eval_.exterior_energy(ct_, &bp_[0]);
+  energy_ = exterior_;
+  for (int i=1; i<=numbases_; i++) {
+    if (bp_[i]>i) {
+      loop_[i] = eval_.loop_energy(ct_, &bp_[0], i, bp_[i]);
+      energy_ += loop_[i];
+    }
+  }
+}
+
+/**
+ * Find the loop that contains base i, which is either unpaired or the 5' base of a pair.
+ * Scanning leftwards skips over whole helices, so the cost is bounded by the size of
+ * that loop.
+ * @return The 5' base of the pair that closes the loop, or 0 for the exterior loop.
+ */
+int IncrementalEvaluator::enclosing_pair(int i) const {
+  int k = i - 1;
+  while (k>=1) {
+    if (bp_[k]==0)
+      k--;
+    else if (bp_[k]>k)
+      return k; /* the first opening base to the left encloses i */
+    else
+      k = bp_[k] - 1; /* skip over the helix that ends at k */
+  }
+  return 0;
+}
+
+/** @return The energy of the loop closed by p.bp_[p] (p>0) or of the exterior loop (p==0). */
+int IncrementalEvaluator::loop_energy_at(int p) {
+  if (p==0)
+    return eval_.exterior_energy(ct_, &bp_[0]);
+  return eval_.loop_energy(ct_, &bp_[0], p, bp_[p]);
+}
+
+void IncrementalEvaluator::set_loop_energy(int p, int e) {
+  if (p==0)
+    exterior_ = e;
+  else
+    loop_[p] = e;
+}
+
+/**
+ * @return true if i.j can be added to the current structure, i.e., both bases are
+ * unpaired and lie in the same loop, so that the new pair does not cross another one.
+ */
+bool IncrementalEvaluator::can_add_pair(int i, int j) const {
+  if (i<1 || j>numbases_ || i>=j)
+    return false;
+  if (bp_[i]!=0 || bp_[j]!=0)
+    return false;
+  return enclosing_pair(i)==enclosing_pair(j);
+}
+
+/**
+ * @return The energy change (100 x kcal/mol) that adding the pair i.j would cause.
+ * The structure is left as it is.
+ */
+int IncrementalEvaluator::delta_add_pair(int i, int j) {
+  if (!can_add_pair(i, j)) {
+    throw std::invalid_argument("base pair cannot be added to the structure");
+  }
+  int p = enclosing_pair(i);
+  int before = (p==0) ? exterior_ : loop_[p];
+  bp_[i] = j;
+  bp_[j] = i;
+  int after = loop_energy_at(p) + eval_.loop_energy(ct_, &bp_[0], i, j);
+  bp_[i] = 0;
+  bp_[j] = 0;
+  return after - before;
+}
+
+/**
+ * @return The energy change (100 x kcal/mol) that removing the pair of base i would cause.
+ * The structure is left as it is.
+ */
+int IncrementalEvaluator::delta_remove_pair(int i) {
+  if (i<1 || i>numbases_ || bp_[i]==0) {
+    throw std::invalid_argument("base is not paired");
+  }
+  if (bp_[i]<i) i = bp_[i];
+  int j = bp_[i];
+  int p = enclosing_pair(i);
+  int before = ((p==0) ? exterior_ : loop_[p]) + loop_[i];
+  bp_[i] = 0;
+  bp_[j] = 0;
+  int after = loop_energy_at(p);
+  bp_[i] = j;
+  bp_[j] = i;
+  return after - before;
+}
+
+/**
+ * Add the pair i.j to the structure.
+ * @return The energy change (100 x kcal/mol).
+ */
+int IncrementalEvaluator::add_pair(int i, int j) {
+  if (!can_add_pair(i, j)) {
+    throw std::invalid_argument("base pair cannot be added to the structure");
+  }
+  int p = enclosing_pair(i);
+  int before = (p==0) ? exterior_ : loop_[p];
+  bp_[i] = j;
+  bp_[j] = i;
+  int outer = loop_energy_at(p);
+  int inner = eval_.loop_energy(ct_, &bp_[0], i, j);
+  set_loop_energy(p, outer);
+  loop_[i] = inner;
+  int delta = outer + inner - before;
+  energy_ += delta;
+  return delta;
+}
+
+/**
+ * Remove the pair of base i (either end of the pair) from the structure.
+ * @return The energy change (100 x kcal/mol).
+ */
+int IncrementalEvaluator::remove_pair(int i) {
+  if (i<1 || i>numbases_ || bp_[i]==0) {
+    throw std::invalid_argument("base is not paired");
+  }
+  if (bp_[i]<i) i = bp_[i];
+  int j = bp_[i];
+  int p = enclosing_pair(i);
+  int before = ((p==0) ? exterior_ : loop_[p]) + loop_[i];
+  bp_[i] = 0;
+  bp_[j] = 0;
+  loop_[i] = 0;
+  int outer = loop_energy_at(p);
+  set_loop_energy(p, outer);
+  int delta = outer - before;
+  energy_ += delta;
+  return delta;
+}
+
+/* eof */
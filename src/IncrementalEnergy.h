@@ -0,0 +1,63 @@
+#ifndef INCREMENTAL_ENERGY_H
+#define INCREMENTAL_ENERGY_H
+
+/**
+ * \class IncrementalEvaluator
+ *
+ * \ingroup Folding
+ *
+ * \brief efn2 energies under single base-pair moves, for Monte-Carlo refinement and kinetics.
+ *
+ * The evaluator keeps a private copy of one structure as a pair table together with its
+ * loop decomposition: the energy of the loop closed by each base pair (see
+ * EnergyEvaluator::loop_energy) and that of the exterior loop. Adding a pair i.j splits
+ * the loop that contains i and j into two, removing one merges two loops, so a move only
+ * needs to re-evaluate these two or three loops. Each move costs time proportional to
+ * the size of the loops involved (plus the coaxial stacking DP for multi-branch loops),
+ * independent of the length of the sequence. The total always equals what efn2 gives for
+ * the current structure.
+ *
+ * The RNAStructure provides the sequence and must outlive the evaluator; its own base
+ * pairs are not changed. Like EnergyEvaluator, an IncrementalEvaluator is meant to be
+ * used by one thread.
+ */
+
+#include "EnergyFunction2.h"
+
+#include <vector>
+
+class IncrementalEvaluator {
+  /** Evaluates the individual loops. */
+  EnergyEvaluator eval_;
+  /** The sequence (and constraints) of the structure. */
+  const RNAStructure *ct_;
+  /** Number of bases of the sequence. */
+  int numbases_;
+  /** The current structure: bp_[k] is the partner of base k (one-based), or 0. bp_[numbases_+1]==0. */
+  std::vector<int> bp_;
+  /** loop_[i] is the energy of the loop closed by the pair i.bp_[i], for i<bp_[i]. */
+  std::vector<int> loop_;
+  /** The energy of the exterior loop. */
+  int exterior_;
+  /** 100 x the free energy of the current structure. */
+  int energy_;
+ public:
+  IncrementalEvaluator(const Datatable &dat, const RNAStructure *ct, int structnum);
+  IncrementalEvaluator(const Datatable &dat, const RNAStructure *ct, const std::vector<int> &pairs);
+  int get_energy() const { return energy_; }
+  int get_partner(int i) const { return bp_[i]; }
+  const std::vector<int>& get_pairs() const { return bp_; }
+  bool can_add_pair(int i, int j) const;
+  int delta_add_pair(int i, int j);
+  int delta_remove_pair(int i);
+  int add_pair(int i, int j);
+  int remove_pair(int i);
+  int enclosing_pair(int i) const;
+ private:
+  void decompose();
+  int loop_energy_at(int p);
+  void set_loop_energy(int p, int e);
+};
+
+#endif
+/* eof */
@@ -0,0 +1,384 @@
+#include "Kinetics.h"
+#include "RNAStructure.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+#include <stdexcept>
+
+/** The gas constant in kcal/(mol K). */
+static const double s_gas_constant = 0.0019872;
+/** Absolute zero in degrees Celsius. */
+static const double s_kelvin_offset = 273.15;
+
+
+/********************* RateTree *********************/
+
+RateTree::RateTree(int n) : top_(0) {
+  resize(n);
+}
+
+/** Set the number of entries to n, all with rate zero. */
+void RateTree::resize(int n) {
+  tree_.assign(n+1, 0.0);
+  rate_.assign(n, 0.0);
+  top_ = 1;
+  while (top_*2 <= n) top_ *= 2;
+}
+
+/** Change the rate of entry k (0-based). */
+void RateTree::set(int k, double rate) {
+  double d = rate - rate_[k];
+  rate_[k] = rate;
+  int n = size();
+  for (int x=k+1; x<=n; x += x & (-x))
+    tree_[x] += d;
+}
+
+/** @return The sum of all rates. */
+double RateTree::total() const {
+  double sum = 0.0;
+  for (int x=size(); x>0; x -= x & (-x))
+    sum += tree_[x];
+  return sum;
+}
+
+/**
+ * @param x A value in [0, total()).
+ * @return The entry k with rate(0)+...+rate(k-1) <= x < rate(0)+...+rate(k). Rounding
+ * can move x past the last entry; the last entry with a positive rate is returned then.
+ */
+int RateTree::find(double x) const {
+  int n = size();
+  int pos = 0;
+  for (int step=top_; step>0; step >>= 1) {
+    if (pos+step <= n && tree_[pos+step] <= x) {
+      pos += step;
+      x -= tree_[pos];
+    }
+  }
+  if (pos >= n || rate_[pos] <= 0.0) {
+    for (pos=n-1; pos>0 && rate_[pos] <= 0.0; pos--)
+      ;
+  }
+  return pos;
+}
+
+
+/********************* KineticSimulator *********************/
+
+/**
+ * @param dat The parameter tables (the temperature of the table sets RT).
+ * @param ct Provides the sequence; must outlive the simulator.
+ * @param start The initial structure in dot-bracket notation (e.g., all dots for the open chain).
+ * @param seed Seed of the random number generator.
+ */
+KineticSimulator::KineticSimulator(const Datatable &dat, const RNAStructure *ct,
+				   const std::string &start, unsigned long seed) :
+  eval_(dat, ct, parse_dot_bracket(start, ct->get_number_of_bases())),
+  ct_(ct), numbases_(ct->get_number_of_bases()),
+  rt_(100.0 * s_gas_constant * (dat.get_temperature() + s_kelvin_offset)),
+  blocks_(numbases_+1), rates_(numbases_+1), is_dirty_(numbases_+1, 0),
+  time_(0.0), rng_(seed), distance_(0) {
+  mark_dirty(0);
+  for (int p=1; p<=numbases_; p++)
+    if (eval_.get_partner(p) > p)
+      mark_dirty(p);
+  rebuild_dirty();
+}
+
+/**
+ * Convert a dot-bracket string into a pair table.
+ * @return pairs[k] is the partner of base k (one-based) or 0; pairs[0] is unused.
+ */
+std::vector<int> KineticSimulator::parse_dot_bracket(const std::string &db, int numbases) {
+  if (static_cast<int>(db.size()) != numbases) {
+    throw std::invalid_argument("dot-bracket string does not match the length of the sequence");
+  }
+  std::vector<int> pairs(numbases+1, 0);
+  std::vector<int> open;
+  for (int k=1; k<=numbases; k++) {
+    char c = db[k-1];
+    if (c=='(') {
+      open.push_back(k);
+    } else if (c==')') {
+      if (open.empty())
+	throw std::invalid_argument("unbalanced dot-bracket string");
+      pairs[k] = open.back();
+      pairs[open.back()] = k;
+      open.pop_back();
+    } else if (c!='.') {
+      throw std::invalid_argument("unexpected character in dot-bracket string");
+    }
+  }
+  if (!open.empty())
+    throw std::invalid_argument("unbalanced dot-bracket string");
+  return pairs;
+}
+
+/** @return The current structure in dot-bracket notation. */
+std::string KineticSimulator::get_structure() const {
+  std::string db(numbases_, '.');
+  for (int k=1; k<=numbases_; k++) {
+    int partner = eval_.get_partner(k);
+    if (partner > k) db[k-1] = '(';
+    else if (partner != 0) db[k-1] = ')';
+  }
+  return db;
+}
+
+/** @return The number of moves available from the current structure. */
+int KineticSimulator::get_number_of_moves() const {
+  int n = 0;
+  for (size_t p=0; p<blocks_.size(); p++)
+    n += static_cast<int>(blocks_[p].size());
+  return n;
+}
+
+/** @return The Metropolis rate of a move that changes the energy by delta. */
+double KineticSimulator::rate(int delta) const {
+  if (delta <= 0) return 1.0;
+  return exp(-delta / rt_);
+}
+
+/** @return true if bases i and j can form a Watson-Crick or GU pair. */
+bool KineticSimulator::canonical(int i, int j) const {
+  int a = ct_->numseq(i);
+  int b = ct_->numseq(j);
+  return (a==1 && b==4) || (a==4 && b==1) || (a==2 && b==3) || (a==3 && b==2)
+    || (a==3 && b==4) || (a==4 && b==3);
+}
+
+/** Collect the unpaired bases of the loop closed by p.bp[p] (p==0: exterior loop). */
+void KineticSimulator::loop_unpaired(int p, std::vector<int> *unpaired) const {
+  unpaired->clear();
+  int k = (p==0) ? 1 : p+1;
+  int end = (p==0) ? numbases_+1 : eval_.get_partner(p);
+  while (k<end) {
+    int partner = eval_.get_partner(k);
+    if (partner==0) {
+      unpaired->push_back(k);
+      k++;
+    } else {
+      k = partner + 1;
+    }
+  }
+}
+
+void KineticSimulator::mark_dirty(int p) {
+  if (!is_dirty_[p]) {
+    is_dirty_[p] = 1;
+    dirty_.push_back(p);
+  }
+}
+
+/** The loop closed by p (p==0: exterior) has changed: rebuild its block and those of its branches. */
+void KineticSimulator::mark_loop_and_branches(int p) {
+  mark_dirty(p);
+  int k = (p==0) ? 1 : p+1;
+  int end = (p==0) ? numbases_+1 : eval_.get_partner(p);
+  while (k<end) {
+    int partner = eval_.get_partner(k);
+    if (partner > k) {
+      mark_dirty(k);
+      k = partner + 1;
+    } else {
+      k++;
+    }
+  }
+}
+
+void KineticSimulator::rebuild_dirty() {
+  for (size_t d=0; d<dirty_.size(); d++) {
+    rebuild_block(dirty_[d]);
+    is_dirty_[dirty_[d]] = 0;
+  }
+  dirty_.clear();
+}
+
+/**
+ * Enumerate the moves of block p (see the class description) and their rates.
+ */
+void KineticSimulator::rebuild_block(int p) {
+  std::vector<Move> &block = blocks_[p];
+  block.clear();
+  double total = 0.0;
+  if (p>0 && eval_.get_partner(p) <= p) { /* p no longer opens a pair */
+    rates_.set(p, 0.0);
+    return;
+  }
+  Move m;
+  /* insertions inside the loop */
+  loop_unpaired(p, &unpaired_);
+  for (size_t x=0; x<unpaired_.size(); x++) {
+    for (size_t y=x+1; y<unpaired_.size(); y++) {
+      int i = unpaired_[x], j = unpaired_[y];
+      if (j-i-1 < s_min_hairpin || !canonical(i, j)) continue;
+      m.type = INSERT;
+      m.i = i;
+      m.j = j;
+      m.delta = eval_.delta_add_pair(i, j);
+      m.rate = rate(m.delta);
+      total += m.rate;
+      block.push_back(m);
+    }
+  }
+  if (p>0) {
+    int q = eval_.get_partner(p);
+    /* deletion of p.q */
+    m.type = DELETE;
+    m.i = p;
+    m.j = q;
+    m.delta = eval_.delta_remove_pair(p);
+    m.rate = rate(m.delta);
+    total += m.rate;
+    block.push_back(m);
+    /* shifts: p or q pairs with another base of the loop that opens when p.q is removed */
+    int removed = eval_.remove_pair(p);
+    loop_unpaired(eval_.enclosing_pair(p), &unpaired_);
+    for (int side=0; side<2; side++) {
+      int keep = (side==0) ? p : q;
+      int other = (side==0) ? q : p;
+      for (size_t x=0; x<unpaired_.size(); x++) {
+	int k = unpaired_[x];
+	if (k==keep || k==other) continue;
+	int i = (k<keep) ? k : keep;
+	int j = (k<keep) ? keep : k;
+	if (j-i-1 < s_min_hairpin || !canonical(i, j)) continue;
+	m.type = SHIFT;
+	m.i = keep;
+	m.j = k;
+	m.delta = removed + eval_.delta_add_pair(i, j);
+	m.rate = rate(m.delta);
+	total += m.rate;
+	block.push_back(m);
+      }
+    }
+    eval_.add_pair(p, q);
+  }
+  rates_.set(p, total);
+}
+
+/** Update distance_ after the partner of base k changed from old_partner. */
+void KineticSimulator::track_distance(int k, int old_partner) {
+  if (target_.empty()) return;
+  int before = (old_partner != target_[k]) ? 1 : 0;
+  int after = (eval_.get_partner(k) != target_[k]) ? 1 : 0;
+  distance_ += after - before;
+}
+
+/** Carry out move m and rebuild the blocks it affects. */
+void KineticSimulator::apply(const Move &m) {
+  if (m.type==INSERT) {
+    int outer = eval_.enclosing_pair(m.i);
+    eval_.add_pair(m.i, m.j);
+    track_distance(m.i, 0);
+    track_distance(m.j, 0);
+    mark_loop_and_branches(outer);
+    mark_loop_and_branches(m.i);
+  } else {
+    int old_partner = eval_.get_partner(m.i);
+    int key = (m.i < old_partner) ? m.i : old_partner;
+    int outer = eval_.enclosing_pair(key);
+    eval_.remove_pair(m.i);
+    blocks_[key].clear();
+    rates_.set(key, 0.0);
+    if (m.type==SHIFT) {
+      int i = (m.i < m.j) ? m.i : m.j;
+      int j = (m.i < m.j) ? m.j : m.i;
+      eval_.add_pair(i, j);
+      track_distance(m.j, 0);
+      mark_loop_and_branches(i);
+    }
+    track_distance(m.i, old_partner);
+    track_distance(old_partner, m.i);
+    mark_loop_and_branches(outer);
+  }
+  rebuild_dirty();
+}
+
+/**
+ * Advance the simulation by one Gillespie step.
+ * @return false if no move is possible (the time is not advanced then).
+ */
+bool KineticSimulator::step() {
+  double total = rates_.total();
+  if (total <= 0.0) return false;
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  time_ += -log(1.0 - uniform(rng_)) / total;
+  /* draw the block in proportion to its total rate, then the move inside the block */
+  int p = rates_.find(uniform(rng_) * total);
+  double x = uniform(rng_) * rates_.get(p);
+  double before = 0.0;
+  const std::vector<Move> &block = blocks_[p];
+  size_t chosen = block.size();
+  for (size_t k=0; k<block.size(); k++) {
+    before += block[k].rate;
+    if (x < before) {
+      chosen = k;
+      break;
+    }
+  }
+  if (chosen == block.size()) { /* rounding: take the last move with a positive rate */
+    for (chosen = block.size(); chosen>0 && block[chosen-1].rate <= 0.0; chosen--)
+      ;
+    if (chosen == 0) return false;
+    chosen--;
+  }
+  Move m = block[chosen];
+  apply(m);
+  return true;
+}
+
+/**
+ * Simulate until max_time (or until no move is possible), recording every structure
+ * visited together with the time at which it was entered.
+ */
+void KineticSimulator::run(double max_time, std::vector<TrajectoryPoint> *trajectory) {
+  TrajectoryPoint point;
+  point.time = time_;
+  point.energy = get_energy();
+  point.structure = get_structure();
+  trajectory->push_back(point);
+  while (time_ < max_time && step()) {
+    if (time_ > max_time) break;
+    point.time = time_;
+    point.energy = get_energy();
+    point.structure = get_structure();
+    trajectory->push_back(point);
+  }
+}
+
+/**
+ * Simulate until the structure equals target.
+ * @return The first-passage time, or -1 if the target is not reached before max_time.
+ */
+double KineticSimulator::first_passage(const std::string &target, double max_time) {
+  target_ = parse_dot_bracket(target, numbases_);
+  distance_ = 0;
+  for (int k=1; k<=numbases_; k++)
+    if (eval_.get_partner(k) != target_[k]) distance_++;
+  while (distance_ != 0) {
+    if (!step() || time_ > max_time)
+      return -1.0;
+  }
+  return time_;
+}
+
+/**
+ * Run independent trajectories from start on the pool and collect their first-passage
+ * times to target (-1 for trajectories that did not arrive before max_time). Trajectory k
+ * uses the seed seed+k, so the results do not depend on the number of threads.
+ */
+std::vector<double> run_first_passage(const Datatable &dat, const RNAStructure *ct,
+				      const std::string &start, const std::string &target,
+				      int n_trajectories, double max_time,
+				      ThreadPool &pool, unsigned long seed) {
+  std::vector<double> times(n_trajectories, -1.0);
+  pool.run(n_trajectories, [&](int k, int) {
+      KineticSimulator sim(dat, ct, start, seed + k);
+      times[k] = sim.first_passage(target, max_time);
+    });
+  return times;
+}
+
+/* eof */
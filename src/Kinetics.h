@@ -0,0 +1,150 @@
+#ifndef KINETICS_H
+#define KINETICS_H
+
+/**
+ * \class KineticSimulator
+ *
+ * \ingroup Folding
+ *
+ * \brief Stochastic folding trajectories (in the style of Kinfold) on the efn2 energy model.
+ *
+ * The state is a secondary structure; the elementary moves are the insertion of a
+ * canonical base pair, the deletion of a pair, and the shift of one end of a pair to
+ * another unpaired base. Each move has the Metropolis rate min(1, exp(-dE/RT)), with dE
+ * the change of the efn2 energy and T the temperature of the Datatable. The simulation
+ * follows Gillespie's algorithm: the waiting time is exponential with the total rate of
+ * all moves, and the move is drawn in proportion to its rate.
+ *
+ * Energies are kept by an IncrementalEvaluator. The moves are grouped by loop: the
+ * block of a pair p.q holds the insertions inside the loop closed by p.q together with
+ * the deletion and the shifts of p.q (the exterior loop has a block of its own). The
+ * rates of a block only depend on its loop and the loop around it, so after a move just
+ * the blocks of the loops that were split, merged or changed, and of their branches, are
+ * rebuilt. The total rate of each block is stored in a RateTree, which draws the next
+ * block in O(log n).
+ *
+ * Each simulator is used by one thread; run_first_passage spreads independent
+ * trajectories over a ThreadPool.
+ */
+
+#include "EnergyFunction2.h"
+#include "IncrementalEnergy.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+
+/**
+ * \class RateTree
+ *
+ * \brief A Fenwick (binary indexed) tree of non-negative rates.
+ *
+ * Supports changing one rate, the total of all rates, and finding the entry in which
+ * a given fraction of the cumulative rate falls, all in O(log n).
+ */
+class RateTree {
+  /** The tree proper (one-based). */
+  std::vector<double> tree_;
+  /** The current rate of each entry. */
+  std::vector<double> rate_;
+  /** Largest power of two not exceeding the number of entries. */
+  int top_;
+ public:
+  explicit RateTree(int n = 0);
+  void resize(int n);
+  int size() const { return static_cast<int>(rate_.size()); }
+  double get(int k) const { return rate_[k]; }
+  void set(int k, double rate);
+  double total() const;
+  int find(double x) const;
+};
+
+
+/** A point of a folding trajectory. */
+struct TrajectoryPoint {
+  /** The time at which the structure was entered. */
+  double time;
+  /** 100 x the free energy of the structure. */
+  int energy;
+  /** The structure in dot-bracket notation. */
+  std::string structure;
+};
+
+
+class KineticSimulator {
+ public:
+  /** The kinds of elementary moves. */
+  enum MoveType { INSERT, DELETE, SHIFT };
+  /** One elementary move: insert i.j, delete the pair of i, or replace the pair of i by i.j (shift). */
+  struct Move {
+    MoveType type;
+    int i;
+    int j;
+    int delta;
+    double rate;
+  };
+ private:
+  /** Minimum number of unpaired bases in a hairpin loop. */
+  static const int s_min_hairpin = 3;
+  /** The energies of the current structure. */
+  IncrementalEvaluator eval_;
+  /** The sequence. */
+  const RNAStructure *ct_;
+  /** Number of bases. */
+  int numbases_;
+  /** RT in the energy units of efn2 (100 x kcal/mol). */
+  double rt_;
+  /** blocks_[p]: the moves belonging to the loop closed by p.bp[p] (p==0: exterior loop). */
+  std::vector<std::vector<Move> > blocks_;
+  /** The total rate of each block. */
+  RateTree rates_;
+  /** Scratch list of loops whose blocks need rebuilding. */
+  std::vector<int> dirty_;
+  /** Flags for dirty_, to avoid duplicates. */
+  std::vector<char> is_dirty_;
+  /** Scratch list of the unpaired bases of a loop. */
+  std::vector<int> unpaired_;
+  /** Simulated time. */
+  double time_;
+  /** Random numbers for the Gillespie steps. */
+  std::mt19937 rng_;
+  /** The target structure of first_passage (empty if none). */
+  std::vector<int> target_;
+  /** Number of bases whose partner differs from the target. */
+  int distance_;
+ public:
+  KineticSimulator(const Datatable &dat, const RNAStructure *ct, const std::string &start,
+		   unsigned long seed);
+  double get_time() const { return time_; }
+  int get_energy() const { return eval_.get_energy(); }
+  std::string get_structure() const;
+  double get_total_rate() const { return rates_.total(); }
+  int get_number_of_moves() const;
+  bool step();
+  void run(double max_time, std::vector<TrajectoryPoint> *trajectory);
+  double first_passage(const std::string &target, double max_time);
+
+  static std::vector<int> parse_dot_bracket(const std::string &db, int numbases);
+ private:
+  double rate(int delta) const;
+  bool canonical(int i, int j) const;
+  void loop_unpaired(int p, std::vector<int> *unpaired) const;
+  void mark_dirty(int p);
+  void mark_loop_and_branches(int p);
+  void rebuild_dirty();
+  void rebuild_block(int p);
+  void apply(const Move &m);
+  void track_distance(int k, int old_partner);
+};
+
+
+std::vector<double> run_first_passage(const Datatable &dat, const RNAStructure *ct,
+				      const std::string &start, const std::string &target,
+				      int n_trajectories, double max_time,
+				      ThreadPool &pool, unsigned long seed);
+
+#endif
+/* eof */
@@ -0,0 +1,239 @@
+#include "LoopTree.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <stdlib.h>
+
+#include "RNAStructure.h"  /* after the standard headers: it defines the macro infinity */
+
+
+/** An empty structure (of no bases). */
+LoopTree::LoopTree() {
+  assign(NULL, 0);
+}
+
+/**
+ * The loop tree of one structure of a CT file.
+ * @param ct The structures
+ * @param structnum The (one-based) number of the structure
+ */
+LoopTree::LoopTree(const RNAStructure *ct, int structnum) {
+  if (structnum < 1 || structnum > ct->get_number_of_structures()) {
+    std::cerr << "[ERROR] LoopTree: structure " << structnum << " requested, but there are "
+	      << ct->get_number_of_structures() << std::endl;
+    throw std::out_of_range("structure number out of range");
+  }
+  assign(ct->basepr()[structnum], ct->get_number_of_bases());
+}
+
+/**
+ * Rebuild the tree for another structure, reusing the storage.
+ * @param pairs Partner of each base (one-based, 0 if unpaired), n+1 entries
+ * @param n The number of bases
+ */
+void LoopTree::assign(const int *pairs, int n) {
+  numbases_ = n;
+  i_.assign(1, 0);
+  j_.assign(1, n+1);
+  parent_.assign(1, -1);
+  first_child_.assign(1, -1);
+  next_sibling_.assign(1, -1);
+  branches_.assign(1, 0);
+  unpaired_.assign(1, 0);
+  std::vector<int> last_child(1, -1);
+  std::vector<int> open(1, 0);
+  for (int pos=1; pos<=n; pos++) {
+    int p = pairs[pos];
+    if (p < 0 || p > n || p == pos || (p != 0 && pairs[p] != pos)) {
+      std::cerr << "[ERROR] LoopTree: base " << pos << " pairs with " << p
+		<< ", which is not a valid pair table" << std::endl;
+      throw std::invalid_argument("invalid pair table");
+    }
+    int top = open.back();
+    if (p > pos) {
+      int k = static_cast<int>(i_.size());
+      i_.push_back(pos);
+      j_.push_back(p);
+      parent_.push_back(top);
+      first_child_.push_back(-1);
+      next_sibling_.push_back(-1);
+      branches_.push_back(0);
+      unpaired_.push_back(0);
+      last_child.push_back(-1);
+      if (last_child[top] < 0)
+	first_child_[top] = k;
+      else
+	next_sibling_[last_child[top]] = k;
+      last_child[top] = k;
+      branches_[top]++;
+      open.push_back(k);
+    } else if (p > 0) {
+      if (j_[top] != pos) {
+	std::cerr << "[ERROR] LoopTree: pair " << p << "." << pos << " crosses pair "
+		  << i_[top] << "." << j_[top] << " (pseudoknot)" << std::endl;
+	throw std::invalid_argument("pseudoknotted pair table");
+      }
+      open.pop_back();
+    } else {
+      unpaired_[top]++;
+    }
+  }
+  build_helix_tree();
+}
+
+/** @return True if loop k is a stacked pair, i.e. k and its only branch form one helix. */
+bool LoopTree::stacked(int k) const {
+  return k > 0 && branches_[k] == 1 && unpaired_[k] == 0;
+}
+
+/**
+ * Number the helices in postorder (the exterior loop last), with their lengths and
+ * leftmost leaves, as the edit distance needs them.
+ */
+void LoopTree::build_helix_tree() {
+  helix_length_.clear();
+  helix_leftmost_.clear();
+  struct Frame {
+    int next;      /* next branch of the loop at the end of the helix */
+    int length;    /* pairs of the helix */
+    int leftmost;  /* postorder number of the leftmost leaf, once known */
+  };
+  std::vector<Frame> stack;
+  Frame root = { first_child_[0], 0, -1 };
+  stack.push_back(root);
+  while (!stack.empty()) {
+    int c = stack.back().next;
+    if (c >= 0) {
+      stack.back().next = next_sibling_[c];
+      int length = 1;
+      while (stacked(c)) {
+	c = first_child_[c];
+	length++;
+      }
+      Frame helix = { first_child_[c], length, -1 };
+      stack.push_back(helix);
+      continue;
+    }
+    Frame done = stack.back();
+    stack.pop_back();
+    int number = static_cast<int>(helix_length_.size());
+    int leftmost = done.leftmost < 0 ? number : done.leftmost;
+    helix_length_.push_back(done.length);
+    helix_leftmost_.push_back(leftmost);
+    if (!stack.empty() && stack.back().leftmost < 0)
+      stack.back().leftmost = leftmost;
+  }
+}
+
+/**
+ * @param level The abstraction level, 1 (most detailed) to 5 (helix nesting only)
+ * @return The abstract shape of the structure, e.g. "_[_[]_[]]_" at level 2
+ */
+std::string LoopTree::shape(int level) const {
+  if (level < 1 || level > 5) {
+    std::cerr << "[ERROR] LoopTree: shape level " << level << " (must be 1..5)" << std::endl;
+    throw std::invalid_argument("shape level out of range");
+  }
+  std::string out;
+  shape_of_loop(0, level, &out);
+  return out;
+}
+
+/** Append the shape of the helix that starts with the pair of loop k. */
+void LoopTree::shape_of_helix(int k, int level, std::string *out) const {
+  /* at levels 4 and 5 bulges and internal loops continue the helix */
+  while (stacked(k) || (level >= 4 && k > 0 && branches_[k] == 1))
+    k = first_child_[k];
+  out->push_back('[');
+  shape_of_loop(k, level, out);
+  out->push_back(']');
+}
+
+/** Append the shape of the inside of loop k: its branches and unpaired regions. */
+void LoopTree::shape_of_loop(int k, int level, std::string *out) const {
+  bool multi = (k == 0 || branches_[k] >= 2);
+  /* a hairpin is always [], its unpaired bases are never shown */
+  bool show = multi ? (level == 1 || level == 2 || level == 4) : (level == 1 && branches_[k] == 1);
+  int from = i_[k]+1;
+  for (int c=first_child_[k]; c>=0; c=next_sibling_[c]) {
+    if (show && i_[c] > from)
+      out->push_back('_');
+    shape_of_helix(c, level, out);
+    from = j_[c]+1;
+  }
+  if (show && j_[k]-1 >= from)
+    out->push_back('_');
+}
+
+/**
+ * Group the structures of ct by their abstract shape, building one loop tree at a time.
+ * @param ct The structures (e.g. suboptimal structures of one sequence)
+ * @param level The abstraction level (see shape)
+ * @param classes Receives the (one-based) numbers of the structures of each shape
+ */
+void LoopTree::shape_classes(const RNAStructure *ct, int level,
+			     std::map<std::string, std::vector<int> > *classes) {
+  classes->clear();
+  LoopTree tree;
+  for (int s=1; s<=ct->get_number_of_structures(); s++) {
+    tree.assign(ct->basepr()[s], ct->get_number_of_bases());
+    (*classes)[tree.shape(level)].push_back(s);
+  }
+}
+
+/**
+ * The edit distance of the helix trees of two structures (Zhang and Shasha 1989).
+ * Deleting or inserting a helix costs its number of pairs; matching two helices
+ * costs the difference of their numbers of pairs.
+ * @return The minimal cost of editing the helix tree of a into that of b
+ */
+int LoopTree::edit_distance(const LoopTree &a, const LoopTree &b) {
+  const std::vector<int> &la = a.helix_length_;
+  const std::vector<int> &lb = b.helix_length_;
+  const std::vector<int> &ma = a.helix_leftmost_;
+  const std::vector<int> &mb = b.helix_leftmost_;
+  int na = static_cast<int>(la.size());
+  int nb = static_cast<int>(lb.size());
+  /* the keyroots are the highest nodes with each leftmost leaf */
+  std::vector<int> ka(na, -1), kb(nb, -1);
+  for (int x=0; x<na; x++)
+    ka[ma[x]] = x;
+  for (int y=0; y<nb; y++)
+    kb[mb[y]] = y;
+  ka.erase(std::remove(ka.begin(), ka.end(), -1), ka.end());
+  kb.erase(std::remove(kb.begin(), kb.end(), -1), kb.end());
+  std::sort(ka.begin(), ka.end());
+  std::sort(kb.begin(), kb.end());
+  std::vector<int> tree(static_cast<size_t>(na)*nb, 0);
+  std::vector<int> forest;
+  for (size_t p=0; p<ka.size(); p++) {
+    for (size_t q=0; q<kb.size(); q++) {
+      int x0 = ma[ka[p]], y0 = mb[kb[q]];
+      int rows = ka[p]-x0+2, cols = kb[q]-y0+2;
+      forest.assign(static_cast<size_t>(rows)*cols, 0);
+      for (int x=1; x<rows; x++)
+	forest[x*cols] = forest[(x-1)*cols] + la[x0+x-1];
+      for (int y=1; y<cols; y++)
+	forest[y] = forest[y-1] + lb[y0+y-1];
+      for (int x=1; x<rows; x++) {
+	int u = x0+x-1;
+	for (int y=1; y<cols; y++) {
+	  int v = y0+y-1;
+	  int best = std::min(forest[(x-1)*cols + y] + la[u], forest[x*cols + y-1] + lb[v]);
+	  if (ma[u] == x0 && mb[v] == y0) {
+	    best = std::min(best, forest[(x-1)*cols + y-1] + abs(la[u] - lb[v]));
+	    tree[static_cast<size_t>(u)*nb + v] = best;
+	  } else {
+	    best = std::min(best, forest[(ma[u]-x0)*cols + (mb[v]-y0)]
+			    + tree[static_cast<size_t>(u)*nb + v]);
+	  }
+	  forest[x*cols + y] = best;
+	}
+      }
+    }
+  }
+  return tree[static_cast<size_t>(na)*nb - 1];
+}
+
+/* eof */
@@ -0,0 +1,99 @@
+#ifndef LOOP_TREE_H
+#define LOOP_TREE_H
+
+/**
+ * \class LoopTree
+ *
+ * \ingroup Folding
+ *
+ * \brief The loops of a secondary structure as an ordered tree, with abstract shapes and tree edit distance.
+ *
+ * Node 0 is the exterior loop; node k>0 is the loop closed by the kth pair i.j
+ * (numbered by increasing i). The children of a node are the pairs directly
+ * enclosed by its loop, from 5' to 3'. The tree is built in one pass over a pair
+ * table (as one row of RNAStructure::basepr) with a stack of open pairs, which is
+ * also how efn2 walks the loops.
+ *
+ * Stacked pairs form helices. The abstract shape (Giegerich, Voss and Rehmsmeier
+ * 2004) writes each helix as [ ] and each unpaired region as _, at five levels
+ * (a hairpin is always [], whatever its number of unpaired bases):
+ * \verbatim
+ * 1  all loops; all unpaired regions outside hairpins
+ * 2  all loops; unpaired regions only in the exterior loop and in multiloops
+ * 3  all loops; no unpaired regions
+ * 4  helices only (bulges and internal loops are absorbed); unpaired regions in the exterior loop and in multiloops
+ * 5  helices only; no unpaired regions
+ * \endverbatim
+ *
+ * The edit distance works on the coarser tree of helices, whose nodes are labelled
+ * with the number of pairs: deleting or inserting a helix costs its length and
+ * changing it costs the difference of the lengths. It is computed with the
+ * algorithm of Zhang and Shasha, whose cost is the product of the numbers of
+ * helices of the two structures times a factor for their nesting depths.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+class RNAStructure;
+
+class LoopTree {
+  /** The number of bases of the structure. */
+  int numbases_;
+  /** 5' base of the pair closing each loop (0 for the exterior loop). */
+  std::vector<int> i_;
+  /** 3' base of the pair closing each loop (n+1 for the exterior loop). */
+  std::vector<int> j_;
+  /** The enclosing loop of each loop (-1 for the exterior loop). */
+  std::vector<int> parent_;
+  /** The first enclosed pair of each loop, or -1. */
+  std::vector<int> first_child_;
+  /** The next pair in the same loop, or -1. */
+  std::vector<int> next_sibling_;
+  /** The number of enclosed pairs of each loop. */
+  std::vector<int> branches_;
+  /** The number of unpaired bases of each loop. */
+  std::vector<int> unpaired_;
+  /** Helix tree in postorder (the exterior loop last): the number of pairs of each helix. */
+  std::vector<int> helix_length_;
+  /** Helix tree in postorder: the leftmost leaf below each helix. */
+  std::vector<int> helix_leftmost_;
+ public:
+  LoopTree();
+  LoopTree(const RNAStructure *ct, int structnum = 1);
+  void assign(const int *pairs, int n);
+  /** @return The number of bases of the structure. */
+  int get_number_of_bases() const { return numbases_; }
+  /** @return The number of loops, including the exterior loop (i.e. pairs + 1). */
+  int get_number_of_loops() const { return static_cast<int>(i_.size()); }
+  /** @return The number of helices (maximal runs of stacked pairs). */
+  int get_number_of_helices() const { return static_cast<int>(helix_length_.size()) - 1; }
+  /** @return 5' base of the pair closing loop k (0 for the exterior loop). */
+  int closing_i(int k) const { return i_[k]; }
+  /** @return 3' base of the pair closing loop k (n+1 for the exterior loop). */
+  int closing_j(int k) const { return j_[k]; }
+  /** @return The loop enclosing loop k (-1 for the exterior loop). */
+  int parent(int k) const { return parent_[k]; }
+  /** @return The first pair enclosed by loop k, or -1 for a hairpin. */
+  int first_child(int k) const { return first_child_[k]; }
+  /** @return The next pair in the loop that encloses k, or -1. */
+  int next_sibling(int k) const { return next_sibling_[k]; }
+  /** @return The number of pairs directly enclosed by loop k. */
+  int get_number_of_branches(int k) const { return branches_[k]; }
+  /** @return The number of unpaired bases of loop k. */
+  int get_number_of_unpaired(int k) const { return unpaired_[k]; }
+  std::string shape(int level) const;
+  static int edit_distance(const LoopTree &a, const LoopTree &b);
+  static void shape_classes(const RNAStructure *ct, int level,
+			    std::map<std::string, std::vector<int> > *classes);
+ private:
+  bool stacked(int k) const;
+  void shape_of_helix(int k, int level, std::string *out) const;
+  void shape_of_loop(int k, int level, std::string *out) const;
+  void build_helix_tree();
+};
+
+#endif
+
+/* eof */
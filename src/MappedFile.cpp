@@ -0,0 +1,61 @@
+#include "MappedFile.h"
+
+#include <sys/mman.h>   /* mmap, madvise */
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/**
+ * Map the file at path. If it cannot be opened or mapped, is_open() is false
+ * (and errno tells why).
+ * @param path Path to a regular file.
+ */
+MappedFile::MappedFile(const char *path) :
+  data_(NULL), size_(0), released_(0), open_(false) {
+  int fd = open(path, O_RDONLY);
+  if (fd<0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st)==0) {
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_==0) {
+      open_ = true;
+    } else {
+      void *m = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m != MAP_FAILED) {
+	madvise(m, size_, MADV_SEQUENTIAL);
+	data_ = static_cast<const char*>(m);
+	open_ = true;
+      }
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != NULL)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+/**
+ * Tell the kernel that the pages before upto will not be read again, so that
+ * they no longer count towards the memory of the process. Reading them again is
+ * still allowed (the file is simply read anew).
+ * @param upto A position in the mapping; the whole pages before it are released.
+ */
+void MappedFile::release(const char *upto) {
+  if (data_==NULL || upto<=data_)
+    return;
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t offset = static_cast<size_t>(upto - data_);
+  if (offset > size_)
+    offset = size_;
+  offset -= offset % page;
+  if (offset > released_) {
+    madvise(const_cast<char*>(data_) + released_, offset - released_, MADV_DONTNEED);
+    released_ = offset;
+  }
+}
+
+/* eof */
@@ -0,0 +1,43 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+/**
+ * \class MappedFile
+ *
+ * \ingroup Folding
+ *
+ * \brief A file mapped read-only into memory.
+ *
+ * The parsers read their input in place from the mapping instead of copying
+ * it through stream buffers. The pages are mapped for sequential access;
+ * a reader that streams through a large file can hand back the part it is
+ * done with (release), so that the memory it occupies stays bounded.
+ * Only regular files can be mapped (not pipes).
+ */
+
+#include <stddef.h>
+
+class MappedFile {
+  /** Start of the mapping (NULL for an empty or unopened file). */
+  const char *data_;
+  /** Length of the file in bytes. */
+  size_t size_;
+  /** Offset (a multiple of the page size) below which the pages were released. */
+  size_t released_;
+  /** Whether the file could be opened and mapped. */
+  bool open_;
+ public:
+  explicit MappedFile(const char *path);
+  ~MappedFile();
+  bool is_open() const { return open_; }
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+  const char *end() const { return data_ + size_; }
+  void release(const char *upto);
+ private:
+  MappedFile(const MappedFile &);
+  MappedFile& operator=(const MappedFile &);
+};
+
+#endif
+/* eof */
@@ -0,0 +1,213 @@
+#include "PairProbability.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <math.h>
+
+#include "ThreadPool.h"
+#include "EnergyFunction2.h"
+#include "RNAStructure.h"  /* after the standard headers: it defines the macro infinity */
+
+/** The gas constant in kcal/(mol K). */
+static const double s_gas_constant = 0.0019872;
+/** Absolute zero in degrees Celsius. */
+static const double s_kelvin_offset = 273.15;
+/** Number of bases handled by one task of the thread pool. */
+static const int s_block = 32;
+
+
+/**
+ * Frequencies of the pairs of the structures of ct, each structure counted once.
+ * @param ct The structures (e.g. sampled or suboptimal structures of one sequence)
+ * @param pool The bases are divided among the workers of this pool
+ */
+PairProbability::PairProbability(const RNAStructure *ct, ThreadPool &pool) {
+  std::vector<double> weight(ct->get_number_of_structures()+1, 1.0);
+  accumulate(ct, weight, pool);
+}
+
+/**
+ * Boltzmann-weighted frequencies of the pairs of the structures of ct. The energies
+ * must have been set (e.g. by efn2_batch) with the same Datatable.
+ * @param ct The structures, with their energies
+ * @param dat Provides the temperature
+ * @param pool The bases are divided among the workers of this pool
+ */
+PairProbability::PairProbability(const RNAStructure *ct, const Datatable &dat, ThreadPool &pool) {
+  int y = ct->get_number_of_structures();
+  std::vector<double> weight(y+1, 0.0);
+  if (y > 0) {
+    double rt = 100.0 * s_gas_constant * (dat.get_temperature() + s_kelvin_offset);
+    int emin = ct->get_energy(1);
+    for (int s=2; s<=y; s++)
+      emin = std::min(emin, ct->get_energy(s));
+    /* relative to the lowest energy, so that no factor overflows */
+    for (int s=1; s<=y; s++)
+      weight[s] = exp(-(ct->get_energy(s) - emin) / rt);
+  }
+  accumulate(ct, weight, pool);
+}
+
+/**
+ * Sum the weights of the structures containing each pair and normalize them to
+ * frequencies. Each task collects the partners of a block of bases over all
+ * structures, so no two workers write the same entry.
+ * @param ct The structures
+ * @param weight The weight of each structure (one-based)
+ * @param pool The blocks of bases are divided among the workers of this pool
+ */
+void PairProbability::accumulate(const RNAStructure *ct, const std::vector<double> &weight,
+				 ThreadPool &pool) {
+  int n = ct->get_number_of_bases();
+  int y = ct->get_number_of_structures();
+  numbases_ = n;
+  nstructures_ = y;
+  const int * const *basepr = ct->basepr();
+  double total = 0.0;
+  for (int s=1; s<=y; s++)
+    total += weight[s];
+  std::vector<std::vector<std::pair<int,double> > > rows(n+1);
+  std::vector<std::vector<int> > slots(pool.size(), std::vector<int>(n+1, -1));
+  int nblocks = (n + s_block - 1) / s_block;
+  pool.run(nblocks, [&](int blk, int worker) {
+    std::vector<int> &slot = slots[worker];
+    int end = std::min(n, (blk+1)*s_block);
+    for (int i=blk*s_block+1; i<=end; i++) {
+      std::vector<std::pair<int,double> > &row = rows[i];
+      for (int s=1; s<=y; s++) {
+	int j = basepr[s][i];
+	if (j <= i)
+	  continue;
+	if (slot[j] < 0) {
+	  slot[j] = static_cast<int>(row.size());
+	  row.push_back(std::make_pair(j, 0.0));
+	}
+	row[slot[j]].second += weight[s];
+      }
+      for (size_t p=0; p<row.size(); p++)
+	slot[row[p].first] = -1;
+      std::sort(row.begin(), row.end());
+    }
+  });
+  start_.assign(n+2, 0);
+  partner_.clear();
+  prob_.clear();
+  unpaired_.assign(n+1, 1.0);
+  unpaired_[0] = 0.0;
+  for (int i=1; i<=n; i++) {
+    start_[i] = static_cast<int>(partner_.size());
+    for (size_t p=0; p<rows[i].size(); p++) {
+      int j = rows[i][p].first;
+      double f = total > 0.0 ? rows[i][p].second / total : 0.0;
+      partner_.push_back(j);
+      prob_.push_back(f);
+      unpaired_[i] -= f;
+      unpaired_[j] -= f;
+    }
+  }
+  start_[n+1] = static_cast<int>(partner_.size());
+  for (int i=1; i<=n; i++)
+    if (unpaired_[i] < 0.0)
+      unpaired_[i] = 0.0;  /* rounding */
+}
+
+/**
+ * @param i One-based position of a base
+ * @param j One-based position of a base
+ * @return The frequency of the pair i.j (0 if it does not occur).
+ */
+double PairProbability::probability(int i, int j) const {
+  if (i > j)
+    std::swap(i, j);
+  if (i < 1 || j > numbases_) {
+    std::cerr << "[ERROR] PairProbability: pair " << i << "." << j << " requested for "
+	      << numbases_ << " bases" << std::endl;
+    throw std::out_of_range("base out of range");
+  }
+  std::vector<int>::const_iterator first = partner_.begin() + start_[i];
+  std::vector<int>::const_iterator last = partner_.begin() + start_[i+1];
+  std::vector<int>::const_iterator p = std::lower_bound(first, last, j);
+  return (p != last && *p == j) ? prob_[p - partner_.begin()] : 0.0;
+}
+
+/**
+ * The centroid structure: all pairs with a frequency above 1/2 (these never
+ * conflict, since the frequencies of the pairs of one base add up to at most 1).
+ * @param pairs Receives the partner of each base (one-based, 0 if unpaired), get_number_of_bases()+1 entries
+ */
+void PairProbability::centroid(int *pairs) const {
+  for (int i=0; i<=numbases_; i++)
+    pairs[i] = 0;
+  for (int i=1; i<=numbases_; i++) {
+    for (int p=start_[i]; p<start_[i+1]; p++) {
+      if (prob_[p] > 0.5) {
+	pairs[i] = partner_[p];
+	pairs[partner_[p]] = i;
+      }
+    }
+  }
+}
+
+/**
+ * The maximum expected accuracy structure. With M(i,j) the best score of the
+ * bases i..j, either i is unpaired or it pairs with a stored partner k<=j:
+ * M(i,j) = max( M(i+1,j) + q(i), max_k 2*gamma*p(i,k) + M(i+1,k-1) + M(k+1,j) ),
+ * with q the unpaired frequencies. M is one flat array with rows of n+2 entries
+ * (rows 1..n+1, columns 0..n; M(i,i-1) = 0 is the empty interval), filled for
+ * decreasing i. The cost is O(n^2) times the average number of partners of a base.
+ * @param pairs Receives the partner of each base (one-based, 0 if unpaired), get_number_of_bases()+1 entries
+ * @param gamma Weight of paired against unpaired bases (larger values give more pairs)
+ * @return The expected accuracy score M(1,n) of the structure
+ */
+double PairProbability::mea(int *pairs, double gamma) const {
+  int n = numbases_;
+  size_t stride = n+2;
+  std::vector<double> m(stride*stride, 0.0);
+  for (int i=n; i>=1; i--) {
+    double *mi = &m[i*stride];
+    const double *below = &m[(i+1)*stride];
+    for (int j=i; j<=n; j++) {
+      double best = below[j] + unpaired_[i];
+      for (int p=start_[i]; p<start_[i+1] && partner_[p]<=j; p++) {
+	int k = partner_[p];
+	double v = 2.0*gamma*prob_[p] + below[k-1] + m[(k+1)*stride + j];
+	if (v > best)
+	  best = v;
+      }
+      mi[j] = best;
+    }
+  }
+  for (int i=0; i<=n; i++)
+    pairs[i] = 0;
+  std::vector<std::pair<int,int> > todo;
+  if (n > 0)
+    todo.push_back(std::make_pair(1, n));
+  while (!todo.empty()) {
+    int i = todo.back().first;
+    int j = todo.back().second;
+    todo.pop_back();
+    if (i > j)
+      continue;
+    const double *below = &m[(i+1)*stride];
+    double target = m[i*stride + j];
+    if (below[j] + unpaired_[i] == target) {
+      todo.push_back(std::make_pair(i+1, j));
+      continue;
+    }
+    for (int p=start_[i]; p<start_[i+1] && partner_[p]<=j; p++) {
+      int k = partner_[p];
+      if (2.0*gamma*prob_[p] + below[k-1] + m[(k+1)*stride + j] == target) {
+	pairs[i] = k;
+	pairs[k] = i;
+	todo.push_back(std::make_pair(i+1, k-1));
+	todo.push_back(std::make_pair(k+1, j));
+	break;
+      }
+    }
+  }
+  return n > 0 ? m[stride + n] : 0.0;
+}
+
+/* eof */
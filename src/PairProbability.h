@@ -0,0 +1,68 @@
+#ifndef PAIR_PROBABILITY_H
+#define PAIR_PROBABILITY_H
+
+/**
+ * \class PairProbability
+ *
+ * \ingroup Folding
+ *
+ * \brief Base-pair frequencies of the structures of an RNAStructure, with centroid and MEA structures.
+ *
+ * The frequency of a pair i.j is the fraction of the structures that contain it,
+ * either counting every structure once or weighting structure s by its Boltzmann
+ * factor exp(-E_s/RT) with the efn2 energies E_s (see efn2_batch) at the temperature
+ * of a Datatable. For a set of sampled or suboptimal structures these are estimates
+ * of the pair probabilities.
+ *
+ * Only pairs that occur are stored, as one sorted list of partners j>i per base i
+ * (compressed rows). The table is filled in one pass over the rows of basepr, the
+ * bases being divided among the workers of a ThreadPool.
+ *
+ * The centroid structure contains the pairs with a frequency above 1/2. The
+ * maximum expected accuracy (MEA) structure maximizes the sum of 2*gamma*p(i,j)
+ * over its pairs plus the unpaired probability of its unpaired bases; the folding
+ * recursion only considers the stored pairs.
+ */
+
+#include <vector>
+
+class RNAStructure;
+class Datatable;
+class ThreadPool;
+
+class PairProbability {
+  /** The number of bases of the sequence. */
+  int numbases_;
+  /** The number of structures the frequencies were taken from. */
+  int nstructures_;
+  /** The pairs of base i are at start_[i]..start_[i+1]-1 of partner_ and prob_. */
+  std::vector<int> start_;
+  /** Partner j>i of each stored pair. */
+  std::vector<int> partner_;
+  /** Frequency of each stored pair. */
+  std::vector<double> prob_;
+  /** Frequency with which each base is unpaired (one-based). */
+  std::vector<double> unpaired_;
+ public:
+  PairProbability(const RNAStructure *ct, ThreadPool &pool);
+  PairProbability(const RNAStructure *ct, const Datatable &dat, ThreadPool &pool);
+  /** @return The number of bases of the sequence. */
+  int get_number_of_bases() const { return numbases_; }
+  /** @return The number of structures the frequencies were taken from. */
+  int get_number_of_structures() const { return nstructures_; }
+  /** @return The number of different pairs with a non-zero frequency. */
+  int get_number_of_pairs() const { return static_cast<int>(partner_.size()); }
+  double probability(int i, int j) const;
+  /** @return The frequency with which base i (one-based) is unpaired. */
+  double unpaired(int i) const { return unpaired_[i]; }
+  void centroid(int *pairs) const;
+  double mea(int *pairs, double gamma = 1.0) const;
+ private:
+  void accumulate(const RNAStructure *ct, const std::vector<double> &weight, ThreadPool &pool);
+  PairProbability(const PairProbability &);
+  PairProbability& operator=(const PairProbability &);
+};
+
+#endif
+
+/* eof */
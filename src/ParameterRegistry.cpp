@@ -0,0 +1,82 @@
+#include "ParameterRegistry.h"
+
+#include <iostream>
+#include <stdexcept>
+
+
+ParameterSet::ParameterSet(Datatable *dat, unsigned long version) :
+  dat_(dat), version_(version) {
+}
+
+ParameterSet::~ParameterSet() {
+  delete dat_;
+}
+
+/**
+ * Read the initial parameter set (version 1) from a directory with the mfold .dat files.
+ */
+ParameterRegistry::ParameterRegistry(const char *directory_path) :
+  last_version_(0) {
+  publish(new Datatable(directory_path));
+}
+
+/**
+ * Start from an already loaded parameter set (for instance, one attached from
+ * shared memory). The registry takes ownership of dat.
+ */
+ParameterRegistry::ParameterRegistry(Datatable *dat) :
+  last_version_(0) {
+  publish(dat);
+}
+
+/**
+ * @return A handle to the current parameter set. This is a single atomic load of a
+ * shared_ptr, cheap enough to be taken for every structure that is evaluated.
+ */
+ParameterRegistry::Snapshot ParameterRegistry::snapshot() const {
+  return std::atomic_load(&current_);
+}
+
+/**
+ * @return The version number of the current parameter set.
+ */
+unsigned long ParameterRegistry::get_version() const {
+  return snapshot()->get_version();
+}
+
+/**
+ * Read the parameter files of directory_path and make them the current set.
+ * The files are parsed before anything is published, so readers keep working
+ * with the old set meanwhile, and a directory that cannot be read leaves the
+ * registry unchanged (the exception of the Datatable constructor propagates).
+ * @return The version number of the new set.
+ */
+unsigned long ParameterRegistry::reload(const char *directory_path) {
+  Datatable *dat = NULL;
+  try {
+    dat = new Datatable(directory_path);
+  } catch (const std::exception &e) {
+    std::cerr << "[ERROR] Could not reload parameters from \"" << directory_path
+	      << "\", keeping version " << get_version() << std::endl;
+    throw;
+  }
+  return publish(dat);
+}
+
+/**
+ * Make dat the current parameter set. The registry takes ownership of dat; the
+ * set it replaces is deleted once the last snapshot referring to it is released.
+ * @return The version number of the new set.
+ */
+unsigned long ParameterRegistry::publish(Datatable *dat) {
+  if (dat == NULL) {
+    throw std::invalid_argument("cannot publish a NULL parameter set");
+  }
+  std::lock_guard<std::mutex> lock(publish_mutex_);
+  Snapshot next(new ParameterSet(dat, last_version_ + 1));
+  ++last_version_;
+  std::atomic_store(&current_, next);
+  return last_version_;
+}
+
+/* eof */
@@ -0,0 +1,75 @@
+#ifndef PARAMETER_REGISTRY_H
+#define PARAMETER_REGISTRY_H
+
+/**
+ * \class ParameterRegistry
+ *
+ * \ingroup Folding
+ *
+ * \brief Versioned, hot-reloadable thermodynamic parameters for long-running processes.
+ *
+ * The registry holds the current parameter set as a shared_ptr to an immutable
+ * ParameterSet. Readers call snapshot() once per unit of work (for instance, per
+ * structure file) and evaluate with the Datatable of that snapshot; the snapshot
+ * keeps its tables alive even if a reload replaces them in the meantime, so
+ * in-flight evaluations are never disturbed.
+ *
+ * reload() parses the new parameter directory without holding any lock that readers
+ * need, and only then publishes the new set with an atomic store. If the new
+ * files cannot be read, the exception propagates and the current set stays in place.
+ * The previous set is destroyed when the last snapshot that refers to it goes away.
+ */
+
+#include "EnergyFunction2.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * \class ParameterSet
+ *
+ * \brief One published version of the parameter tables.
+ */
+class ParameterSet {
+  /** The parameter tables (owned). */
+  Datatable *dat_;
+  /** Number of the publication that produced this set (1 for the initial tables). */
+  unsigned long version_;
+ public:
+  ParameterSet(Datatable *dat, unsigned long version);
+  ~ParameterSet();
+  const Datatable& get_datatable() const { return *dat_; }
+  unsigned long get_version() const { return version_; }
+ private:
+  ParameterSet(const ParameterSet &);
+  ParameterSet& operator=(const ParameterSet &);
+};
+
+
+class ParameterRegistry {
+ public:
+  /** A reader's handle to one version of the parameters. */
+  typedef std::shared_ptr<const ParameterSet> Snapshot;
+ private:
+  /** The current parameter set. Only accessed with std::atomic_load/std::atomic_store. */
+  Snapshot current_;
+  /** Serialises publishers so that version numbers increase in publication order. */
+  std::mutex publish_mutex_;
+  /** Version number of the most recently published set. */
+  unsigned long last_version_;
+ public:
+  explicit ParameterRegistry(const char *directory_path);
+  explicit ParameterRegistry(Datatable *dat);
+
+  Snapshot snapshot() const;
+  unsigned long get_version() const;
+  unsigned long reload(const char *directory_path);
+  unsigned long publish(Datatable *dat);
+ private:
+  ParameterRegistry(const ParameterRegistry &);
+  ParameterRegistry& operator=(const ParameterRegistry &);
+};
+
+#endif
+/* eof */
@@ -2,7 +2,10 @@
 
 
 
-#include "RNAStructure.h"
+#include <algorithm>
+#include "ThreadPool.h"
+#include "RNAStructure.h"  /* after these: it defines the macro infinity */
+#include "StructureWriter.h"
 
 #include <iostream>
 #include <fstream>
@@ -13,6 +16,130 @@
 #include <math.h>       /* floor */
 #include <cerrno>
 #include <exception>
+#include <stdexcept>
+#include <climits>
+
+
+/**
+ * Numeric codes of the one-letter bases of a CT file (see RNAStructure::numseq_),
+ * so that encoding a base is a single table lookup.
+ * - A, B: 1; C, Z: 2; G, H: 3; U, T, V, W: 4; I (intermolecular linker): 5;
+ * - a, c, g, u, t: as the upper case base, and forced single stranded;
+ * - anything else (e.g. X): 0.
+ */
+struct BaseTable {
+  unsigned char code[256];
+  unsigned char nopair[256];
+  BaseTable() {
+    memset(code, 0, sizeof(code));
+    memset(nopair, 0, sizeof(nopair));
+    code['A'] = code['B'] = code['a'] = 1;
+    code['C'] = code['Z'] = code['c'] = 2;
+    code['G'] = code['H'] = code['g'] = 3;
+    code['U'] = code['T'] = code['V'] = code['W'] = code['u'] = code['t'] = 4;
+    code['I'] = 5;
+    nopair['a'] = nopair['c'] = nopair['g'] = nopair['u'] = nopair['t'] = 1;
+  }
+};
+
+static const BaseTable s_base_table;
+
+/**
+ * Character classes for the CT parser: blanks (space, tab, carriage return) separate
+ * the fields of a line, and a field ends at a blank or at the newline.
+ */
+struct CharTable {
+  unsigned char blank[256];
+  unsigned char delimiter[256];
+  CharTable() {
+    memset(blank, 0, sizeof(blank));
+    memset(delimiter, 0, sizeof(delimiter));
+    blank[' '] = blank['\t'] = blank['\r'] = 1;
+    delimiter[' '] = delimiter['\t'] = delimiter['\r'] = delimiter['\n'] = 1;
+  }
+};
+
+static const CharTable s_char_table;
+
+/*
+ * The scanning functions below do not check for the end of the buffer: every line
+ * they are applied to ends with a newline, which stops all of them
+ * (see createFromCTFile for a last line without a newline).
+ */
+
+static inline bool is_blank(char c) {
+  return s_char_table.blank[static_cast<unsigned char>(c)];
+}
+
+/** @return The first character at or after p that is not a blank. */
+static inline const char *skip_blanks(const char *p) {
+  while (is_blank(*p))
+    p++;
+  return p;
+}
+
+/**
+ * Skip optional blanks and the following field (a run of characters other than
+ * blanks and newlines).
+ * @return The character after the field, or NULL if the line has no further field.
+ */
+static inline const char *skip_field(const char *p) {
+  p = skip_blanks(p);
+  if (*p=='\n')
+    return NULL;
+  while (!s_char_table.delimiter[static_cast<unsigned char>(*p)])
+    p++;
+  return p;
+}
+
+/**
+ * Parse an optionally signed decimal integer after optional blanks.
+ * @return The character after the integer, or NULL if there is no integer at p.
+ */
+static inline const char *parse_int(const char *p, int *value) {
+  p = skip_blanks(p);
+  bool negative = false;
+  if (*p=='-' || *p=='+') {
+    negative = (*p=='-');
+    p++;
+  }
+  unsigned int d = static_cast<unsigned char>(*p) - '0';
+  if (d>9)
+    return NULL;
+  int v = 0;
+  do {
+    v = 10*v + d;
+    p++;
+    d = static_cast<unsigned char>(*p) - '0';
+  } while (d<=9);
+  *value = negative ? -v : v;
+  return p;
+}
+
+/** @return The position of the newline that ends the line starting at p, or end. */
+static inline const char *line_end(const char *p, const char *end) {
+  const char *eol = static_cast<const char*>(memchr(p, '\n', end-p));
+  return eol ? eol : end;
+}
+
+/** @return true if there is nothing but white space in [p,end). */
+static bool only_space(const char *p, const char *end) {
+  for (; p<end; p++)
+    if (!s_char_table.delimiter[static_cast<unsigned char>(*p)])
+      return false;
+  return true;
+}
+
+/**
+ * Report a malformed CT file; such a file is corrupt and we do not try to recover.
+ * @throws std::runtime_error naming the file and the line
+ */
+static void ct_error(const char *path, int lineno, const char *msg) {
+  std::stringstream ss;
+  ss << "Malformed CT file \"" << path << "\" (line " << lineno << "): " << msg;
+  std::cerr << "[ERROR] " << ss.str() << std::endl;
+  throw std::runtime_error(ss.str());
+}
 
 
 inline void swap(int *a, int *b) {
@@ -23,13 +150,82 @@ inline void swap(int *a, int *b) {
   return;
 }
 
-RNAStructure::RNAStructure(const std::string &path) {
-  int i;
-  allocate();
-  for (i=1;i<=s_maxstructures;i++) {
-    energy_[i]=0;
-    allocated_ = false;
+/**
+ * An empty structure, e.g., to be filled by CTReader::next.
+ */
+RNAStructure::RNAStructure() {
+  stride_ = 0;
+  numofbases_ = 0;
+  numofstructures_ = 0;
+  nnopair_=0;
+  npair_=0;
+  ndbl_=0;
+  intermolecular_ = false;
+  ngu_ = 0;
+  templated_ = false;
+}
+
+/**
+ * Replace the contents of the object by the sequence alone, without any structures;
+ * add them with add_structure. The arrays are only reallocated for a longer sequence.
+ * @param sequence The nucleotides (the same letters as in the second column of a CT file).
+ */
+void RNAStructure::assign_sequence(const std::string &sequence) {
+  int n = static_cast<int>(sequence.size());
+  if (n >= stride_) {
+    allocate(n, 1);
   }
+  numofbases_ = n;
+  numofstructures_ = 0;
+  nnopair_ = 0;
+  npair_ = 0;
+  ndbl_ = 0;
+  ngu_ = 0;
+  intermolecular_ = false;
+  int j = 0;
+  for (int count=1; count<=n; count++) {
+    nucs_[count] = sequence[count-1];
+    tonum(sequence[count-1], count);
+    if (numseq_[count]==5 && j<3) { /* see createFromCTFile */
+      inter_[j] = count;
+      j++;
+    }
+    hnumber_[count] = count;
+  }
+}
+
+/**
+ * Append a structure of the current sequence.
+ * @param pairs pairs[k] is the partner of base k (one-based) or 0, for k=1..get_number_of_bases().
+ * @param energy 100 x the free energy of the structure (0 if unknown).
+ * @param label The label (header) of the structure.
+ * @return The index (one-based) of the new structure.
+ */
+int RNAStructure::add_structure(const int *pairs, int energy, const std::string &label) {
+  /* pairs may be a row of this object, which reserve_structures can move */
+  const int *buffer = pairs_.data();
+  bool own = !pairs_.empty() && pairs >= buffer && pairs < buffer + pairs_.size();
+  size_t offset = own ? static_cast<size_t>(pairs - buffer) : 0;
+  std::string header(label);
+  numofstructures_++;
+  reserve_structures(numofstructures_);
+  if (own)
+    pairs = pairs_.data() + offset;
+  memcpy(basepr_[numofstructures_]+1, pairs+1, sizeof(int)*numofbases_);
+  energy_[numofstructures_] = energy;
+  ctlabel_[numofstructures_].swap(header);
+  return numofstructures_;
+}
+
+/**
+ * Read the structures of a CT file. The arrays are sized to the number of bases
+ * and structures that are actually found in the file.
+ * @param path Path to the ct file.
+ */
+RNAStructure::RNAStructure(const std::string &path) {
+  stride_ = 0;
+  numofbases_ = 0;
+  numofstructures_ = 0;
   nnopair_=0;
   npair_=0;
   ndbl_=0;
@@ -39,6 +235,63 @@ RNAStructure::RNAStructure(const std::string &path) {
   createFromCTFile(path.c_str());
 }
 
+/**
+ * Construct a single structure from a sequence and its secondary structure in
+ * dot-bracket notation, e.g., "GGGAAAUCC" and "(((...)))", without going
+ * through a CT file. Only one structure is allocated, and only for the length
+ * of the sequence.
+ * @param sequence The nucleotides (the same letters as in the second column of a CT file).
+ * @param dotbracket The structure, '(' and ')' for paired and '.' for unpaired bases.
+ */
+RNAStructure::RNAStructure(const std::string &sequence, const std::string &dotbracket) {
+  templated_ = false;
+  numofbases_ = 0;
+  allocate(static_cast<int>(sequence.size()), 1);
+  assign(sequence, dotbracket);
+}
+
+/**
+ * Replace the contents of the object by a single structure given as a sequence
+ * and a dot-bracket string. The arrays are only reallocated if the new sequence is
+ * longer than any sequence held before, so that a structure can be reused to
+ * evaluate a stream of candidates without touching the heap.
+ * @param sequence The nucleotides (the same letters as in the second column of a CT file).
+ * @param dotbracket The structure, '(' and ')' for paired and '.' for unpaired bases.
+ */
+void RNAStructure::assign(const std::string &sequence, const std::string &dotbracket) {
+  int n = static_cast<int>(sequence.size());
+  if (static_cast<int>(dotbracket.size()) != n) {
+    throw std::invalid_argument("dot-bracket string does not match the length of the sequence");
+  }
+  assign_sequence(sequence);
+  numofstructures_ = 1;
+  energy_[1] = 0;
+  ctlabel_[1].clear();
+  /* Row zero of basepr_ is not used by any structure and serves as the stack of open brackets. */
+  int *bp = basepr_[1];
+  int *open = basepr_[0];
+  int sp = 0;
+  for (int k=1; k<=n; k++) {
+    char c = dotbracket[k-1];
+    if (c=='(') {
+      open[sp++] = k;
+      bp[k] = 0;
+    } else if (c==')') {
+      if (sp==0)
+	throw std::invalid_argument("unbalanced dot-bracket string");
+      int i = open[--sp];
+      bp[i] = k;
+      bp[k] = i;
+    } else if (c=='.') {
+      bp[k] = 0;
+    } else {
+      throw std::invalid_argument("unexpected character in dot-bracket string");
+    }
+  }
+  if (sp!=0)
+    throw std::invalid_argument("unbalanced dot-bracket string");
+}
+
 /**
  * The connect format is column based. The first column specified the sequence index, starting at one. 
  * Columns 3, 4, and 6 redundantly give sequence indices (plus/minus one). The second column contains 
@@ -77,191 +330,268 @@ RNAStructure::RNAStructure(const std::string &path) {
 * Note that this class was adapted from a struct that was intended to deal with CT files. It is
 * thus not primarily adapted to dot-parens or other structure representations. We will make a
 * function to output a dot-paren representation from the CT representation.
+* The file is mapped into memory and parsed in place, one pass per line: the columns that
+* repeat the numbering are skipped, the pairing partner and the historical numbering are
+* converted directly, and the bases (which are taken from the first structure) are encoded
+* with a table lookup.
  * @param path Path to the ct file.
- * @param rnalist Vector that will hold all of the structures in the current CT file we are parsing.
+ * @return 1 on success, 0 if the file could not be opened.
+ * @throws std::runtime_error if the file is malformed (with the path and line number)
  */
 int RNAStructure::createFromCTFile(const char * path) {
-  int count, i, j;
-  int linelength = 20;
-  char base[2]; // base[0] will be one or ACGU, and base[1]='\0'
-  char line[linelength], temp[50];
-  std::string header;
-  std::string lin;
-  std::ifstream in;
   numofbases_=-1; /* flag that numbases is not initialised */
-  in.open(path);
-  if (!in.is_open())
+  numofstructures_=0;
+  CTReader reader(path);
+  if (!reader.is_open()) {
     perror("error while opening CT file");
-  /*
-  in >> count; // this is the number of residues in the sequence. 
-  j = 0;
-
-  if (count == -100) { //this is a CCT formatted file:
-    std::cerr << "[ERROR] Attempting to read a CCT-formated file \"" << path << "\", which is not supported."
-	      << std::endl;
-    exit(1);
+    numofbases_ = 0;
+    return 0;
   }
-  // Reset the file
-  in.close();
-  in.open(path);
-  */
-  for (numofstructures_ = 1; numofstructures_<=s_maxstructures;numofstructures_++) {
-    if (numofstructures_==s_maxstructures) {
-      std::cerr << "[ERROR] Number of structures in CT file \""<< path << "\" exceeds maximum allowed.\n";
-      exit(1);
+  read_ct_records(&reader, INT_MAX);
+  if (numofbases_<0)
+    numofbases_ = 0;
+  return 1;
+}
+
+/**
+ * Replace the structures of this object by the next (at most max) records of the CT
+ * file of reader (see createFromCTFile for the format). The sequence is taken from
+ * the first of these records.
+ * @return The number of structures read (0 at the end of the file).
+ */
+int RNAStructure::read_ct_records(CTReader *reader, int max) {
+  const char *path = reader->path_.c_str();
+  const char *p = reader->pos_;
+  const char *end = reader->end_;
+  const char *tail = reader->tail_;
+  int lineno = reader->lineno_;
+  int j = 0; /* number of intermolecular linker bases seen so far */
+  numofstructures_ = 0;
+  while (numofstructures_ < max) {
+    if (p==tail && tail<end) {
+      /* The scanners stop at newlines; a last line without one is parsed from a copy that has it. */
+      reader->lastline_.assign(tail, end-tail);
+      reader->lastline_ += '\n';
+      p = reader->lastline_.data();
+      end = p + reader->lastline_.size();
+      tail = end;
     }
+    if (p>=end)
+      break;
     // The first line should also be the header. Format: 
     // 99	dG = -31.70 [Initially -31.70] AAEU02002163 1/2268-2170
     // alternative format: 
     // 76   ENERGY = 0.1  RA7680
-    if (getline(in,header)) {
+    const char *eol = line_end(p, end);
+    lineno++;
+    const char *q = skip_blanks(p);
+    if (q==eol) {
       /** Some CT files have an empty last line. This is probably not standard-conform, 
        * but if we see this we assume that the data is over and we stop trying to input
        * more data.
        */
-      if (header.empty() || header.length()==0) {
-	std::cerr << "[WARNING] Empty header line (or last empty line) in CT file: \""
-		  << header << "\" in file: "
-		  << path << "\"\n";
-	goto bailout;
-      }
-      const std::string delims(" \t"); /* space or tab */
-      size_t first_space = header.find_first_of(delims);
-      std::string num = header.substr(0,first_space );
-      int n = atoi(num.c_str());
-      if (numofbases_<0)
-	numofbases_=n;
-      else if (numofbases_ != n) {
-	std::cerr << "[ERROR] Malformed CT file: Divergent number of bases (n=" << n
-		  <<") but we previously found numofbases_="<<numofbases_ << std::endl;
-	exit(1); /* This is a major error that means the input file is corrupt. Do not try to recover. */
-      }
-      size_t rest = header.find_first_not_of(delims,first_space+1);
-      size_t last = header.find_last_not_of(delims);
-      header = header.substr(rest, (last-rest+1));
-    } else {
-      if (errno != 0) { /* if errno==0, there was no error, and we are simply finished with the file. */
-	perror("Could not process header line of CT file");
+      if (!only_space(eol, end)) {
+	std::cerr << "[WARNING] Empty header line in CT file \"" << path
+		  << "\" (line " << lineno << "), ignoring the rest of the file\n";
       }
+      p = end;
       break;
     }
-    /* when we get here, we are finished with the header */
-    if (in.eof()) {
-      numofstructures_--;
-      return 1;
+    int n;
+    q = parse_int(q, &n);
+    if (q==NULL) 
+      ct_error(path, lineno, "the header does not start with the number of bases");
+    if (reader->numofbases_<0) {
+      if (n<=0)
+	ct_error(path, lineno, "invalid number of bases");
+      reader->numofbases_=n;
+    } else if (reader->numofbases_ != n) {
+      /* This is a major error that means the input file is corrupt. Do not try to recover. */
+      ct_error(path, lineno, "divergent number of bases");
+    }
+    if (numofbases_ != n) {
+      numofbases_ = n;
+      allocate(n, 1);
+    }
+    q = skip_blanks(q);
+    const char *last = eol;
+    while (last>q && is_blank(last[-1]))
+      last--;
+    p = eol+1;
+    if (p>=end && tail==end) /* a header without any bases at the end of the file */
+      break;
+    numofstructures_++;
+    reserve_structures(numofstructures_);
+    ctlabel_[numofstructures_].assign(q, last-q);
+    energy_[numofstructures_] = 0;
+    int *bp = basepr_[numofstructures_];
+    bool first = (numofstructures_==1);
+    if (first) {
+      nnopair_ = 0;
+      intermolecular_ = false;
     }
-    ctlabel_[numofstructures_] = header;
     // The following code gets the structural information.
-    for (count=1; count<= numofbases_; count++)	{
-      in >> temp; //ignore base number in ctfile
-      in >> base; //read the base
-      strcpy(base+1, "\0");
-      nucs_[count]=base[0];
-      tonum(base, count); //convert base to numeric
-      if (numseq_[count]==5) {  /* 5 is a flag for intermolecular interactions, see erg3 */
-	intermolecular_ = true;
-	inter_[j] = count; /* the index of the jth base with intermolecular interactions. */
-	j++;
+    for (int count=1; count<=numofbases_; count++) {
+      if (p==tail && tail<end) {
+	reader->lastline_.assign(tail, end-tail);
+	reader->lastline_ += '\n';
+	p = reader->lastline_.data();
+	end = p + reader->lastline_.size();
+	tail = end;
       }
-      in >> temp; //ignore numbering
-      in >> temp; //ignore numbering
-      in >> basepr_[numofstructures_][count]; //read base pairing info
-      in >> hnumber_[count]; //read historical numbering
-    }
-    /* when we get here,  we have read in all of the lines for each base in the current structure. */
-    char c = in.peek();  // peek character
-    if ( c == EOF ) {
-      goto bailout;
-    } else if (c==10) { /* char value of 10 means new line. We need to remove this character
-			   in order to get the next call to getline to work correctly! */
-      in.get(c);
+      if (p>=end)
+	ct_error(path, lineno, "the file ends in the middle of a structure");
+      lineno++;
+      /* The columns that only repeat the numbering are skipped without converting them. */
+      int partner, hist;
+      q = skip_field(p); //ignore base number in ctfile
+      char base = '\0';
+      if (q!=NULL) {
+	q = skip_blanks(q);
+	base = *q; //read the base
+	q = skip_field(q);
+      }
+      if (q!=NULL) q = skip_field(q); //ignore numbering
+      if (q!=NULL) q = skip_field(q); //ignore numbering
+      if (q!=NULL) q = parse_int(q, &partner); //read base pairing info
+      if (q!=NULL) q = parse_int(q, &hist); //read historical numbering
+      if (q==NULL)
+	ct_error(path, lineno, "expected six columns");
+      if (partner<0 || partner>numofbases_)
+	ct_error(path, lineno, "base pairing partner out of range");
+      bp[count] = partner;
+      if (first) { /* the structures share the sequence of the first one */
+	nucs_[count] = base;
+	tonum(base, count); //convert base to numeric
+	if (numseq_[count]==5 && j<3) {  /* 5 is a flag for intermolecular interactions, see erg3 */
+	  inter_[j] = count; /* the index of the jth base with intermolecular interactions. */
+	  j++;
+	}
+	hnumber_[count] = hist;
+      }
+      while (*q!='\n')
+	q++;
+      p = q+1;
     }
   }
- bailout:
-  numofstructures_--;
-  return 1;
+  reader->pos_ = p;
+  reader->end_ = end;
+  reader->tail_ = tail;
+  reader->lineno_ = lineno;
+  return numofstructures_;
 }
 
 
 
-void RNAStructure::tonum(char *base, int count)	{
-  if (!strcmp(base, "A")) (numseq_[count] = 1);
-  else if(!strcmp(base, "B")) {
-    (numseq_[count] = 1);
-
-  }
-  else if(!strcmp(base, "a")) {
-    numseq_[count]=1;
-    nnopair_++;
-    nopair_[nnopair_] = count;
-  }
-  else if(!strcmp(base, "C")) (numseq_[count] = 2);
-  else if(!strcmp(base, "Z")) {
-    (numseq_[count] = 2);
+/**
+ * Open the CT file at path for reading with next. The file is mapped into memory;
+ * see is_open for whether this worked.
+ * @param path Path to the ct file.
+ */
+CTReader::CTReader(const std::string &path) :
+  path_(path), file_(path.c_str()), lineno_(0), numofbases_(-1), nread_(0) {
+  pos_ = file_.data();
+  end_ = file_.end();
+  tail_ = end_;
+  while (tail_>pos_ && tail_[-1]!='\n')
+    tail_--;
+}
 
+/**
+ * Read the next records of the file into ct, replacing the structures it held.
+ * ct only ever holds max_structures structures, and the part of the file that was
+ * parsed is released, so that memory does not grow with the size of the file.
+ * @param ct Receives the structures (with the sequence of the first one); it is
+ * resized as necessary and can be reused for all calls.
+ * @param max_structures Maximum number of structures to read.
+ * @return The number of structures read, 0 at the end of the file.
+ * @throws std::runtime_error if a record is malformed or truncated (with the path and
+ * line number); ct is then left without structures and the reader stays at that record.
+ */
+int CTReader::next(RNAStructure *ct, int max_structures) {
+  if (max_structures < 1) {
+    throw std::invalid_argument("max_structures must be positive");
   }
-  else if(!strcmp(base, "c")) {
-    numseq_[count] = 2;
-    nnopair_++;
-    nopair_[nnopair_] = count;
+  if (!file_.is_open())
+    return 0;
+  int k;
+  try {
+    k = ct->read_ct_records(this, max_structures);
+  } catch (const std::runtime_error &) {
+    ct->numofstructures_ = 0; /* do not hand out the records of a half-read batch */
+    throw;
   }
-  else if(!strcmp(base, "G")) (numseq_[count] = 3);
-  else if(!strcmp(base, "H")) {
-    (numseq_[count] = 3);
+  nread_ += k;
+  if (pos_ >= file_.data() && pos_ <= file_.end())
+    file_.release(pos_);
+  return k;
+}
 
-  }
-  else if(!strcmp(base, "g")) {
-    numseq_[count] = 3;
-    nnopair_++;
-    nopair_[nnopair_] = count;
-  }
 
-  else if(!strcmp(base, "U")||!strcmp(base, "T")) (numseq_[count] = 4);
-  else if(!strcmp(base, "V")||!strcmp(base, "W")) {
-    (numseq_[count] = 4);
 
-  }
-  else if(!strcmp(base, "u")||!strcmp(base, "t")) {
-    numseq_[count] = 4;
+/**
+ * Store the numeric code of base (see numseq_) at position count. Lower case
+ * bases are additionally recorded as forced single stranded (nopair_), and 'I'
+ * marks an intermolecular linker.
+ */
+void RNAStructure::tonum(char base, int count)	{
+  unsigned char c = static_cast<unsigned char>(base);
+  numseq_[count] = s_base_table.code[c];
+  if (s_base_table.nopair[c] && nnopair_ < maxforce-1) {
     nnopair_++;
     nopair_[nnopair_] = count;
   }
-
-  else if(!strcmp(base, "I")) {
-    numseq_[count] = 5;
+  if (numseq_[count]==5)
     intermolecular_= true;
-  }
-
-  else (numseq_[count]=0);  //this is for others, like X
-  return;
 }
 
 
-void RNAStructure::allocate(int size) {
-  int i;
-  //Size = size;//save the size of the array so that the destructor can
-  //deallocate the space
-  numseq_ = new int [2*size+1];
-  hnumber_ = new int [size+1];
-  nucs_ = new char [size+2];
-  basepr_ = new int *[maxstructures+1];
-  for (i=0;i<=s_maxstructures;i++) {
-    basepr_[i] = new int [size+1];
+/**
+ * Size the arrays for sequences of up to size bases and for nstructures structures.
+ * The pair tables of all structures share one contiguous buffer (pairs_), with one
+ * row of size+1 entries per structure; basepr_ holds pointers to the rows.
+ */
+void RNAStructure::allocate(int size, int nstructures) {
+  stride_ = size+1;
+  numseq_.assign(2*size+1, 0);
+  hnumber_.assign(size+1, 0);
+  nucs_.assign(size+2, 0);
+  pairs_.clear();
+  basepr_.clear();  /* the rows of the old length are laid out differently */
+  energy_.clear();
+  ctlabel_.clear();
+  reserve_structures(nstructures);
+}
+
+/**
+ * Make room for at least nstructures structures (keeping the ones already stored).
+ * The buffers grow geometrically, so that reading a CT file structure by structure
+ * takes amortized constant time per structure.
+ */
+void RNAStructure::reserve_structures(int nstructures) {
+  size_t rows = nstructures+1;
+  if (energy_.size() >= rows)
+    return;
+  size_t r = basepr_.size();
+  /* rows may have been permuted (apply_order), so rebase them by offset if pairs_ moves */
+  std::vector<size_t> offset;
+  if (pairs_.capacity() < rows*stride_) {
+    offset.resize(r);
+    for (size_t k=0; k<r; k++)
+      offset[k] = basepr_[k] - pairs_.data();
   }
-  allocated_ = true;
+  pairs_.resize(rows*stride_, 0);
+  energy_.resize(rows, 0);
+  ctlabel_.resize(rows);
+  for (size_t k=0; k<offset.size(); k++)
+    basepr_[k] = &pairs_[offset[k]];
+  basepr_.resize(rows);
+  for (; r<rows; r++)
+    basepr_[r] = &pairs_[r*stride_];
 }
 
 RNAStructure::~RNAStructure() {
   int i;
-  if (allocated_) {
-    delete[] numseq_;
-    for (i=0;i<=s_maxstructures;i++) {
-      delete[] basepr_[i];
-    }
-    delete[] basepr_;
-    delete[] hnumber_;
-    delete[] nucs_;
-  }
   if (templated_) {
     for (i=0;i<=numofbases_;i++) {
       delete[] tem_[i];
@@ -270,6 +600,20 @@ RNAStructure::~RNAStructure() {
   }
 }
 
+/**
+ * @return The number of bytes allocated on the heap for the sequence, the pair tables,
+ * the energies and the labels of the structures.
+ */
+size_t RNAStructure::get_storage_size() const {
+  size_t size = sizeof(int) * (numseq_.capacity() + hnumber_.capacity() + pairs_.capacity()
+			       + energy_.capacity())
+    + nucs_.capacity() + sizeof(int*) * basepr_.capacity()
+    + sizeof(std::string) * ctlabel_.capacity();
+  for (size_t k=0; k<ctlabel_.size(); k++)
+    size += ctlabel_[k].capacity();
+  return size;
+}
+
 
 
 int RNAStructure::get_number_of_bases() const {
@@ -317,43 +661,133 @@ std::string RNAStructure::get_dot_parens_structure(int i) const {
 }
 
 void RNAStructure::set_energy( int* en, int n ) {
-  if (n>s_maxstructures) {
+  if (n>static_cast<int>(energy_.size())) {
     throw std::exception();//"array out of bounds exception in set_energy");
   }
-  memcpy (energy_,en, sizeof(int)*n);
+  memcpy (&energy_[0],en, sizeof(int)*n);
 }
 
 /**
- * Reorder the structures in a CT file by their efn energies.
+ * Orders structures by energy, ties broken by their position so that the
+ * resulting order is stable (and the same for the serial and parallel sort).
  */
-void RNAStructure::sortstructures () {
-  register int c;
-  int cur, i;
-  std::string ctheader;
-
-  for (c = 2; c<=(numofstructures_); c++){
-
-    cur = c;
-
-    while (cur>1) {
-      if ((energy_[cur])<(energy_[cur-1])) {
-      	swap(&(energy_[cur]), &(energy_[cur-1]));
-	//also swap the ct labels:
-	ctheader = ctlabel_[cur];
-	ctlabel_[cur] =  ctlabel_[cur-1];
-	ctlabel_[cur-1] = ctheader;
-	for (i=1; i<=numofbases_; i++) {
-	  swap(&(basepr_[cur][i]),&(basepr_[cur-1][i]));
-	}
-	cur--;
-      }
-      else {
-	break;
-      }
+struct EnergyOrder {
+  const std::vector<int> &energy_;
+  explicit EnergyOrder(const std::vector<int> &energy) : energy_(energy) {}
+  bool operator()(int a, int b) const {
+    return energy_[a] < energy_[b] || (energy_[a] == energy_[b] && a < b);
+  }
+};
+
+/** Below this many structures sorted_order does not use the pool. */
+static const int s_parallel_sort_min = 4096;
+
+/**
+ * Computes the order of the structures by their efn energies without moving
+ * any of them (see apply_order). Lower energies come first; structures with
+ * equal energies keep their relative order. For large ensembles the pool sorts
+ * one slice of the index per worker and the slices are then merged pairwise.
+ * @param pool Optional thread pool
+ * @return order[k] is the current (1-based) number of the structure that sorts to position k+1
+ */
+std::vector<int> RNAStructure::sorted_order(ThreadPool *pool) const {
+  int y = numofstructures_;
+  std::vector<int> order(y);
+  for (int k=0; k<y; k++)
+    order[k] = k+1;
+  EnergyOrder less(energy_);
+  if (pool == NULL || pool->size() < 2 || y < s_parallel_sort_min) {
+    std::sort(order.begin(), order.end(), less);
+    return order;
+  }
+  int slices = pool->size();
+  std::vector<int> bound(slices+1);
+  for (int s=0; s<=slices; s++)
+    bound[s] = static_cast<int>(static_cast<long>(y) * s / slices);
+  pool->run(slices, [&](int s, int) {
+    std::sort(order.begin()+bound[s], order.begin()+bound[s+1], less);
+  });
+  for (int width=1; width<slices; width*=2) {
+    int merges = (slices + 2*width - 1) / (2*width);
+    pool->run(merges, [&](int m, int) {
+      int lo = 2*m*width;
+      int mid = std::min(lo+width, slices);
+      int hi = std::min(lo+2*width, slices);
+      if (mid < hi)
+        std::inplace_merge(order.begin()+bound[lo], order.begin()+bound[mid],
+                           order.begin()+bound[hi], less);
+    });
+  }
+  return order;
+}
+
+/**
+ * Rearranges the structures into the given order in one pass. Only the row
+ * pointers of basepr_ are permuted; the pair tables stay where they are in pairs_.
+ * @param order A permutation of 1..get_number_of_structures() (as from sorted_order)
+ */
+void RNAStructure::apply_order(const std::vector<int> &order) {
+  int y = numofstructures_;
+  if (static_cast<int>(order.size()) != y) {
+    std::cerr << "[ERROR] apply_order: got " << order.size() << " indices for "
+	      << y << " structures" << std::endl;
+    throw std::invalid_argument("order is not a permutation of the structures");
+  }
+  std::vector<char> seen(y+1, 0);
+  for (int k=0; k<y; k++) {
+    if (order[k] < 1 || order[k] > y || seen[order[k]]) {
+      std::cerr << "[ERROR] apply_order: bad or repeated index " << order[k] << std::endl;
+      throw std::invalid_argument("order is not a permutation of the structures");
     }
+    seen[order[k]] = 1;
+  }
+  std::vector<int*> rows(y);
+  std::vector<int> energy(y);
+  std::vector<std::string> label(y);
+  for (int k=0; k<y; k++) {
+    rows[k] = basepr_[order[k]];
+    energy[k] = energy_[order[k]];
+    label[k].swap(ctlabel_[order[k]]);
+  }
+  for (int k=0; k<y; k++) {
+    basepr_[k+1] = rows[k];
+    energy_[k+1] = energy[k];
+    ctlabel_[k+1].swap(label[k]);
   }
 }
 
+/**
+ * Reorder the structures in a CT file by their efn energies.
+ * @param pool Optional thread pool for large ensembles (see sorted_order)
+ */
+void RNAStructure::sortstructures (ThreadPool *pool) {
+  apply_order(sorted_order(pool));
+}
+
+/**
+ * Keeps only the k structures with the lowest efn energies, in sorted order.
+ * Only these k are sorted (a partial sort of the index), so this is cheaper than
+ * sortstructures followed by truncation when k is much smaller than the ensemble.
+ * @param k The number of structures to keep; all are kept (and sorted) if there are fewer
+ */
+void RNAStructure::keep_lowest(int k) {
+  if (k < 0) {
+    std::cerr << "[ERROR] keep_lowest: k=" << k << std::endl;
+    throw std::invalid_argument("keep_lowest: negative number of structures");
+  }
+  int y = numofstructures_;
+  if (k > y)
+    k = y;
+  std::vector<int> order(y);
+  for (int c=0; c<y; c++)
+    order[c] = c+1;
+  std::partial_sort(order.begin(), order.begin()+k, order.end(), EnergyOrder(energy_));
+  apply_order(order);
+  for (int c=k+1; c<=y; c++)
+    std::string().swap(ctlabel_[c]);
+  numofstructures_ = k;
+}
+
 
 
 
@@ -361,35 +795,8 @@ void RNAStructure::sortstructures () {
  * outputs a ct file
  */
 void RNAStructure::ctout (const char *ctoutfile) {
-  int count, i; //length
-  char line[2*ctheaderlength], number[2*numlen]; //base[2]
-
-  std::ofstream outfile;
-  outfile.open(ctoutfile);
-  for (count=1; count<=(numofstructures_); count++) {
-    outfile << numofbases_ << "\t";
-    if (energy_[count]!=0) {
-      outfile << "dG = ";
-      sprintf(number, "%0.2f", (double) energy_[count] / 100.0);
-      outfile <<  number << " ";
-    } else {
-      outfile << " ";
-    }
-    //strcat(line, ct->ctlabel[count]);
-    //fputs (line, ctfile);
-    outfile << ctlabel_[count] <<  std::endl;
-    for (i=1; i<numofbases_; i++) {
-      sprintf(line, "%i\t%c\t%i\t%i\t%i\t%i\n",
-	      i,nucs_[i],(i-1),(i+1),basepr_[count][i], hnumber_[i]);
-      outfile << line;
-    }
-    i = numofbases_;
-    sprintf(line, "%i\t%c\t%i\t%i\t%i\t%i\n",
-	    i, nucs_[i], (i-1), 0, basepr_[count][i], hnumber_[i]);
-    outfile << line;
-  }
-  outfile.close();
-  return;
+  StructureWriter writer(ctoutfile, StructureWriter::CT);
+  writer.write_all(this);
 }
 
 
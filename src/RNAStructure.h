@@ -4,6 +4,8 @@
 
 
 #include <string>
+#include <vector>
+#include "MappedFile.h"
 
 
 #if !defined(DEFINES_H)
@@ -34,18 +36,19 @@
  * @author Peter Robinson
  * @version 0.0.4 Jan 1, 2016
  */
+class CTReader;
+class ThreadPool;
+
 class RNAStructure {
   /** (Maximum) length of the header line of a CT file. */
   static const int s_ctheaderlength = 125;
-  /** maximum number of structures in ct file */
-  static const int s_maxstructures = 1010;
-  /** maximum number of bases in a structure */
-  static const int s_maxbases = 10000;
   /** number of bases in sequence */
   int numofbases_;
   /** number of alternative structures of the sequence
       that is held by structure */
   int numofstructures_;
+  /** length of a row of pairs_, i.e., one more than the number of bases the arrays were allocated for */
+  int stride_;
   int pair[maxforce][2];
   int npair_;
   /**
@@ -56,11 +59,13 @@ class RNAStructure {
     G = 3
     U = 4
   */
-  int *numseq_;
+  std::vector<int> numseq_;
   /** array stores the historical numbering of a sequence */
-  int *hnumber_;
-  /** basepr_[i][j] = base to which the jth base is paired in the ith structure */
-  int **basepr_;
+  std::vector<int> hnumber_;
+  /** The pair tables of all structures, one row of stride_ entries per structure (row 0 is unused). */
+  std::vector<int> pairs_;
+  /** basepr_[i][j] = base to which the jth base is paired in the ith structure (pointers to the rows of pairs_) */
+  std::vector<int*> basepr_;
   int ndbl_;
   int dbl_[maxforce];
   /** The energy (the indices refer to the individual structures held in this object). 
@@ -68,7 +73,7 @@ class RNAStructure {
    * is done so that integer math can be performed
    *  and the nearest tenth of a kcal/mol can be
    * followed*/
-  int energy_[s_maxstructures+1];
+  std::vector<int> energy_;
   /* the index of the jth base with intermolecular interactions. */
   int inter_[3];
   int nnopair_;
@@ -76,13 +81,11 @@ class RNAStructure {
   int ngu_;
   int gu_[maxgu];
   /** Labels for the structures in this CT file.  a string of information for each of the structures*/
-  std::string ctlabel_[s_maxstructures+1]; //[s_ctheaderlength];
+  std::vector<std::string> ctlabel_;
   /** Nucleotides is a character array to store the sequence information -- 
    * this will allow the program to keep T and U from getting confused*/
-  char *nucs_;
+  std::vector<char> nucs_;
   bool intermolecular_;
-  /** Has the class function allocate() beein called yet? */
-  bool allocated_;
   bool templated_;
   bool **tem_;
   //int **fce;//[maxbases+1][2*maxbases]
@@ -90,25 +93,95 @@ class RNAStructure {
 
  public:
   int createFromCTFile(const char * path);
+  RNAStructure();
   RNAStructure(const std::string &path);
+  RNAStructure(const std::string &sequence, const std::string &dotbracket);
+  void assign(const std::string &sequence, const std::string &dotbracket);
+  void assign_sequence(const std::string &sequence);
+  int add_structure(const int *pairs, int energy = 0, const std::string &label = "");
   ~RNAStructure();
   int get_number_of_bases() const;
   int get_number_of_structures() const;
   std::string get_ith_label(int i) const;
   std::string get_dot_parens_structure(int i) const;
   bool intermolecular() const;
-  int ** basepr() { return basepr_; }
-  inline int numseq(int i) { return numseq_[i]; }
-  inline int inter(int i) { return inter_[i]; }
-  inline char nucleotide_at(int i) { return nucs_[i]; }
+  int ** basepr() { return basepr_.data(); }
+  const int * const * basepr() const { return basepr_.data(); }
+  inline int numseq(int i) const { return numseq_[i]; }
+  inline int inter(int i) const { return inter_[i]; }
+  inline char nucleotide_at(int i) const { return nucs_[i]; }
+  /** @return The historical numbering of base i (the last column of a CT file). */
+  inline int historical_number(int i) const { return hnumber_[i]; }
   void set_energy( int* en, int n );
-  void sortstructures();
+  /** @return 100 x the free energy of the ith structure (as set by set_energy). */
+  inline int get_energy(int i) const { return energy_[i]; }
+  void sortstructures(ThreadPool *pool = NULL);
+  std::vector<int> sorted_order(ThreadPool *pool = NULL) const;
+  void apply_order(const std::vector<int> &order);
+  void keep_lowest(int k);
   void ctout (const char *ctoutfile);
+  size_t get_storage_size() const;
  private:
-  void allocate(int size = s_maxbases);
+  /* The row pointers in basepr_ point into pairs_ of the same object. */
+  RNAStructure(const RNAStructure &);
+  RNAStructure& operator=(const RNAStructure &);
+  int read_ct_records(CTReader *reader, int max);
+  void allocate(int size, int nstructures);
+  void reserve_structures(int nstructures);
   void allocatetem();
-  void tonum(char *base, int count);
-  
+  void tonum(char base, int count);
+  friend class CTReader;
+};
+
+
+/**
+ * \class CTReader
+ *
+ * \ingroup Folding
+ *
+ * \brief Reads a CT file one record (or a bounded batch of records) at a time.
+ *
+ * RNAStructure(path) loads all structures of a CT file at once. A CTReader instead
+ * fills an RNAStructure with the next few records on each call to next, so that
+ * suboptimal sets of any size can be scored (e.g., with EnergyEvaluator::efn2 or
+ * efn2_batch) in constant memory:
+ * \code
+ * CTReader reader(path);
+ * RNAStructure batch;
+ * while (reader.next(&batch, 64) > 0)
+ *   efn2_batch(dat, &batch, pool);
+ * \endcode
+ * The parsing is the same as for RNAStructure(path); a malformed or truncated record
+ * makes next throw std::runtime_error.
+ */
+class CTReader {
+  /** Path to the CT file (for messages). */
+  std::string path_;
+  /** The mapped file. */
+  MappedFile file_;
+  /** Start of the next record. */
+  const char *pos_;
+  /** End of the data (of the file, or of lastline_ once the last line is reached). */
+  const char *end_;
+  /** Start of the last line if it has no newline (else end_). */
+  const char *tail_;
+  /** Copy of a last line without newline, with the newline appended. */
+  std::string lastline_;
+  /** Number of lines read so far. */
+  int lineno_;
+  /** Number of bases of the records (-1 before the first record). */
+  int numofbases_;
+  /** Number of structures read so far. */
+  long nread_;
+ public:
+  explicit CTReader(const std::string &path);
+  bool is_open() const { return file_.is_open(); }
+  int next(RNAStructure *ct, int max_structures = 1);
+  long get_number_read() const { return nread_; }
+ private:
+  CTReader(const CTReader &);
+  CTReader& operator=(const CTReader &);
+  friend class RNAStructure;
 };
 
 
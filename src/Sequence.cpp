@@ -3,13 +3,23 @@
 #include "Sequence.h"
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <sstream>
+#include <stdexcept>
 
 
-void Record::appendSequenceLine(std::string line){
+void Record::appendSequenceLine(const std::string &line){
   this->sequence_ += line;
 }
 
+/**
+ * Take over seq as the sequence, without copying it.
+ * @param seq The new sequence; receives the old one
+ */
+void Record::swap_sequence(std::string &seq){
+  this->sequence_.swap(seq);
+}
+
 unsigned int Record::get_size() {
   return this->sequence_.length();
 }
@@ -137,10 +147,10 @@ Record::Record(std::string h) : header_(h), sequence_() {
   }
 }
 
-  /**
-   * Parse a FASTA file and create one or more Record objects.
-   */
-bool parseFASTA(std::string path, std::vector<Record> & records){
+/**
+ * Parse a FASTA file from a stream (for files that cannot be mapped, such as pipes).
+ */
+static bool parse_fasta_stream(const std::string &path, std::vector<Record> & records){
   std::ifstream fin(path.c_str());
   if(!fin) {
     std::cerr << "Couldn't open the input FASTA file: \""
@@ -169,6 +179,145 @@ bool parseFASTA(std::string path, std::vector<Record> & records){
   return true;
 }
 
+  /**
+   * Parse a FASTA file and create one or more Record objects.
+   * The file is indexed by a FastaIndex, so that each sequence is copied
+   * once into a string of the right size.
+   */
+bool parseFASTA(std::string path, std::vector<Record> & records){
+  FastaIndex index(path);
+  if (!index.is_open())
+    return parse_fasta_stream(path, records);
+  records.reserve(records.size() + index.get_number_of_records());
+  for (size_t k=0; k<index.get_number_of_records(); k++) {
+    FastaView view = index.record(k);
+    records.push_back(Record(view.get_header()));
+    std::string seq = view.get_sequence();
+    records.back().swap_sequence(seq);
+  }
+  return true;
+}
+
+/**
+ * @return The header line of the record, without the '>'.
+ */
+std::string FastaView::get_header() const {
+  return std::string(header, header_length);
+}
+
+/**
+ * @return True if the residues are on a single line, i.e. data[0..length) is the
+ * sequence itself and can be used without a copy.
+ */
+bool FastaView::contiguous() const {
+  const char *nl = static_cast<const char*>(memchr(data, '\n', data_length));
+  if (nl == NULL)
+    return true;
+  size_t first = nl - data;
+  if (first > 0 && data[first-1] == '\r')
+    first--;
+  return first == length;
+}
+
+/**
+ * @return The residues of the record, with the line ends removed.
+ */
+std::string FastaView::get_sequence() const {
+  if (contiguous())
+    return std::string(data, length);
+  std::string seq;
+  seq.reserve(length);
+  const char *p = data;
+  const char *end = data + data_length;
+  while (p < end) {
+    const char *nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    const char *eol = (nl != NULL) ? nl : end;
+    size_t len = eol - p;
+    if (len > 0 && p[len-1] == '\r')
+      len--;
+    seq.append(p, len);
+    p = eol + 1;
+  }
+  return seq;
+}
+
+/**
+ * @return The residues in upper case, with T replaced by U.
+ */
+std::string FastaView::get_rna() const {
+  std::string rna = get_sequence();
+  for (size_t i=0; i<rna.size(); ++i) {
+    char c = rna[i];
+    if (c >= 'a' && c <= 'z')
+      c = static_cast<char>(c - 'a' + 'A');
+    rna[i] = (c == 'T') ? 'U' : c;
+  }
+  return rna;
+}
+
+/**
+ * Map the FASTA file at path and index its records. If the file cannot be
+ * mapped, is_open() is false and there are no records.
+ * @param path Path to a FASTA file with one or more records.
+ */
+FastaIndex::FastaIndex(const std::string &path) : file_(path.c_str()) {
+  if (!file_.is_open() || file_.size() == 0)
+    return;
+  const char *base = file_.data();
+  const char *end = file_.end();
+  const char *p = base;
+  size_t residues = 0;
+  while (p < end) {
+    const char *nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    const char *eol = (nl != NULL) ? nl : end;
+    const char *next = (nl != NULL) ? nl + 1 : end;
+    if (*p == '>') {
+      if (!header_.empty()) {
+	end_.push_back(p - base);
+	length_.push_back(residues);
+      }
+      header_.push_back(p - base);
+      data_.push_back(next - base);
+      residues = 0;
+    } else if (!header_.empty()) {
+      size_t len = eol - p;
+      if (len > 0 && p[len-1] == '\r')
+	len--;
+      residues += len;
+    }
+    p = next;
+  }
+  if (!header_.empty()) {
+    end_.push_back(file_.size());
+    length_.push_back(residues);
+  }
+}
+
+/**
+ * @param k The (zero-based) number of the record
+ * @return A view of record k, valid as long as this index
+ */
+FastaView FastaIndex::record(size_t k) const {
+  if (k >= header_.size()) {
+    std::cerr << "[ERROR] FastaIndex: record " << k << " requested, but there are "
+	      << header_.size() << std::endl;
+    throw std::out_of_range("FASTA record out of range");
+  }
+  const char *base = file_.data();
+  FastaView view;
+  view.header = base + header_[k] + 1;
+  const char *h_end = base + data_[k];
+  if (h_end > view.header && h_end[-1] == '\n')
+    h_end--;
+  if (h_end > view.header && h_end[-1] == '\r')
+    h_end--;
+  view.header_length = h_end - view.header;
+  view.data = base + data_[k];
+  view.data_length = end_[k] - data_[k];
+  view.length = length_[k];
+  return view;
+}
+
 /**
  * This function removes leading space and digits as well
  * as any space, and returns the resulting string.
@@ -16,6 +16,7 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include "MappedFile.h"
 
 
 /**
@@ -61,7 +62,8 @@ class Record {
   unsigned int CDS_endpos_;
  public:
   Record(std::string h);
-  void appendSequenceLine(std::string line);
+  void appendSequenceLine(const std::string &line);
+  void swap_sequence(std::string &seq);
   unsigned int get_size();
   std::string substr(unsigned int start_pos, unsigned int length);
   std::string get_rna() const;
@@ -82,6 +84,69 @@ class Record {
   void appendSequenceFromGeneBankLines(std::vector<std::string> seqlines);
 };
 
+/**
+ * \struct FastaView
+ *
+ * \brief One record of a memory-mapped FASTA file, pointing into the mapping.
+ *
+ * The header (without the '>' and the line end) and the sequence lines are not
+ * copied. The sequence part may contain line ends; get_sequence and get_rna copy
+ * the residues into a string of exactly the right size only when asked. A view is
+ * valid as long as the FastaIndex it came from.
+ */
+struct FastaView {
+  /** The header line after the '>' (not terminated). */
+  const char *header;
+  /** The length of the header, without the line end. */
+  size_t header_length;
+  /** The sequence lines, from the line after the header to the next record. */
+  const char *data;
+  /** The length of the sequence lines, including their line ends. */
+  size_t data_length;
+  /** The number of residues (data_length minus the line end characters). */
+  size_t length;
+
+  bool contiguous() const;
+  std::string get_header() const;
+  std::string get_sequence() const;
+  std::string get_rna() const;
+};
+
+/**
+ * \class FastaIndex
+ *
+ * \brief Maps a FASTA file and indexes the position of every record in one scan.
+ *
+ * The scan only looks for line ends (with memchr, which the C library vectorizes)
+ * and for the '>' at the start of a line; it records where each header and
+ * sequence start and how many residues each record has. Records are then handed
+ * out as FastaView objects in constant time; nothing is copied until a caller
+ * asks for a sequence. Text before the first header is ignored and '\r' before a
+ * line end (Windows files) is not counted as a residue.
+ */
+class FastaIndex {
+  /** The mapped file. */
+  MappedFile file_;
+  /** The offset of the '>' of each record. */
+  std::vector<size_t> header_;
+  /** The offset of the sequence lines of each record. */
+  std::vector<size_t> data_;
+  /** The offset where each record ends (the next '>' or the end of the file). */
+  std::vector<size_t> end_;
+  /** The number of residues of each record. */
+  std::vector<size_t> length_;
+ public:
+  explicit FastaIndex(const std::string &path);
+  /** @return True if the file could be mapped. */
+  bool is_open() const { return file_.is_open(); }
+  /** @return The number of records. */
+  size_t get_number_of_records() const { return header_.size(); }
+  FastaView record(size_t k) const;
+ private:
+  FastaIndex(const FastaIndex &);
+  FastaIndex& operator=(const FastaIndex &);
+};
+
 bool parseFASTA(std::string path, std::vector<Record> & records);
 bool parseGenBank(std::string path, std::vector<Record> & records);
  
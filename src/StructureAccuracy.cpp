@@ -0,0 +1,205 @@
+#include "StructureAccuracy.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <map>
+#include <iomanip>
+#include <math.h>
+
+#include "ThreadPool.h"
+#include "RNAStructure.h"  /* after the standard headers: it defines the macro infinity */
+
+
+AccuracyCounts::AccuracyCounts() :
+  reference_pairs(0), predicted_pairs(0), found(0), confirmed(0), possible_pairs(0) {}
+
+/** @return Found reference pairs over all reference pairs (0 if there are none). */
+double AccuracyCounts::sensitivity() const {
+  return reference_pairs > 0 ? static_cast<double>(found) / reference_pairs : 0.0;
+}
+
+/** @return Confirmed predicted pairs over all predicted pairs (0 if there are none). */
+double AccuracyCounts::ppv() const {
+  return predicted_pairs > 0 ? static_cast<double>(confirmed) / predicted_pairs : 0.0;
+}
+
+/** @return The harmonic mean of sensitivity and PPV (0 if both are 0). */
+double AccuracyCounts::f1() const {
+  double s = sensitivity();
+  double p = ppv();
+  return s + p > 0.0 ? 2.0 * s * p / (s + p) : 0.0;
+}
+
+/**
+ * The Matthews correlation coefficient. False negatives are the reference pairs
+ * not found, false positives the predicted pairs not confirmed, and true positives
+ * the mean of found and confirmed (these only differ with slippage).
+ * @return The MCC (0 if it is undefined)
+ */
+double AccuracyCounts::mcc() const {
+  double tp = 0.5 * (found + confirmed);
+  double fp = predicted_pairs - confirmed;
+  double fn = reference_pairs - found;
+  double tn = possible_pairs - tp - fp - fn;
+  double denominator = (tp + fp) * (tp + fn) * (tn + fp) * (tn + fn);
+  return denominator > 0.0 ? (tp * tn - fp * fn) / sqrt(denominator) : 0.0;
+}
+
+/** Add the counts of another comparison (pooled scores over several structures). */
+void AccuracyCounts::add(const AccuracyCounts &other) {
+  reference_pairs += other.reference_pairs;
+  predicted_pairs += other.predicted_pairs;
+  found += other.found;
+  confirmed += other.confirmed;
+  possible_pairs += other.possible_pairs;
+}
+
+/**
+ * @return True if the pair i.j of one structure matches a pair of the other
+ * structure, given by its pair table partner (exactly, or shifted by one base at one end with slippage).
+ */
+static inline bool matches(const int *partner, int i, int j, int n, bool slippage) {
+  if (partner[i] == j)
+    return true;
+  if (!slippage)
+    return false;
+  return (i > 1 && partner[i-1] == j) || (i < n && partner[i+1] == j)
+    || (partner[j-1] == i) || (j < n && partner[j+1] == i);
+}
+
+/**
+ * Compare two pair tables of the same sequence in one pass.
+ * @param predicted Partner of each base (one-based, 0 if unpaired) in the prediction
+ * @param reference Partner of each base in the reference structure
+ * @param n The number of bases
+ * @param slippage If true, pairs shifted by one base at one end also match
+ * @return The pair counts
+ */
+AccuracyCounts compare_structures(const int *predicted, const int *reference, int n, bool slippage) {
+  AccuracyCounts c;
+  c.possible_pairs = static_cast<long>(n) * (n - 1) / 2;
+  for (int i=1; i<=n; i++) {
+    int p = predicted[i];
+    int r = reference[i];
+    if (p > i) {
+      c.predicted_pairs++;
+      if (matches(reference, i, p, n, slippage))
+	c.confirmed++;
+    }
+    if (r > i) {
+      c.reference_pairs++;
+      if (matches(predicted, i, r, n, slippage))
+	c.found++;
+    }
+  }
+  return c;
+}
+
+/**
+ * Compare structure p of predicted with structure r of reference.
+ * @return The pair counts
+ */
+AccuracyCounts compare_structures(const RNAStructure *predicted, int p,
+				  const RNAStructure *reference, int r, bool slippage) {
+  int n = reference->get_number_of_bases();
+  if (predicted->get_number_of_bases() != n) {
+    std::cerr << "[ERROR] compare_structures: prediction of " << predicted->get_number_of_bases()
+	      << " bases against a reference of " << n << std::endl;
+    throw std::invalid_argument("predicted and reference structures differ in length");
+  }
+  if (p < 1 || p > predicted->get_number_of_structures()
+      || r < 1 || r > reference->get_number_of_structures()) {
+    std::cerr << "[ERROR] compare_structures: structures " << p << " and " << r
+	      << " requested" << std::endl;
+    throw std::out_of_range("structure number out of range");
+  }
+  return compare_structures(predicted->basepr()[p], reference->basepr()[r], n, slippage);
+}
+
+/**
+ * Compare the first structure of each prediction with the first structure of its
+ * reference, distributing the comparisons over the pool.
+ * @param predicted One prediction per sequence
+ * @param reference The reference structures, in the same order
+ * @param pool The comparisons are divided among the workers of this pool
+ * @param results Receives the counts of each comparison
+ * @param slippage If true, pairs shifted by one base at one end also match
+ */
+void compare_batch(const std::vector<const RNAStructure*> &predicted,
+		   const std::vector<const RNAStructure*> &reference,
+		   ThreadPool &pool, std::vector<AccuracyCounts> *results, bool slippage) {
+  if (predicted.size() != reference.size()) {
+    std::cerr << "[ERROR] compare_batch: " << predicted.size() << " predictions for "
+	      << reference.size() << " references" << std::endl;
+    throw std::invalid_argument("numbers of predictions and references differ");
+  }
+  int count = static_cast<int>(predicted.size());
+  for (int k=0; k<count; k++) {
+    int n = reference[k]->get_number_of_bases();
+    if (predicted[k]->get_number_of_bases() != n
+	|| predicted[k]->get_number_of_structures() < 1 || reference[k]->get_number_of_structures() < 1) {
+      std::cerr << "[ERROR] compare_batch: comparison " << k+1 << " has a prediction of "
+		<< predicted[k]->get_number_of_bases() << " bases against a reference of "
+		<< n << " (or no structure)" << std::endl;
+      throw std::invalid_argument("predicted and reference structures do not match");
+    }
+  }
+  results->assign(count, AccuracyCounts());
+  pool.run(count, [&](int k, int) {
+    (*results)[k] = compare_structures(predicted[k]->basepr()[1], reference[k]->basepr()[1],
+				       reference[k]->get_number_of_bases(), slippage);
+  });
+}
+
+/**
+ * Write one line per family (in alphabetical order) and a final line "all" with
+ * the number of sequences and the mean sensitivity, PPV, F1 and MCC of their
+ * comparisons, tab separated after a header line.
+ * @param out The table is written here
+ * @param family The family of each comparison
+ * @param results The counts of each comparison (see compare_batch)
+ */
+void write_accuracy_summary(std::ostream &out, const std::vector<std::string> &family,
+			    const std::vector<AccuracyCounts> &results) {
+  if (family.size() != results.size()) {
+    std::cerr << "[ERROR] write_accuracy_summary: " << family.size() << " families for "
+	      << results.size() << " results" << std::endl;
+    throw std::invalid_argument("numbers of families and results differ");
+  }
+  struct Sums {
+    long count;
+    double score[4];
+  };
+  std::map<std::string, Sums> sums;
+  const Sums zero = { 0, { 0.0, 0.0, 0.0, 0.0 } };
+  Sums all = zero;
+  for (size_t k=0; k<results.size(); k++) {
+    const AccuracyCounts &c = results[k];
+    double score[4] = { c.sensitivity(), c.ppv(), c.f1(), c.mcc() };
+    std::map<std::string, Sums>::iterator it = sums.find(family[k]);
+    if (it == sums.end())
+      it = sums.insert(std::make_pair(family[k], zero)).first;
+    it->second.count++;
+    all.count++;
+    for (int m=0; m<4; m++) {
+      it->second.score[m] += score[m];
+      all.score[m] += score[m];
+    }
+  }
+  out << "family\tsequences\tsensitivity\tppv\tf1\tmcc\n";
+  out << std::fixed << std::setprecision(4);
+  for (std::map<std::string, Sums>::const_iterator it=sums.begin(); it!=sums.end(); ++it) {
+    out << it->first << "\t" << it->second.count;
+    for (int m=0; m<4; m++)
+      out << "\t" << it->second.score[m] / it->second.count;
+    out << "\n";
+  }
+  if (all.count > 0) {
+    out << "all\t" << all.count;
+    for (int m=0; m<4; m++)
+      out << "\t" << all.score[m] / all.count;
+    out << "\n";
+  }
+}
+
+/* eof */
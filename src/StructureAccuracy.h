@@ -0,0 +1,65 @@
+#ifndef STRUCTURE_ACCURACY_H
+#define STRUCTURE_ACCURACY_H
+
+/**
+ * \struct AccuracyCounts
+ *
+ * \ingroup Folding
+ *
+ * \brief Pair counts of a predicted structure against a reference, with the usual accuracy scores.
+ *
+ * Sensitivity is the fraction of the reference pairs that were predicted, the
+ * positive predictive value (PPV) the fraction of the predicted pairs that are in
+ * the reference. F1 is their harmonic mean. The Matthews correlation coefficient
+ * (MCC) counts as true negatives all other pairs i<j of the sequence.
+ *
+ * With slippage a pair i.j also matches i-1.j, i+1.j, i.j-1 and i.j+1 in the other
+ * structure. The number of reference pairs found and the number of predicted
+ * pairs confirmed can then differ, so both are kept.
+ *
+ * compare_structures compares two pair tables in one linear pass.
+ * compare_batch runs many comparisons on a ThreadPool, and write_accuracy_summary
+ * writes the mean scores of each family as a table.
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+class RNAStructure;
+class ThreadPool;
+
+struct AccuracyCounts {
+  /** The number of pairs of the reference structure. */
+  long reference_pairs;
+  /** The number of pairs of the predicted structure. */
+  long predicted_pairs;
+  /** Reference pairs that were predicted (true positives for the sensitivity). */
+  long found;
+  /** Predicted pairs that are in the reference (true positives for the PPV). */
+  long confirmed;
+  /** All pairs i<j of the sequence, n(n-1)/2. */
+  long possible_pairs;
+
+  AccuracyCounts();
+  double sensitivity() const;
+  double ppv() const;
+  double f1() const;
+  double mcc() const;
+  void add(const AccuracyCounts &other);
+};
+
+AccuracyCounts compare_structures(const int *predicted, const int *reference, int n,
+				  bool slippage = false);
+AccuracyCounts compare_structures(const RNAStructure *predicted, int p,
+				  const RNAStructure *reference, int r, bool slippage = false);
+void compare_batch(const std::vector<const RNAStructure*> &predicted,
+		   const std::vector<const RNAStructure*> &reference,
+		   ThreadPool &pool, std::vector<AccuracyCounts> *results,
+		   bool slippage = false);
+void write_accuracy_summary(std::ostream &out, const std::vector<std::string> &family,
+			    const std::vector<AccuracyCounts> &results);
+
+#endif
+
+/* eof */
@@ -0,0 +1,287 @@
+#include "StructureDistance.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "ThreadPool.h"
+#include "RNAStructure.h"  /* after the standard headers: it defines the macro infinity */
+
+
+/** @return The number of bits set in a xor b over n words. */
+static int xor_popcount_generic(const uint64_t *a, const uint64_t *b, int n) {
+  int count = 0;
+  for (int w=0; w<n; w++)
+    count += __builtin_popcountll(a[w] ^ b[w]);
+  return count;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/** The same with the POPCNT instruction, which the default -march does not assume. */
+__attribute__((target("popcnt")))
+static int xor_popcount_hw(const uint64_t *a, const uint64_t *b, int n) {
+  int count = 0;
+  for (int w=0; w<n; w++)
+    count += __builtin_popcountll(a[w] ^ b[w]);
+  return count;
+}
+
+static int (*select_xor_popcount())(const uint64_t *, const uint64_t *, int) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("popcnt") ? xor_popcount_hw : xor_popcount_generic;
+}
+#else
+static int (*select_xor_popcount())(const uint64_t *, const uint64_t *, int) {
+  return xor_popcount_generic;
+}
+#endif
+
+/** Chosen once for the CPU we run on. */
+static int (*const s_xor_popcount)(const uint64_t *, const uint64_t *, int) = select_xor_popcount();
+
+/** Number of structures handled by one task of the thread pool. */
+static const int s_block = 64;
+/** At most this many structures are tried as initial medoids (see StructureDistance::cluster). */
+static const int s_candidates = 256;
+
+
+/**
+ * Encode all structures of ct as bitsets over the pairs that occur in any of them.
+ * @param ct The structures (typically suboptimal or sampled structures of one sequence)
+ */
+StructureDistance::StructureDistance(const RNAStructure *ct) {
+  int n = ct->get_number_of_bases();
+  nstructures_ = ct->get_number_of_structures();
+  const int * const *basepr = ct->basepr();
+  /* number the pairs by i and then j; seen marks the partners j of the current i */
+  std::vector<char> seen(n+1, 0);
+  std::vector<int> partners;
+  for (int i=1; i<=n; i++) {
+    partners.clear();
+    for (int s=1; s<=nstructures_; s++) {
+      int j = basepr[s][i];
+      if (j > i && !seen[j]) {
+	seen[j] = 1;
+	partners.push_back(j);
+      }
+    }
+    std::sort(partners.begin(), partners.end());
+    for (size_t p=0; p<partners.size(); p++) {
+      pair_i_.push_back(i);
+      pair_j_.push_back(partners[p]);
+      seen[partners[p]] = 0;
+    }
+  }
+  words_ = static_cast<int>((pair_i_.size() + 63) / 64);
+  bits_.assign(static_cast<size_t>(nstructures_)*words_, 0);
+  /* the first candidate pair of each i, to find the number of i.j */
+  std::vector<int> first(n+2, 0);
+  for (size_t p=0; p<pair_i_.size(); p++)
+    first[pair_i_[p]+1]++;
+  for (int i=1; i<=n+1; i++)
+    first[i] += first[i-1];
+  for (int s=1; s<=nstructures_; s++) {
+    uint64_t *bits = &bits_[static_cast<size_t>(s-1)*words_];
+    for (int i=1; i<=n; i++) {
+      int j = basepr[s][i];
+      if (j <= i)
+	continue;
+      int p = first[i];
+      while (pair_j_[p] != j)
+	p++;
+      bits[p >> 6] |= static_cast<uint64_t>(1) << (p & 63);
+    }
+  }
+}
+
+/**
+ * @param a One-based number of a structure
+ * @return The number of pairs of structure a.
+ */
+int StructureDistance::get_number_of_pairs(int a) const {
+  int count = 0;
+  for (int w=0; w<words_; w++)
+    count += __builtin_popcountll(row(a)[w]);
+  return count;
+}
+
+/**
+ * @param a One-based number of a structure
+ * @param b One-based number of a structure
+ * @return The number of pairs in exactly one of the structures a and b.
+ */
+int StructureDistance::distance(int a, int b) const {
+  if (a < 1 || a > nstructures_ || b < 1 || b > nstructures_) {
+    std::cerr << "[ERROR] StructureDistance: structures " << a << " and " << b
+	      << " requested, but there are " << nstructures_ << std::endl;
+    throw std::out_of_range("structure number out of range");
+  }
+  return s_xor_popcount(row(a), row(b), words_);
+}
+
+/**
+ * Compute the distances of all pairs of structures. The matrix is stored condensed:
+ * the distance of a<b is at condensed_index(a,b,n), i.e. the rows of the upper
+ * triangle one after the other. A distance is at most the number of candidate
+ * pairs, so this throws if there are more than 65535 of them.
+ * @param matrix Receives n(n-1)/2 distances for n structures
+ * @param pool The rows are distributed over the workers of this pool
+ */
+void StructureDistance::distance_matrix(std::vector<uint16_t> *matrix, ThreadPool &pool) const {
+  int y = nstructures_;
+  if (pair_i_.size() > 0xffffu) {
+    std::cerr << "[ERROR] StructureDistance: " << pair_i_.size()
+	      << " candidate pairs, distances may not fit 16 bits" << std::endl;
+    throw std::out_of_range("too many candidate pairs for a 16 bit distance matrix");
+  }
+  matrix->assign(static_cast<size_t>(y)*(y > 0 ? y-1 : 0)/2, 0);
+  uint16_t *out = matrix->data();
+  pool.run(y, [&](int k, int) {
+    int a = k+1;
+    const uint64_t *ra = row(a);
+    uint16_t *d = out + (a < y ? condensed_index(a, a+1, y) : 0);
+    for (int b=a+1; b<=y; b++)
+      *d++ = static_cast<uint16_t>(s_xor_popcount(ra, row(b), words_));
+  });
+}
+
+/**
+ * Partition the structures into k clusters around medoids (k-medoids with
+ * alternating assignment and medoid updates). The initial medoids are chosen
+ * greedily, each one the structure that most reduces the distances of all
+ * structures to their nearest medoid; only an evenly spaced sample of at most
+ * 256 structures is tried, so this stays linear in the ensemble. Then every structure is
+ * assigned to its nearest medoid and each medoid is replaced by the member with
+ * the smallest sum of distances to the rest of its cluster, until nothing changes.
+ * Distances are computed on demand, so memory stays linear in the number of structures.
+ * @param k The number of clusters (1..get_number_of_structures())
+ * @param medoids Receives the one-based number of the representative of each cluster
+ * @param assignment Receives the cluster (0..k-1) of each structure, structure 1 first
+ * @param pool Distances are computed by the workers of this pool
+ * @param max_iterations Upper bound for the number of assignment/update rounds
+ * @return The sum of the distances of all structures to their medoids
+ */
+long StructureDistance::cluster(int k, std::vector<int> *medoids, std::vector<int> *assignment,
+				ThreadPool &pool, int max_iterations) const {
+  int y = nstructures_;
+  if (k < 1 || k > y) {
+    std::cerr << "[ERROR] StructureDistance: cannot make " << k << " clusters of "
+	      << y << " structures" << std::endl;
+    throw std::invalid_argument("number of clusters out of range");
+  }
+  int nblocks = (y + s_block - 1) / s_block;
+  /* greedy start (as in PAM's BUILD) over an evenly spaced sample of candidates */
+  int stride = (y + s_candidates - 1) / s_candidates;
+  std::vector<int> candidates;
+  for (int s=1; s<=y; s+=stride)
+    candidates.push_back(s);
+  std::vector<long> gain(candidates.size());
+  std::vector<int> nearest(y, words_*64 + 1);
+  std::vector<char> chosen(y+1, 0);
+  medoids->clear();
+  assignment->assign(y, 0);
+  while (static_cast<int>(medoids->size()) < k) {
+    pool.run(static_cast<int>(candidates.size()), [&](int q, int) {
+      const uint64_t *rc = row(candidates[q]);
+      long g = 0;
+      for (int s=0; s<y; s++) {
+	int d = s_xor_popcount(row(s+1), rc, words_);
+	if (d < nearest[s])
+	  g += nearest[s] - d;
+      }
+      gain[q] = chosen[candidates[q]] ? -1 : g;
+    });
+    int next = 0;
+    long best = 0;
+    for (size_t q=0; q<candidates.size(); q++) {
+      if (gain[q] > best) {
+	best = gain[q];
+	next = candidates[q];
+      }
+    }
+    if (next == 0) {
+      /* no sampled candidate helps: take the structure farthest from the medoids */
+      for (int s=1; s<=y; s++)
+	if (!chosen[s] && (next == 0 || nearest[s-1] > nearest[next-1]))
+	  next = s;
+    }
+    int c = static_cast<int>(medoids->size());
+    medoids->push_back(next);
+    chosen[next] = 1;
+    const uint64_t *rm = row(next);
+    pool.run(nblocks, [&](int blk, int) {
+      int end = std::min(y, (blk+1)*s_block);
+      for (int s=blk*s_block; s<end; s++) {
+	int d = s_xor_popcount(row(s+1), rm, words_);
+	if (d < nearest[s]) {
+	  nearest[s] = d;
+	  (*assignment)[s] = c;
+	}
+      }
+    });
+  }
+  std::vector<long> cost(y);
+  std::vector<int> members;
+  std::vector<int> start(k+1);
+  for (int iteration=0; iteration<max_iterations; iteration++) {
+    /* group the members of each cluster */
+    std::fill(start.begin(), start.end(), 0);
+    for (int s=0; s<y; s++)
+      start[(*assignment)[s]+1]++;
+    for (int c=0; c<k; c++)
+      start[c+1] += start[c];
+    members.resize(y);
+    std::vector<int> fill(start.begin(), start.end()-1);
+    for (int s=0; s<y; s++)
+      members[fill[(*assignment)[s]]++] = s+1;
+    /* the cost of each structure as the medoid of its own cluster */
+    pool.run(y, [&](int m, int) {
+      int s = members[m];
+      int c = (*assignment)[s-1];
+      const uint64_t *rs = row(s);
+      long sum = 0;
+      for (int q=start[c]; q<start[c+1]; q++)
+	sum += s_xor_popcount(rs, row(members[q]), words_);
+      cost[s-1] = sum;
+    });
+    bool changed = false;
+    for (int c=0; c<k; c++) {
+      int best = (*medoids)[c];
+      for (int q=start[c]; q<start[c+1]; q++) {
+	int s = members[q];
+	if (cost[s-1] < cost[best-1])
+	  best = s;
+      }
+      if (best != (*medoids)[c]) {
+	(*medoids)[c] = best;
+	changed = true;
+      }
+    }
+    if (!changed)
+      break;
+    /* reassign every structure to its nearest medoid (ties to the lower cluster) */
+    pool.run(nblocks, [&](int blk, int) {
+      int end = std::min(y, (blk+1)*s_block);
+      for (int s=blk*s_block; s<end; s++) {
+	const uint64_t *rs = row(s+1);
+	int best = 0;
+	int dbest = s_xor_popcount(rs, row((*medoids)[0]), words_);
+	for (int c=1; c<k && dbest>0; c++) {
+	  int d = s_xor_popcount(rs, row((*medoids)[c]), words_);
+	  if (d < dbest) {
+	    dbest = d;
+	    best = c;
+	  }
+	}
+	(*assignment)[s] = best;
+	nearest[s] = dbest;
+      }
+    });
+  }
+  long total = 0;
+  for (int s=0; s<y; s++)
+    total += nearest[s];
+  return total;
+}
+
+/* eof */
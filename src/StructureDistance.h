@@ -0,0 +1,69 @@
+#ifndef STRUCTURE_DISTANCE_H
+#define STRUCTURE_DISTANCE_H
+
+/**
+ * \class StructureDistance
+ *
+ * \ingroup Folding
+ *
+ * \brief Base-pair distances between the structures of an RNAStructure and medoid clustering.
+ *
+ * The base-pair distance of two structures is the number of pairs that occur in
+ * exactly one of them. All pairs that occur in any structure of the ensemble are
+ * numbered (the candidate pairs) and each structure is stored as a bitset over
+ * them, so the distance of two structures is the popcount of the exclusive or of
+ * their bitsets. For suboptimal or sampled ensembles the candidate pairs are a
+ * small multiple of the sequence length, i.e. a few machine words per structure.
+ *
+ * The distances can be computed all-vs-all (distance_matrix) or on demand, as
+ * the k-medoid clustering (cluster) does to avoid the quadratic matrix.
+ */
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+class RNAStructure;
+class ThreadPool;
+
+class StructureDistance {
+  /** The number of structures. */
+  int nstructures_;
+  /** The number of 64-bit words of the bitset of one structure. */
+  int words_;
+  /** The bitsets, words_ words per structure, structure 1 first. */
+  std::vector<uint64_t> bits_;
+  /** i of each candidate pair (i<j), ordered by i and then j. */
+  std::vector<int> pair_i_;
+  /** j of each candidate pair. */
+  std::vector<int> pair_j_;
+ public:
+  explicit StructureDistance(const RNAStructure *ct);
+  /** @return The number of structures that were encoded. */
+  int get_number_of_structures() const { return nstructures_; }
+  /** @return The number of different pairs in all structures. */
+  int get_number_of_candidate_pairs() const { return static_cast<int>(pair_i_.size()); }
+  /** @return The number of pairs of structure a (one-based). */
+  int get_number_of_pairs(int a) const;
+  int distance(int a, int b) const;
+  void distance_matrix(std::vector<uint16_t> *matrix, ThreadPool &pool) const;
+  /**
+   * @return The position of the distance of structures a<b (one-based) in the
+   * condensed matrix of n structures (see distance_matrix).
+   */
+  static inline size_t condensed_index(int a, int b, int n) {
+    size_t r = a-1;
+    return r*(2*static_cast<size_t>(n)-r-1)/2 + (b-a-1);
+  }
+  long cluster(int k, std::vector<int> *medoids, std::vector<int> *assignment,
+	       ThreadPool &pool, int max_iterations = 100) const;
+ private:
+  /** @return The bitset of structure a (one-based). */
+  inline const uint64_t *row(int a) const { return bits_.data() + static_cast<size_t>(a-1)*words_; }
+  StructureDistance(const StructureDistance &);
+  StructureDistance& operator=(const StructureDistance &);
+};
+
+#endif
+
+/* eof */
@@ -0,0 +1,176 @@
+#include "StructureWriter.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "ThreadPool.h"
+#include "RNAStructure.h"  /* after the standard headers: it defines the macro infinity */
+
+
+/** Append the decimal representation of value to out. */
+static inline void append_int(std::string *out, int value) {
+  char digits[12];
+  int k = sizeof(digits);
+  unsigned int v = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+  do {
+    digits[--k] = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  if (value < 0)
+    digits[--k] = '-';
+  out->append(digits + k, sizeof(digits) - k);
+}
+
+/** Append 100 x energy as kcal/mol with two decimals (as printf("%0.2f", energy/100.0)). */
+static inline void append_energy(std::string *out, int energy) {
+  unsigned int v = energy < 0 ? 0u - static_cast<unsigned int>(energy) : static_cast<unsigned int>(energy);
+  if (energy < 0)
+    out->push_back('-');
+  append_int(out, static_cast<int>(v / 100));
+  out->push_back('.');
+  out->push_back(static_cast<char>('0' + (v / 10) % 10));
+  out->push_back(static_cast<char>('0' + v % 10));
+}
+
+
+
+/**
+ * Create (or overwrite) the file at path.
+ * @param path The output file.
+ * @param format CT or DOT_BRACKET.
+ * @param block_size The formatted text is written to the file in blocks of about this size.
+ */
+StructureWriter::StructureWriter(const std::string &path, Format format, size_t block_size) :
+  out_(path.c_str(), std::ios::binary | std::ios::trunc), format_(format), block_size_(block_size) {
+  if (!out_.is_open()) {
+    std::cerr << "[ERROR] Could not open \"" << path << "\" for writing" << std::endl;
+    throw std::runtime_error("could not open output file");
+  }
+  buffer_.reserve(block_size_ + block_size_ / 4);
+}
+
+StructureWriter::~StructureWriter() {
+  flush();
+  out_.close();
+}
+
+/** Write the buffered text to the file. */
+void StructureWriter::flush() {
+  if (!buffer_.empty()) {
+    out_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+  out_.flush();
+}
+
+/** Append structure structnum of ct to the output. */
+void StructureWriter::write(const RNAStructure *ct, int structnum) {
+  format(ct, structnum, format_, &buffer_);
+  if (buffer_.size() >= block_size_) {
+    out_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+}
+
+/**
+ * Append all structures of ct to the output, in order. With a pool, chunks of
+ * structures are formatted in parallel, a few chunks per worker at a time, so that
+ * the memory used does not depend on the number of structures.
+ * @param ct The structures.
+ * @param pool Worker threads for the formatting (NULL: format in the calling thread).
+ */
+void StructureWriter::write_all(const RNAStructure *ct, ThreadPool *pool) {
+  int y = ct->get_number_of_structures();
+  if (pool == NULL || pool->size() < 2) {
+    for (int s=1; s<=y; s++)
+      write(ct, s);
+    return;
+  }
+  int nchunks = (y + s_chunk - 1) / s_chunk;
+  int round = 4 * pool->size();
+  chunks_.resize(round);
+  for (int first=0; first<nchunks; first+=round) {
+    int count = std::min(round, nchunks - first);
+    pool->run(count, [&](int c, int) {
+	std::string &text = chunks_[c];
+	text.clear();
+	int from = (first + c) * s_chunk + 1;
+	int to = std::min(from + s_chunk - 1, y);
+	for (int s=from; s<=to; s++)
+	  format(ct, s, format_, &text);
+      });
+    for (int c=0; c<count; c++) {
+      buffer_.append(chunks_[c]);
+      if (buffer_.size() >= block_size_) {
+	out_.write(buffer_.data(), buffer_.size());
+	buffer_.clear();
+      }
+    }
+  }
+}
+
+/** Append structure structnum of ct to out in the given format. */
+void StructureWriter::format(const RNAStructure *ct, int structnum, Format format, std::string *out) {
+  if (format == CT)
+    format_ct(ct, structnum, out);
+  else
+    format_dot_bracket(ct, structnum, out);
+}
+
+/**
+ * Append structure structnum of ct to out as a CT record: the header line (number of
+ * bases, the energy if it is not zero, the label), then one line per base with its
+ * index, nucleotide, neighbours, partner and historical number.
+ */
+void StructureWriter::format_ct(const RNAStructure *ct, int structnum, std::string *out) {
+  int n = ct->get_number_of_bases();
+  const int *bp = ct->basepr()[structnum];
+  out->reserve(out->size() + 24 * (n + 1));
+  append_int(out, n);
+  out->push_back('\t');
+  int energy = ct->get_energy(structnum);
+  if (energy != 0) {
+    out->append("dG = ");
+    append_energy(out, energy);
+  }
+  out->push_back(' ');
+  out->append(ct->get_ith_label(structnum));
+  out->push_back('\n');
+  for (int i=1; i<=n; i++) {
+    append_int(out, i);
+    out->push_back('\t');
+    out->push_back(ct->nucleotide_at(i));
+    out->push_back('\t');
+    append_int(out, i-1);
+    out->push_back('\t');
+    append_int(out, i<n ? i+1 : 0);
+    out->push_back('\t');
+    append_int(out, bp[i]);
+    out->push_back('\t');
+    append_int(out, ct->historical_number(i));
+    out->push_back('\n');
+  }
+}
+
+/**
+ * Append structure structnum of ct to out as ">label", the sequence, and the
+ * dot-bracket string followed by the energy in parentheses.
+ */
+void StructureWriter::format_dot_bracket(const RNAStructure *ct, int structnum, std::string *out) {
+  int n = ct->get_number_of_bases();
+  const int *bp = ct->basepr()[structnum];
+  out->push_back('>');
+  out->append(ct->get_ith_label(structnum));
+  out->push_back('\n');
+  for (int i=1; i<=n; i++)
+    out->push_back(ct->nucleotide_at(i));
+  out->push_back('\n');
+  for (int i=1; i<=n; i++)
+    out->push_back(bp[i]==0 ? '.' : (bp[i]>i ? '(' : ')'));
+  out->append(" (");
+  append_energy(out, ct->get_energy(structnum));
+  out->append(")\n");
+}
+
+/* eof */
@@ -0,0 +1,65 @@
+#ifndef STRUCTURE_WRITER_H
+#define STRUCTURE_WRITER_H
+
+/**
+ * \class StructureWriter
+ *
+ * \ingroup Folding
+ *
+ * \brief Writes structures as CT or dot-bracket text through large buffers.
+ *
+ * The records are formatted with hand-written integer conversion into a buffer
+ * that is written to the file in blocks of (by default) one megabyte, instead of
+ * one formatted write per line. write_all can format the structures on a thread
+ * pool; each worker formats a chunk of structures into its own buffer, and the
+ * chunks are written in the order of the structures.
+ *
+ * The CT output is the same as that of RNAStructure::ctout (which uses this class).
+ * The dot-bracket output has three lines per structure:
+ * \verbatim
+ * >label
+ * GGGAAAUCC
+ * (((...))) (-1.20)
+ * \endverbatim
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+class RNAStructure;
+class ThreadPool;
+
+class StructureWriter {
+ public:
+  /** The output formats. */
+  enum Format { CT, DOT_BRACKET };
+ private:
+  /** Number of structures formatted by one task of write_all. */
+  static const int s_chunk = 16;
+  /** The output file. */
+  std::ofstream out_;
+  /** The format of the records. */
+  Format format_;
+  /** Formatted text not yet written to the file. */
+  std::string buffer_;
+  /** Size at which buffer_ is written to the file. */
+  size_t block_size_;
+  /** Per-chunk buffers of write_all (kept to reuse their capacity). */
+  std::vector<std::string> chunks_;
+ public:
+  StructureWriter(const std::string &path, Format format, size_t block_size = 1 << 20);
+  ~StructureWriter();
+  void write(const RNAStructure *ct, int structnum);
+  void write_all(const RNAStructure *ct, ThreadPool *pool = NULL);
+  void flush();
+  static void format(const RNAStructure *ct, int structnum, Format format, std::string *out);
+  static void format_ct(const RNAStructure *ct, int structnum, std::string *out);
+  static void format_dot_bracket(const RNAStructure *ct, int structnum, std::string *out);
+ private:
+  StructureWriter(const StructureWriter &);
+  StructureWriter& operator=(const StructureWriter &);
+};
+
+#endif
+/* eof */
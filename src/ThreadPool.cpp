@@ -0,0 +1,71 @@
+#include "ThreadPool.h"
+
+
+/**
+ * @param n_threads Number of worker threads. 0 (the default) means one thread per
+ * hardware thread (as reported by std::thread::hardware_concurrency).
+ */
+ThreadPool::ThreadPool(int n_threads) :
+  task_(NULL), n_(0), next_(0), generation_(0), active_(0), stop_(false) {
+  if (n_threads <= 0) {
+    n_threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (n_threads <= 0) n_threads = 1;
+  }
+  for (int w=0; w<n_threads; w++)
+    workers_.push_back(std::thread(&ThreadPool::work, this, w));
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (size_t w=0; w<workers_.size(); w++)
+    workers_[w].join();
+}
+
+/**
+ * Execute task(k, worker) for k = 0..n-1 on the workers and wait for all of them.
+ * An exception thrown by a task is not propagated (it terminates the program), so
+ * tasks should handle their own errors.
+ */
+void ThreadPool::run(int n, const Task &task) {
+  if (n <= 0) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task;
+  n_ = n;
+  next_.store(0);
+  active_ = size();
+  ++generation_;
+  start_.notify_all();
+  done_.wait(lock, [this]() { return active_ == 0; });
+  task_ = NULL;
+}
+
+/**
+ * The loop of each worker thread: wait for a new generation, then take
+ * indices from next_ until the loop is exhausted.
+ */
+void ThreadPool::work(int worker) {
+  unsigned long seen = 0;
+  for (;;) {
+    const Task *task;
+    int n;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, seen]() { return stop_ || generation_ != seen; });
+      if (stop_) return;
+      seen = generation_;
+      task = task_;
+      n = n_;
+    }
+    for (int k = next_.fetch_add(1); k < n; k = next_.fetch_add(1))
+      (*task)(k, worker);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--active_ == 0)
+      done_.notify_one();
+  }
+}
+
+/* eof */
@@ -0,0 +1,66 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/**
+ * \class ThreadPool
+ *
+ * \ingroup Folding
+ *
+ * \brief A fixed set of worker threads for data-parallel loops.
+ *
+ * run(n, task) calls task(k, worker) for k = 0..n-1, spread over the workers,
+ * and returns when all n calls are done. worker (0..size()-1) identifies the
+ * thread that executes the call, so that callers can give each worker its own
+ * scratch objects (e.g., one EnergyEvaluator per worker) without locking.
+ * Indices are handed out one at a time from an atomic counter, which balances
+ * the load when the individual calls differ in cost.
+ *
+ * The threads are started once and sleep between calls to run. run itself is
+ * not reentrant: a pool executes one loop at a time.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+ public:
+  /** The body of a parallel loop: (index, worker). */
+  typedef std::function<void(int, int)> Task;
+ private:
+  /** The worker threads. */
+  std::vector<std::thread> workers_;
+  /** Protects the fields below, except next_. */
+  std::mutex mutex_;
+  /** Signals a new loop (or shutdown) to the workers. */
+  std::condition_variable start_;
+  /** Signals the end of a loop to run. */
+  std::condition_variable done_;
+  /** The body of the current loop. */
+  const Task *task_;
+  /** Number of iterations of the current loop. */
+  int n_;
+  /** Next iteration to be handed out. */
+  std::atomic<int> next_;
+  /** Incremented for each loop, so that workers notice a new one. */
+  unsigned long generation_;
+  /** Number of workers still busy with the current loop. */
+  int active_;
+  /** Set by the destructor. */
+  bool stop_;
+ public:
+  explicit ThreadPool(int n_threads = 0);
+  ~ThreadPool();
+  int size() const { return static_cast<int>(workers_.size()); }
+  void run(int n, const Task &task);
+ private:
+  void work(int worker);
+  ThreadPool(const ThreadPool &);
+  ThreadPool& operator=(const ThreadPool &);
+};
+
+#endif
+/* eof */
@@ -29,19 +29,42 @@
 #include "Nussinov.h"
 #include "EnergyFunction2.h"
 #include "RNAStructure.h"
+#include "ParameterRegistry.h"
+#include "ThreadPool.h"
+#include "IncrementalEnergy.h"
+#include "Kinetics.h"
+#include "Ensemble.h"
+#include "StructureWriter.h"
+#include "StructureDistance.h"
+#include "PairProbability.h"
+#include "StructureAccuracy.h"
+#include "LoopTree.h"
 #include "optionparser.h"
 
 #include <string>
 #include <vector>
+#include <thread>
 #include <execinfo.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 
 // Files with unit test
 #include "unittests/readfastatest.cpp"
 #include "unittests/nussinovtest.cpp"
 #include "unittests/CTtest.cpp"
+#include "unittests/efn2test.cpp"
+#include "unittests/registrytest.cpp"
+#include "unittests/threadpooltest.cpp"
+#include "unittests/incrementaltest.cpp"
+#include "unittests/kineticstest.cpp"
+#include "unittests/ensembletest.cpp"
+#include "unittests/distancetest.cpp"
+#include "unittests/probabilitytest.cpp"
+#include "unittests/accuracytest.cpp"
+#include "unittests/looptreetest.cpp"
 
 /** Handler to print a stack trace if there is a SEGFAULT */
 void handler(int sig) {
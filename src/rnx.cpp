@@ -34,18 +34,31 @@
  */
 
 #include <iostream>
+#include <stdexcept>
 #include "optionparser.h"
 #include "Sequence.h"
 #include "EnergyFunction2.h"
 #include "RNAStructure.h"
+#include "ThreadPool.h"
+#include <stdlib.h>
 
 
 const std::vector<option::Descriptor> usage = {
      { 'h', "help",  option::ArgType::NONE, "Print usage message and exit" },
      { 'c', "ct", option::ArgType::STRING, "CT file" },
      { 'd', "data", option::ArgType::STRING, "Data directory with folding parameters" },
+     { 's', "shm", option::ArgType::STRING, "Shared-memory segment with the folding parameters (created if absent)" },
+     { 't', "threads", option::ArgType::INTEGER, "Number of worker threads for scoring the structures (default: all cores)" },
    };
 
+/*
+ * Usage:
+ *   rnx [-c file.ct] [-d dat] [-s shm] [-t threads]
+ *     score the structures of a CT file and write them, sorted by energy, to testout.ct
+ *   rnx eval [-d dat] [-s shm] [-t threads] < candidates.tsv
+ *     read sequence<TAB>dot-bracket lines from stdin and write them with their energies to stdout
+ */
+
 
 
 int main(int argc, char* argv[]) {
@@ -53,17 +66,55 @@ int main(int argc, char* argv[]) {
  
   option::Parser parser(usage, argc, argv);
   std::string cmd = parser.get_command_string();
-  std::cout << cmd << std::endl;
-  const char * fname = "./testdata/u3.ct";
+  bool eval_mode = parser.nonoption_count()>0 && parser.get_nonoption(0)=="eval";
+  if (! eval_mode) /* in eval mode, stdout is reserved for the energies */
+    std::cout << cmd << std::endl;
+  std::string fname = "./testdata/u3.ct";
+  if (parser.has_option('c'))
+    fname = parser.get_value('c');
+  int n_threads = 0;
+  if (parser.has_option('t'))
+    n_threads = atoi(parser.get_value('t').c_str());
   
 
-  const char *dir = "./dat";
-  Datatable dattab(dir);
+  std::string dir = "./dat";
+  if (parser.has_option('d'))
+    dir = parser.get_value('d');
+  Datatable *dattab;
+  if (parser.has_option('s')) {
+    /* worker pools: the first process parses the data files, the others attach */
+    std::string shm = parser.get_value('s');
+    try {
+      dattab = Datatable::attach_shared(shm.c_str());
+      if (!dattab->is_from(dir.c_str())) {
+	std::cerr << "[WARNING] Shared-memory segment \"" << shm << "\" holds the parameters of "
+		  << dattab->get_data_dir() << ", publishing those of " << dir << std::endl;
+	delete dattab;
+	dattab = NULL;
+      }
+    } catch (const std::runtime_error &e) {
+      dattab = NULL;
+    }
+    if (dattab == NULL) {
+      dattab = new Datatable(dir.c_str());
+      dattab->publish_shared(shm.c_str());
+    }
+  } else {
+    dattab = new Datatable(dir.c_str());
+  }
+  ThreadPool pool(n_threads);
+  if (eval_mode) {
+    std::ios::sync_with_stdio(false);
+    efn2_stream(*dattab, std::cin, std::cout, pool);
+    delete dattab;
+    return 0;
+  }
   RNAStructure rnastruct(fname);
 
-  dattab.efn2(&rnastruct, 1);
+  efn2_batch(*dattab, &rnastruct, pool, true);
 
   const char *newout = "testout.ct";
   rnastruct.ctout (newout);
+  delete dattab;
   return 0;
 }
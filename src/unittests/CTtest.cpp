@@ -401,6 +401,18 @@ TESTWITHSETUP(RNAStructureFixture,dotparen)
   CHECK_STRINGS_EQUAL(expected, dpar);
 }
 
+/** the arrays are sized to the 76 bases and the one structure of RA7680 */
+TESTWITHSETUP(RNAStructureFixture,storage)
+{
+  size_t size = rnastruct->get_storage_size();
+  CHECK(size < 4096);
+  RNAStructure u3("../testdata/u3.ct");
+  CHECK_INTS_EQUAL(5,u3.get_number_of_structures());
+  CHECK(u3.get_storage_size() < 4 * sizeof(int) * 6 * (u3.get_number_of_bases()+1));
+  /* one contiguous buffer with a row of n+1 entries per structure */
+  CHECK_INTS_EQUAL(u3.get_number_of_bases()+1,u3.basepr()[5] - u3.basepr()[4]);
+}
+
 /** check we get the correct label of the RA7680 structure */
 TESTWITHSETUP(RNAStructureFixture,intermolecular)
 {
@@ -688,3 +700,221 @@ TEST (iloop_lopsided_u3,EnergyFunction2) {
 
 
 
+
+
+/**
+ * The CT parser gives the same structures for files with DOS line ends, without
+ * a newline after the last line, and with trailing blank lines.
+ */
+TEST (ct_line_ends,RNAStructure) {
+  std::ifstream in("../testdata/u3.ct");
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  std::string text = buffer.str();
+  RNAStructure u3("../testdata/u3.ct");
+  std::string dos;
+  for (size_t k=0; k<text.size(); k++) {
+    if (text[k]=='\n') dos += '\r';
+    dos += text[k];
+  }
+  const char *path = "/tmp/rnx_ct_line_ends.ct";
+  std::string variants[] = { dos, text.substr(0, text.size()-1), text + "\n\n" };
+  for (int v=0; v<3; v++) {
+    std::ofstream out(path, std::ios::binary);
+    out << variants[v];
+    out.close();
+    RNAStructure ct(path);
+    CHECK_INTS_EQUAL(5,ct.get_number_of_structures());
+    CHECK_INTS_EQUAL(u3.get_number_of_bases(),ct.get_number_of_bases());
+    CHECK_STRINGS_EQUAL(u3.get_ith_label(5),ct.get_ith_label(5));
+    CHECK_STRINGS_EQUAL(u3.get_dot_parens_structure(5),ct.get_dot_parens_structure(5));
+    CHECK(u3.nucleotide_at(217)==ct.nucleotide_at(217));
+  }
+  remove(path);
+}
+
+
+/**
+ * The buffered writer produces the same CT text with and without a thread pool
+ * (and with a block size that forces many flushes), and the text reads back
+ * into the same structures.
+ */
+TEST (structure_writer_ct,StructureWriter) {
+  RNAStructure u3("../testdata/u3.ct");
+  int energies[] = { 0, -8250, -8230, -5, 0, 120 };
+  u3.set_energy(energies, 6);
+  const char *serial = "/tmp/rnx_writer_serial.ct";
+  const char *parallel = "/tmp/rnx_writer_parallel.ct";
+  {
+    StructureWriter writer(serial, StructureWriter::CT, 100);
+    writer.write_all(&u3);
+  }
+  {
+    ThreadPool pool(3);
+    StructureWriter writer(parallel, StructureWriter::CT);
+    writer.write_all(&u3, &pool);
+  }
+  std::ifstream a(serial), b(parallel);
+  std::stringstream sa, sb;
+  sa << a.rdbuf();
+  sb << b.rdbuf();
+  CHECK(sa.str()==sb.str());
+  std::string first_line = sa.str().substr(0, sa.str().find('\n'));
+  CHECK_STRINGS_EQUAL(std::string("217\tdG = -82.50 ") + u3.get_ith_label(1),first_line);
+  CHECK(sa.str().find("dG = -0.05 ") != std::string::npos);
+  CHECK(sa.str().find("dG = 1.20 ") != std::string::npos);
+  RNAStructure copy(serial);
+  CHECK_INTS_EQUAL(5,copy.get_number_of_structures());
+  for (int s=1; s<=5; s++)
+    CHECK_STRINGS_EQUAL(u3.get_dot_parens_structure(s),copy.get_dot_parens_structure(s));
+  remove(serial);
+  remove(parallel);
+}
+
+/** Dot-bracket records: label, sequence, structure and energy. */
+TEST (structure_writer_dot_bracket,StructureWriter) {
+  RNAStructure hairpin("GGGAAACCC", "(((...)))");
+  int energies[] = { 0, -120 };
+  hairpin.set_energy(energies, 2);
+  std::string text;
+  StructureWriter::format_dot_bracket(&hairpin, 1, &text);
+  CHECK_STRINGS_EQUAL(std::string(">\nGGGAAACCC\n(((...))) (-1.20)\n"),text);
+}
+
+/** Sorting permutes whole structures (pairs, energy and label) and is stable. */
+TEST (sort_structures,RNAStructure) {
+  RNAStructure u3("../testdata/u3.ct");
+  int energies[] = { 0, 100, -50, 100, -300, -50 };
+  u3.set_energy(energies, 6);
+  std::string db[6], label[6];
+  for (int s=1; s<=5; s++) {
+    db[s] = u3.get_dot_parens_structure(s);
+    label[s] = u3.get_ith_label(s);
+  }
+  u3.sortstructures();
+  int expected[] = { 0, 4, 2, 5, 1, 3 };
+  for (int s=1; s<=5; s++) {
+    CHECK_INTS_EQUAL(energies[expected[s]],u3.get_energy(s));
+    CHECK_STRINGS_EQUAL(db[expected[s]],u3.get_dot_parens_structure(s));
+    CHECK_STRINGS_EQUAL(label[expected[s]],u3.get_ith_label(s));
+  }
+  /* rows must survive a reallocation of the pair buffer after the permutation */
+  for (int k=0; k<100; k++)
+    u3.add_structure(u3.basepr()[1], 7, "extra");
+  CHECK_STRINGS_EQUAL(db[4],u3.get_dot_parens_structure(1));
+  CHECK_STRINGS_EQUAL(db[3],u3.get_dot_parens_structure(5));
+  CHECK_STRINGS_EQUAL(db[4],u3.get_dot_parens_structure(105));
+}
+
+/** The parallel sort and keep_lowest agree with the serial sort. */
+TEST (sort_large_ensemble,RNAStructure) {
+  RNAStructure hairpin("GGGAAACCC", "(((...)))");
+  RNAStructure open("GGGAAACCC", ".........");
+  unsigned int x = 12345;
+  for (int k=0; k<9999; k++) {
+    x = x * 1103515245u + 12345u;
+    int energy = static_cast<int>((x >> 16) % 2000) - 1000;
+    hairpin.add_structure(k % 2 ? hairpin.basepr()[1] : open.basepr()[1], energy);
+  }
+  std::vector<int> serial = hairpin.sorted_order();
+  ThreadPool pool(3);
+  std::vector<int> parallel = hairpin.sorted_order(&pool);
+  CHECK_INTS_EQUAL(10000,parallel.size());
+  CHECK(serial==parallel);
+  std::vector<int> top(serial.begin(), serial.begin()+10);
+  std::vector<std::string> db(10);
+  for (int k=0; k<10; k++)
+    db[k] = hairpin.get_dot_parens_structure(top[k]);
+  hairpin.keep_lowest(10);
+  CHECK_INTS_EQUAL(10,hairpin.get_number_of_structures());
+  for (int k=0; k<10; k++)
+    CHECK_STRINGS_EQUAL(db[k],hairpin.get_dot_parens_structure(k+1));
+  for (int s=2; s<=10; s++)
+    CHECK(hairpin.get_energy(s-1) <= hairpin.get_energy(s));
+}
+
+/** An RNAStructure reused for a sequence of another length holds the same rows as a fresh one. */
+TEST (reuse_other_length,RNAStructure) {
+  RNAStructure u3("../testdata/u3.ct");
+  std::string seq(300, 'A');
+  std::string db = std::string(100, '(') + std::string(100, '.') + std::string(100, ')');
+  RNAStructure ct(seq, db);
+  CHECK_INTS_EQUAL(2,ct.add_structure(ct.basepr()[1]));
+  CTReader reader("../testdata/u3.ct");
+  CHECK_INTS_EQUAL(5,reader.next(&ct, 5));
+  CHECK_INTS_EQUAL(u3.get_number_of_bases(),ct.get_number_of_bases());
+  int differ = 0;
+  for (int s=1; s<=5; s++)
+    for (int i=1; i<=u3.get_number_of_bases(); i++)
+      differ += (ct.basepr()[s][i] != u3.basepr()[s][i]);
+  CHECK_INTS_EQUAL(0,differ);
+  ct.assign(seq, db);
+  CHECK_INTS_EQUAL(1,ct.get_number_of_structures());
+  CHECK_STRINGS_EQUAL(db,ct.get_dot_parens_structure(1));
+}
+
+/**
+ * A malformed CT file is reported with an exception that names the file and the
+ * line, instead of ending the program.
+ */
+TEST (malformed_ct,RNAStructure) {
+  const char *path = "/tmp/rnx_malformed.ct";
+  {
+    std::ofstream out(path);
+    out << "3 ENERGY = -1.0 bad\n"
+	<< "1 G 0 2 3 1\n"
+	<< "2 A 1 3 9 2\n"
+	<< "3 C 2 4 1 3\n";
+  }
+  std::string message;
+  try {
+    RNAStructure ct(path);
+  } catch (const std::runtime_error &e) {
+    message = e.what();
+  }
+  CHECK(message.find(path) != std::string::npos);
+  CHECK(message.find("line 3") != std::string::npos);
+  CHECK(message.find("partner out of range") != std::string::npos);
+  remove(path);
+}
+
+/**
+ * A CT file that ends in the middle of a record: the complete records are read,
+ * then next throws (naming the file and the line) and leaves the batch empty.
+ */
+TEST (ct_reader_truncated,CTReader) {
+  const char *path = "/tmp/rnx_truncated.ct";
+  std::string text;
+  {
+    std::ifstream in("../testdata/u3.ct");
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    text = buffer.str();
+  }
+  /* the first record and the header and first ten bases of the second */
+  size_t cut = 0;
+  int n = RNAStructure("../testdata/u3.ct").get_number_of_bases();
+  for (int line=0; line<n+1+1+10; line++)
+    cut = text.find('\n', cut) + 1;
+  {
+    std::ofstream out(path);
+    out << text.substr(0, cut);
+  }
+  CTReader reader(path);
+  RNAStructure batch;
+  CHECK_INTS_EQUAL(1,reader.next(&batch, 1));
+  std::string message;
+  try {
+    reader.next(&batch, 4);
+  } catch (const std::runtime_error &e) {
+    message = e.what();
+  }
+  CHECK(message.find(path) != std::string::npos);
+  std::stringstream line;
+  line << "line " << n+1+1+10; /* the last line of the file */
+  CHECK(message.find(line.str()) != std::string::npos);
+  CHECK(message.find("ends in the middle") != std::string::npos);
+  CHECK_INTS_EQUAL(0,batch.get_number_of_structures());
+  CHECK_INTS_EQUAL(1,reader.get_number_read());
+  remove(path);
+}
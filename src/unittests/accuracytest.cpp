@@ -0,0 +1,62 @@
+
+/**
+ * Unit tests for the accuracy of predicted against reference structures.
+ */
+
+/** A structure compared with itself is perfect; a disjoint one scores zero. */
+TEST (accuracy_counts,StructureAccuracy) {
+  RNAStructure u3("../testdata/u3.ct");
+  AccuracyCounts same = compare_structures(&u3, 1, &u3, 1);
+  CHECK(same.reference_pairs > 0);
+  CHECK_INTS_EQUAL(same.reference_pairs,same.found);
+  CHECK(fabs(same.sensitivity() - 1.0) < 1e-12);
+  CHECK(fabs(same.ppv() - 1.0) < 1e-12);
+  CHECK(fabs(same.f1() - 1.0) < 1e-12);
+  CHECK(fabs(same.mcc() - 1.0) < 1e-12);
+  AccuracyCounts other = compare_structures(&u3, 2, &u3, 1);
+  CHECK(other.found == other.confirmed);
+  CHECK(other.sensitivity() < 1.0);
+  RNAStructure a("GGGGAAAACCCC", "((((....))))");
+  RNAStructure b("GGGGAAAACCCC", ".((((...))))");
+  AccuracyCounts strict = compare_structures(&b, 1, &a, 1);
+  CHECK_INTS_EQUAL(4,strict.reference_pairs);
+  CHECK_INTS_EQUAL(0,strict.found);
+  CHECK_INTS_EQUAL(0,strict.confirmed);
+  CHECK_INTS_EQUAL(66,strict.possible_pairs);
+  AccuracyCounts slipped = compare_structures(&b, 1, &a, 1, true);
+  CHECK_INTS_EQUAL(4,slipped.found);
+  CHECK_INTS_EQUAL(4,slipped.confirmed);
+  RNAStructure c("GGGGAAAACCCCA", "((((....)))).");
+  bool thrown = false;
+  try {
+    compare_structures(&c, 1, &a, 1);
+  } catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+/** The batch comparison and the family table of means. */
+TEST (accuracy_summary,StructureAccuracy) {
+  RNAStructure a("GGGGAAAACCCC", "((((....))))");
+  RNAStructure b("GGGGAAAACCCC", "............");
+  std::vector<const RNAStructure*> predicted, reference;
+  std::vector<std::string> family;
+  for (int k=0; k<100; k++) {
+    predicted.push_back(k % 4 ? &a : &b);
+    reference.push_back(&a);
+    family.push_back(k % 2 ? "tRNA" : "5S");
+  }
+  ThreadPool pool(3);
+  std::vector<AccuracyCounts> results;
+  compare_batch(predicted, reference, pool, &results);
+  CHECK_INTS_EQUAL(100,results.size());
+  CHECK(fabs(results[0].sensitivity()) < 1e-12);
+  CHECK(fabs(results[1].sensitivity() - 1.0) < 1e-12);
+  std::ostringstream out;
+  write_accuracy_summary(out, family, results);
+  CHECK_STRINGS_EQUAL(std::string("family\tsequences\tsensitivity\tppv\tf1\tmcc\n"
+				  "5S\t50\t0.5000\t0.5000\t0.5000\t0.5000\n"
+				  "tRNA\t50\t1.0000\t1.0000\t1.0000\t1.0000\n"
+				  "all\t100\t0.7500\t0.7500\t0.7500\t0.7500\n"),out.str());
+}
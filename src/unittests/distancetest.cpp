@@ -0,0 +1,101 @@
+
+/**
+ * Unit tests for base-pair distances and medoid clustering.
+ */
+
+/** Count the pairs in exactly one of the structures a and b by comparing pair tables. */
+static int pair_table_distance(const RNAStructure &ct, int a, int b) {
+  int d = 0;
+  for (int i=1; i<=ct.get_number_of_bases(); i++) {
+    int pa = ct.basepr()[a][i];
+    int pb = ct.basepr()[b][i];
+    if (pa > i && pa != pb)
+      d++;
+    if (pb > i && pb != pa)
+      d++;
+  }
+  return d;
+}
+
+/** The bitset distances and the condensed matrix agree with the pair tables of u3. */
+TEST (distance_matrix,StructureDistance) {
+  RNAStructure u3("../testdata/u3.ct");
+  StructureDistance dist(&u3);
+  CHECK_INTS_EQUAL(5,dist.get_number_of_structures());
+  CHECK(dist.get_number_of_candidate_pairs() > 0);
+  ThreadPool pool(3);
+  std::vector<uint16_t> matrix;
+  dist.distance_matrix(&matrix, pool);
+  CHECK_INTS_EQUAL(10,matrix.size());
+  for (int a=1; a<=5; a++) {
+    CHECK_INTS_EQUAL(0,dist.distance(a,a));
+    for (int b=a+1; b<=5; b++) {
+      int expected = pair_table_distance(u3, a, b);
+      CHECK_INTS_EQUAL(expected,dist.distance(a,b));
+      CHECK_INTS_EQUAL(expected,dist.distance(b,a));
+      CHECK_INTS_EQUAL(expected,matrix[StructureDistance::condensed_index(a,b,5)]);
+    }
+  }
+}
+
+/** Pairs shifted by one base are different candidate pairs. */
+TEST (distance_slipped,StructureDistance) {
+  const char *seq = "GGGGAAAACCCC";
+  const char *slipped[] = { "((((....))))", ".((((...))))", "(((....)))..", "((((...)))).", };
+  RNAStructure ct(seq, slipped[0]);
+  RNAStructure tmp(seq, slipped[0]);
+  for (int k=1; k<4; k++) {
+    tmp.assign(seq, slipped[k]);
+    ct.add_structure(tmp.basepr()[1]);
+  }
+  StructureDistance dist(&ct);
+  CHECK_INTS_EQUAL(15,dist.get_number_of_candidate_pairs());
+  for (int a=1; a<=4; a++) {
+    CHECK_INTS_EQUAL(a == 3 ? 3 : 4,dist.get_number_of_pairs(a));
+    for (int b=1; b<=4; b++)
+      CHECK_INTS_EQUAL(pair_table_distance(ct, a, b),dist.distance(a,b));
+  }
+  CHECK_INTS_EQUAL(8,dist.distance(1,2));
+}
+
+/** Two families of structures around different helices fall into two clusters. */
+TEST (distance_cluster,StructureDistance) {
+  const char *seq = "GGGGAAAACCCCUUUUGGGGAAAACCCC";
+  const char *family[] = {
+    "((((....))))................",
+    "(((......)))................",
+    ".(((....))).................",
+    "................((((....))))",
+    "................(((......)))",
+    ".................(((....))).",
+    "(((((..............)))))....",
+  };
+  RNAStructure ct(seq, family[0]);
+  RNAStructure tmp(seq, family[0]);
+  for (int k=1; k<7; k++) {
+    tmp.assign(seq, family[k]);
+    ct.add_structure(tmp.basepr()[1]);
+  }
+  StructureDistance dist(&ct);
+  ThreadPool pool(2);
+  std::vector<int> medoids, assignment;
+  long cost = dist.cluster(2, &medoids, &assignment, pool);
+  CHECK_INTS_EQUAL(2,medoids.size());
+  CHECK_INTS_EQUAL(7,assignment.size());
+  CHECK(assignment[0]==assignment[1] && assignment[0]==assignment[2]);
+  CHECK(assignment[3]==assignment[4] && assignment[3]==assignment[5]);
+  CHECK(assignment[0]!=assignment[3]);
+  long sum = 0;
+  for (int s=1; s<=7; s++)
+    sum += dist.distance(s, medoids[assignment[s-1]]);
+  CHECK_INTS_EQUAL(sum,cost);
+  dist.cluster(7, &medoids, &assignment, pool);
+  CHECK_INTS_EQUAL(0,dist.distance(1, medoids[assignment[0]]));
+  bool thrown = false;
+  try {
+    dist.cluster(8, &medoids, &assignment, pool);
+  } catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
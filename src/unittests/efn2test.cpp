@@ -0,0 +1,662 @@
+/**
+ * Unit tests for temperature dependent parameter sets and for
+ * the evaluation of whole structures with efn2.
+ */
+
+/**
+ * Temperature rescaling requires enthalpy tables. Using the free energy
+ * tables as enthalpies means that every entropy term is zero, so that
+ * all energies must stay the same at any temperature apart from the
+ * (purely entropic) extrapolation for large loops.
+ */
+TEST (at_temperature_pure_enthalpy,Datatable) {
+  const char *dir = "../dat";
+  Datatable dattab(dir);
+  CHECK(!dattab.has_enthalpies());
+  dattab.load_enthalpies(dir, ".dat");
+  CHECK(dattab.has_enthalpies());
+  const Datatable &hot = dattab.at_temperature(60.0);
+  CHECK_DOUBLES_EQUAL(60.0,hot.get_temperature());
+  CHECK_INTS_EQUAL(dattab.get_stack_energy(1,4,2,3),hot.get_stack_energy(1,4,2,3));
+  CHECK_INTS_EQUAL(dattab.get_tstackh_energy(4,3,3,2),hot.get_tstackh_energy(4,3,3,2));
+  CHECK_INTS_EQUAL(dattab.get_destabilizing_energy_hairpin_loop(30),hot.get_destabilizing_energy_hairpin_loop(30));
+  CHECK_INTS_EQUAL(dattab.get_tetraloop_energy("GGGGAC"),hot.get_tetraloop_energy("GGGGAC"));
+  CHECK_INTS_EQUAL(dattab.get_terminal_AU_penalty(),hot.get_terminal_AU_penalty());
+  CHECK(hot.get_stack_energy(1,1,1,1)>9999); // infinity stays infinity
+  double expected = dattab.get_prelog()*(60.0+273.15)/(37.0+273.15);
+  CHECK_DOUBLES_EQUAL(expected,hot.get_prelog());
+}
+
+/**
+ * Enthalpies that differ from the free energies. The .dh files are copies of
+ * the .dat files, except that the stacks of -2.2 have dH = -9.9 and the
+ * hairpin of 30 has dH = 9.9 (dG(37) = 7.7), so these are rescaled with
+ * dG(T) = dH - (T/310.15)*(dH - dG(37)) while all other entries stay put.
+ */
+TEST (at_temperature_rescaled,Datatable) {
+  const char *dir = "/tmp/rnx_enthalpy";
+  mkdir(dir, 0755);
+  const char *files[] = { "loop", "stack", "tstackh", "tstacki", "tloop", "miscloop",
+			  "dangle", "int22", "int21", "coaxial", "triloop", "tstackcoax",
+			  "coaxstack", "tstack", "tstackm", "int11" };
+  int n_files = sizeof(files)/sizeof(files[0]);
+  for (int k=0; k<n_files; k++) {
+    std::ifstream in((std::string("../dat/") + files[k] + ".dat").c_str());
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+    if (std::string(files[k]) == "stack") {
+      for (size_t pos=text.find("-2.2"); pos!=std::string::npos; pos=text.find("-2.2", pos))
+	text.replace(pos, 4, "-9.9");
+    } else if (std::string(files[k]) == "loop") {
+      std::string row30("6.1               7.7");
+      size_t pos = text.find(row30);
+      CHECK(pos != std::string::npos);
+      text.replace(pos, row30.size(), "6.1               9.9");
+    }
+    std::ofstream out((std::string(dir) + "/" + files[k] + ".dh").c_str());
+    out << text;
+  }
+  Datatable dattab("../dat");
+  dattab.load_enthalpies(dir);
+  CHECK_INTS_EQUAL(-220,dattab.get_stack_energy(1,4,2,3));
+  CHECK_INTS_EQUAL(770,dattab.get_destabilizing_energy_hairpin_loop(30));
+  /* -990 - (333.15/310.15)*(-990+220) = -162.9; 990 - (333.15/310.15)*(990-770) = 753.7 */
+  const Datatable &hot = dattab.at_temperature(60.0);
+  CHECK_INTS_EQUAL(-163,hot.get_stack_energy(1,4,2,3));
+  CHECK_INTS_EQUAL(754,hot.get_destabilizing_energy_hairpin_loop(30));
+  /* -990 - (293.15/310.15)*(-990+220) = -262.2; 990 - (293.15/310.15)*(990-770) = 782.1 */
+  const Datatable &cold = dattab.at_temperature(20.0);
+  CHECK_INTS_EQUAL(-262,cold.get_stack_energy(1,4,2,3));
+  CHECK_INTS_EQUAL(782,cold.get_destabilizing_energy_hairpin_loop(30));
+  /* dH == dG(37): no entropy, the same at every temperature */
+  CHECK_INTS_EQUAL(dattab.get_destabilizing_energy_hairpin_loop(29),hot.get_destabilizing_energy_hairpin_loop(29));
+  CHECK_INTS_EQUAL(dattab.get_stack_energy(2,3,3,2),hot.get_stack_energy(2,3,3,2));
+  for (int k=0; k<n_files; k++)
+    remove((std::string(dir) + "/" + files[k] + ".dh").c_str());
+  rmdir(dir);
+}
+
+/**
+ * The 37 degree request returns the table itself, and other
+ * temperatures are built only once. Once a table has been derived the
+ * enthalpies cannot be replaced, so that the reference stays valid.
+ */
+TEST (at_temperature_cache,Datatable) {
+  const char *dir = "../dat";
+  Datatable dattab(dir);
+  dattab.load_enthalpies(dir, ".dat");
+  CHECK(&dattab == &dattab.at_temperature(37.0));
+  const Datatable *t1 = &dattab.at_temperature(25.0);
+  const Datatable *t2 = &dattab.at_temperature(25.01);
+  CHECK(t1 == t2);
+  CHECK(t1 != &dattab.at_temperature(50.0));
+  int stack = t1->get_stack_energy(1,4,2,3);
+  bool rejected = false;
+  try {
+    dattab.load_enthalpies(dir, ".dat");
+  } catch (const std::runtime_error &e) {
+    rejected = true;
+  }
+  CHECK(rejected);
+  CHECK(t1 == &dattab.at_temperature(25.0));
+  CHECK_INTS_EQUAL(stack,t1->get_stack_energy(1,4,2,3));
+  /* before any derived table, the enthalpies can be replaced */
+  Datatable fresh(dir);
+  fresh.load_enthalpies(dir, ".dat");
+  fresh.load_enthalpies(dir, ".dat");
+  CHECK(fresh.has_enthalpies());
+}
+
+/** Several threads sweeping the same temperatures share the cached tables. */
+TEST (at_temperature_parallel,Datatable) {
+  const char *dir = "../dat";
+  Datatable dattab(dir);
+  dattab.load_enthalpies(dir, ".dat");
+  const int n_threads = 4;
+  const Datatable *seen[n_threads][3];
+  std::vector<std::thread> workers;
+  for (int t=0; t<n_threads; ++t) {
+    workers.push_back(std::thread([&dattab,&seen,t]() {
+	  for (int k=0; k<3; ++k)
+	    seen[t][k] = &dattab.at_temperature(20.0 + 20.0*((t+k)%3));
+	}));
+  }
+  for (int t=0; t<n_threads; ++t)
+    workers[t].join();
+  for (int t=0; t<n_threads; ++t)
+    for (int k=0; k<3; ++k)
+      CHECK(seen[t][k] == &dattab.at_temperature(20.0 + 20.0*((t+k)%3)));
+}
+
+/**
+ * efn2 reproduces the energies that mfold wrote into the header
+ * lines of u3.ct (e.g., "dG = -82.50" for the first structure).
+ */
+TEST (efn2_u3,EnergyEvaluator) {
+  Datatable *dattab = new Datatable("../dat");
+  RNAStructure rnastruct("../testdata/u3.ct");
+  EnergyEvaluator evaluator(*dattab);
+  evaluator.efn2(&rnastruct, 0);
+  CHECK_INTS_EQUAL(-8250,evaluator.get_energy(1));
+  CHECK_INTS_EQUAL(-8230,evaluator.get_energy(2));
+  CHECK_INTS_EQUAL(-8038,evaluator.get_energy(3));
+  CHECK_INTS_EQUAL(-7773,evaluator.get_energy(4));
+  CHECK_INTS_EQUAL(-7758,evaluator.get_energy(5));
+  evaluator.efn2(&rnastruct, 3);
+  CHECK_INTS_EQUAL(-8038,evaluator.get_energy(3));
+  delete dattab;
+}
+
+/**
+ * Stress test: many threads, each with its own EnergyEvaluator, evaluate
+ * the same structures over and over against one shared Datatable.
+ * Every thread must see exactly the single-threaded energies.
+ */
+TEST (efn2_shared_datatable,EnergyEvaluator) {
+  const Datatable *dattab = new Datatable("../dat");
+  const RNAStructure *u3 = new RNAStructure("../testdata/u3.ct");
+  const RNAStructure *snora = new RNAStructure("../testdata/SNORA17.ct");
+  const int expected_u3[] = {0, -8250, -8230, -8038, -7773, -7758};
+  const int n_threads = 8;
+  const int n_rounds = 50;
+  std::vector<int> mismatches(n_threads, 0);
+  std::vector<std::thread> workers;
+  for (int t=0; t<n_threads; ++t) {
+    workers.push_back(std::thread([=,&mismatches]() {
+	  EnergyEvaluator evaluator(*dattab);
+	  for (int r=0; r<n_rounds; ++r) {
+	    evaluator.efn2(u3, 0);
+	    for (int k=1; k<=5; ++k)
+	      if (evaluator.get_energy(k) != expected_u3[k])
+		mismatches[t]++;
+	    evaluator.efn2(snora, 1);
+	    if (evaluator.get_energy(1) != -5500)
+	      mismatches[t]++;
+	  }
+	}));
+  }
+  for (int t=0; t<n_threads; ++t)
+    workers[t].join();
+  for (int t=0; t<n_threads; ++t)
+    CHECK_INTS_EQUAL(0,mismatches[t]);
+  delete u3;
+  delete snora;
+  delete dattab;
+}
+
+/**
+ * Publish the tables into shared memory and attach to them from
+ * a forked worker process, which scores u3.ct without reading ../dat.
+ */
+TEST (shared_tables,Datatable) {
+  std::stringstream ss;
+  ss << "/rnx_unittest_" << getpid();
+  std::string name = ss.str();
+  Datatable *dattab = new Datatable("../dat");
+  uint64_t fingerprint = dattab->get_fingerprint();
+  dattab->publish_shared(name.c_str());
+  delete dattab;
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    int status = 1;
+    try {
+      Datatable *shared = Datatable::attach_shared(name.c_str(), fingerprint);
+      RNAStructure rnastruct("../testdata/u3.ct");
+      EnergyEvaluator evaluator(*shared);
+      evaluator.efn2(&rnastruct, 1);
+      if (shared->is_shared() && evaluator.get_energy(1) == -8250)
+	status = 0;
+      delete shared;
+    } catch (...) {
+    }
+    _exit(status);
+  }
+  int status = -1;
+  waitpid(pid, &status, 0);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status)==0);
+
+  Datatable *shared = Datatable::attach_shared(name.c_str());
+  CHECK(shared->is_shared());
+  CHECK(fingerprint == shared->get_fingerprint());
+  CHECK_INTS_EQUAL(-220,shared->get_stack_energy(1,4,2,3));
+  CHECK_CSTRINGS_EQUAL("../dat",shared->get_data_dir());
+  CHECK(shared->is_from("../dat/"));
+  CHECK(!shared->is_from("../dat", ".dh"));
+  CHECK(!shared->is_from("../other_dat"));
+  delete shared;
+  /* a path the header cannot hold in full is refused, leaving the segment as it was */
+  std::string long_dir("../dat");
+  while (long_dir.size() < maxfil)
+    long_dir += "/.";
+  Datatable long_path(long_dir.c_str());
+  bool refused = false;
+  try {
+    long_path.publish_shared(name.c_str());
+  } catch (const std::runtime_error &e) {
+    refused = true;
+  }
+  CHECK(refused);
+  shared = Datatable::attach_shared(name.c_str());
+  CHECK(shared->is_from("../dat"));
+  delete shared;
+  /* a worker expecting another parameter set must be turned away */
+  bool rejected = false;
+  try {
+    Datatable *other = Datatable::attach_shared(name.c_str(), fingerprint+1);
+    delete other;
+  } catch (const std::runtime_error &e) {
+    rejected = true;
+  }
+  CHECK(rejected);
+  Datatable::unlink_shared(name.c_str());
+}
+
+/**
+ * The scratch space of an evaluator only grows to the size required by the
+ * largest structure; scoring the same or smaller structures again reuses it
+ * and gives the same energies.
+ */
+TEST (efn2_scratch_reuse,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  RNAStructure mir283("../testdata/mir283.ct");
+  RNAStructure ra7680("../testdata/RA7680.ct");
+  EnergyEvaluator evaluator(dattab);
+  evaluator.reserve(u3.get_number_of_bases() > ra7680.get_number_of_bases() ?
+		    u3.get_number_of_bases() : ra7680.get_number_of_bases(),
+		    u3.get_number_of_structures());
+  size_t scratch = evaluator.get_scratch_size();
+  for (int r=0; r<3; ++r) {
+    evaluator.efn2(&u3, 0);
+    CHECK_INTS_EQUAL(-8250,evaluator.get_energy(1));
+    CHECK_INTS_EQUAL(-7758,evaluator.get_energy(5));
+    evaluator.efn2(&mir283, 1);
+    CHECK_INTS_EQUAL(-3170,evaluator.get_energy(1));
+    evaluator.efn2(&ra7680, 1);
+    CHECK_INTS_EQUAL(-3308,evaluator.get_energy(1));
+  }
+  CHECK(scratch == evaluator.get_scratch_size());
+}
+
+/**
+ * Without linkers or forced bases, no segment is constrained and
+ * the constraints take no space at all (formerly n^2/2 ints).
+ */
+TEST (force_constraints_unconstrained,ForceConstraints) {
+  RNAStructure rnastruct("../testdata/RA7680.ct");
+  ForceConstraints fce;
+  fce.assign(&rnastruct);
+  int n = rnastruct.get_number_of_bases();
+  CHECK_INTS_EQUAL(0,fce.at(1,n));
+  CHECK_INTS_EQUAL(0,fce.at(5,6));
+  CHECK_INTS_EQUAL(0,(int)fce.get_size());
+}
+
+/**
+ * With intermolecular linker bases (I), every segment that spans a linker gets
+ * the flag 5, as the dense fce triangle filled by forceinterefn did.
+ */
+TEST (force_constraints_linker,ForceConstraints) {
+  RNAStructure rnastruct("GGGAAIIIAACCC", "(((.......)))");
+  CHECK(rnastruct.intermolecular());
+  ForceConstraints fce;
+  fce.assign(&rnastruct);
+  int n = rnastruct.get_number_of_bases();
+  /* the triangle as forceinterefn filled it: w[j][i-j] = 5 for j < linker < i */
+  std::vector<std::vector<int> > dense(n+1, std::vector<int>(n+1, 0));
+  for (int k=0; k<3; k++) {
+    int dbl = rnastruct.inter(k);
+    for (int i=dbl+1; i<=n; i++)
+      for (int j=1; j<dbl; j++)
+	dense[j][i] = 5;
+  }
+  int differ = 0;
+  for (int i=1; i<=n; i++)
+    for (int j=i; j<=n; j++)
+      if (fce.at(i,j) != dense[i][j])
+	differ++;
+  CHECK_INTS_EQUAL(0,differ);
+  CHECK_INTS_EQUAL(5,fce.at(3,11));
+  CHECK_INTS_EQUAL(5,fce.at(6,8));
+  CHECK_INTS_EQUAL(0,fce.at(1,6));
+  CHECK_INTS_EQUAL(0,fce.at(8,13));
+}
+
+/**
+ * Batch evaluation scores every structure on the pool and stores
+ * the energies in the RNAStructure.
+ */
+TEST (efn2_batch_u3,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure rnastruct("../testdata/u3.ct");
+  ThreadPool pool(3);
+  efn2_batch(dattab, &rnastruct, pool, true);
+  CHECK_INTS_EQUAL(-8250,rnastruct.get_energy(1));
+  CHECK_INTS_EQUAL(-8230,rnastruct.get_energy(2));
+  CHECK_INTS_EQUAL(-8038,rnastruct.get_energy(3));
+  CHECK_INTS_EQUAL(-7773,rnastruct.get_energy(4));
+  CHECK_INTS_EQUAL(-7758,rnastruct.get_energy(5));
+  /* after sorting, the structures still carry their own energies */
+  EnergyEvaluator evaluator(dattab);
+  CHECK_INTS_EQUAL(-8038,evaluator.evaluate(&rnastruct, 3));
+}
+
+/**
+ * The structures of u3 in reverse order are put back in the order of
+ * increasing energy, each with its own pairs.
+ */
+TEST (efn2_batch_sort,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  int n = u3.get_number_of_bases();
+  std::string sequence;
+  for (int k=1; k<=n; k++)
+    sequence += u3.nucleotide_at(k);
+  RNAStructure reversed;
+  reversed.assign_sequence(sequence);
+  for (int s=5; s>=1; s--)
+    reversed.add_structure(u3.basepr()[s]);
+  ThreadPool pool(2);
+  efn2_batch(dattab, &reversed, pool, false);
+  CHECK_INTS_EQUAL(-7758,reversed.get_energy(1));
+  CHECK_INTS_EQUAL(-8250,reversed.get_energy(5));
+  efn2_batch(dattab, &reversed, pool, true);
+  int expected[] = { 0, -8250, -8230, -8038, -7773, -7758 };
+  for (int s=1; s<=5; s++) {
+    CHECK_INTS_EQUAL(expected[s],reversed.get_energy(s));
+    int differ = 0;
+    for (int k=1; k<=n; k++)
+      if (reversed.basepr()[s][k] != u3.basepr()[s][k])
+	differ++;
+    CHECK_INTS_EQUAL(0,differ);
+  }
+}
+
+/**
+ * The loops of each structure add up to its efn2 energy, and the
+ * parallel decomposition gives the same records as the serial one.
+ */
+TEST (decompose_u3,LoopDecomposition) {
+  Datatable dattab("../dat");
+  RNAStructure rnastruct("../testdata/u3.ct");
+  EnergyEvaluator evaluator(dattab);
+  LoopDecomposition loops;
+  for (int s=1; s<=5; s++)
+    evaluator.decompose(&rnastruct, s, &loops);
+  CHECK_INTS_EQUAL(-8250,loops.get_total_energy(1));
+  CHECK_INTS_EQUAL(-8230,loops.get_total_energy(2));
+  CHECK_INTS_EQUAL(-7758,loops.get_total_energy(5));
+  CHECK_INTS_EQUAL(LoopDecomposition::EXTERIOR,loops.type[0]);
+  int pairs = 0, hairpins = 0;
+  const int *bp = rnastruct.basepr()[1];
+  for (int k=1; k<=rnastruct.get_number_of_bases(); k++)
+    if (bp[k]>k) pairs++;
+  for (size_t k=0; k<loops.get_number_of_loops() && loops.structure[k]==1; k++)
+    if (loops.type[k]==LoopDecomposition::HAIRPIN) hairpins++;
+  CHECK(hairpins > 0);
+  /* one loop per pair plus the exterior loop */
+  size_t n1 = 0;
+  while (n1<loops.get_number_of_loops() && loops.structure[n1]==1) n1++;
+  CHECK_INTS_EQUAL(pairs+1,(int)n1);
+
+  LoopDecomposition batch;
+  ThreadPool pool(3);
+  decompose_batch(dattab, &rnastruct, pool, &batch);
+  CHECK(batch.energy == loops.energy);
+  CHECK(batch.i == loops.i);
+  CHECK(batch.type == loops.type);
+
+  std::stringstream ss;
+  batch.write_tsv(ss);
+  std::string header;
+  std::getline(ss, header);
+  CHECK_STRINGS_EQUAL("structure\ttype\ti\tj\tsize\tenergy",header);
+}
+
+/**
+ * With memoization, the suboptimal structures of u3 reuse each other's
+ * loops; the energies stay the same, also when the sequence changes.
+ */
+TEST (efn2_memoize,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  RNAStructure mir283("../testdata/mir283.ct");
+  EnergyEvaluator evaluator(dattab);
+  evaluator.set_memoize(true);
+  evaluator.efn2(&u3, 0);
+  CHECK_INTS_EQUAL(-8250,evaluator.get_energy(1));
+  CHECK_INTS_EQUAL(-8230,evaluator.get_energy(2));
+  CHECK_INTS_EQUAL(-8038,evaluator.get_energy(3));
+  CHECK_INTS_EQUAL(-7773,evaluator.get_energy(4));
+  CHECK_INTS_EQUAL(-7758,evaluator.get_energy(5));
+  CHECK(evaluator.get_cache_hits() > evaluator.get_cache_misses());
+  CHECK_INTS_EQUAL(-3170,evaluator.evaluate(&mir283, 1));
+  CHECK_INTS_EQUAL(-8038,evaluator.evaluate(&u3, 3));
+  evaluator.set_memoize(false);
+  CHECK_INTS_EQUAL(-8038,evaluator.evaluate(&u3, 3));
+}
+
+/**
+ * Two hairpins 65536 bases apart, with different closing pairs, get their own
+ * cache entries: the memoized energy is the plain one.
+ */
+TEST (efn2_memoize_long,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  std::string sequence(70000, 'A');
+  std::string dotbracket(70000, '.');
+  sequence.replace(4, 10, "GGGAAAACCC");
+  dotbracket.replace(4, 10, "(((....)))");
+  sequence.replace(4+65536, 10, "GGCUUCGGCC");
+  dotbracket.replace(4+65536, 10, "(((....)))");
+  RNAStructure ct(sequence, dotbracket);
+  EnergyEvaluator evaluator(dattab);
+  int plain = evaluator.evaluate(&ct, 1);
+  evaluator.set_memoize(true);
+  CHECK_INTS_EQUAL(plain,evaluator.evaluate(&ct, 1));
+  CHECK_INTS_EQUAL(2,static_cast<int>(evaluator.get_cache_misses()));
+}
+
+/**
+ * The d2 and no-dangle models skip coaxial stacking. d2 only adds
+ * (non-positive) dangling ends to the no-dangle energy, and switching
+ * back gives the efn2 energies again.
+ */
+TEST (efn2_dangle_models,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  EnergyEvaluator evaluator(dattab);
+  CHECK(evaluator.get_model() == EnergyEvaluator::COAXIAL_STACKING);
+  evaluator.set_model(EnergyEvaluator::NO_DANGLES);
+  evaluator.efn2(&u3, 0);
+  std::vector<int> nodangle = evaluator.get_energies();
+  evaluator.set_model(EnergyEvaluator::D2_DANGLES);
+  evaluator.efn2(&u3, 0);
+  std::vector<int> d2 = evaluator.get_energies();
+  int expected_nodangle[] = { 0, -7650, -7280, -7328, -6693, -6698 };
+  int expected_d2[] = { 0, -8230, -8210, -8038, -7793, -7768 };
+  for (int s=1; s<=5; s++) {
+    CHECK_INTS_EQUAL(expected_nodangle[s],nodangle[s]);
+    CHECK_INTS_EQUAL(expected_d2[s],d2[s]);
+  }
+  /* one helix in the exterior loop: d2 adds the 3' dangle A on C-G (-1.7) and the 5' one (-0.2) */
+  RNAStructure hairpin("AGGGGAAAACCCCA", ".((((....)))).");
+  evaluator.set_model(EnergyEvaluator::NO_DANGLES);
+  CHECK_INTS_EQUAL(-540,evaluator.evaluate(&hairpin, 1));
+  evaluator.set_model(EnergyEvaluator::D2_DANGLES);
+  CHECK_INTS_EQUAL(-730,evaluator.evaluate(&hairpin, 1));
+  evaluator.set_model(EnergyEvaluator::COAXIAL_STACKING);
+  CHECK_INTS_EQUAL(-8250,evaluator.evaluate(&u3, 1));
+  CHECK_INTS_EQUAL(-7758,evaluator.evaluate(&u3, 5));
+}
+
+/** @return The sequence of ct as a string. */
+static std::string sequence_of(const RNAStructure &ct) {
+  std::string seq;
+  for (int k=1; k<=ct.get_number_of_bases(); k++)
+    seq += ct.nucleotide_at(k);
+  return seq;
+}
+
+/**
+ * A structure made from a sequence and a dot-bracket string gets the same
+ * energy as the structure from the CT file, also after it was reused.
+ */
+TEST (efn2_dot_bracket,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  RNAStructure snora("../testdata/SNORA17.ct");
+  RNAStructure candidate(sequence_of(snora), snora.get_dot_parens_structure(1));
+  EnergyEvaluator evaluator(dattab);
+  CHECK_INTS_EQUAL(1,candidate.get_number_of_structures());
+  CHECK_INTS_EQUAL(-5500,evaluator.evaluate(&candidate, 1));
+  candidate.assign(sequence_of(u3), u3.get_dot_parens_structure(1));
+  CHECK_INTS_EQUAL(u3.get_number_of_bases(),candidate.get_number_of_bases());
+  CHECK_INTS_EQUAL(-8250,evaluator.evaluate(&candidate, 1));
+  CHECK_STRINGS_EQUAL(u3.get_dot_parens_structure(1),candidate.get_dot_parens_structure(1));
+  bool thrown = false;
+  try {
+    candidate.assign("GGGAAACC", "(((...))");
+  } catch (const std::invalid_argument &e) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+/**
+ * Candidates are written back in input order with their energies; a malformed
+ * line gets "NA" and does not stop the stream.
+ */
+TEST (efn2_stream,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  RNAStructure mir("../testdata/mir283.ct");
+  std::string u3seq = sequence_of(u3);
+  std::string mirseq = sequence_of(mir);
+  std::stringstream in;
+  in << u3seq << '\t' << u3.get_dot_parens_structure(1) << '\n'
+     << mirseq << '\t' << mir.get_dot_parens_structure(1) << "\n\n"
+     << "GGGAAACC\t(((...))\n"
+     << u3seq << '\t' << u3.get_dot_parens_structure(5) << '\n';
+  std::ostringstream out;
+  ThreadPool pool(2);
+  long n = efn2_stream(dattab, in, out, pool, 3);
+  CHECK_INTS_EQUAL(4,n);
+  std::istringstream result(out.str());
+  std::string line;
+  const char *expected[] = { "-82.50", "-31.70", "NA", "-77.58" };
+  for (int k=0; k<4; k++) {
+    getline(result, line);
+    CHECK_STRINGS_EQUAL(std::string(expected[k]),line.substr(line.rfind('\t')+1));
+  }
+}
+
+/**
+ * Scoring sequences against a loop plan gives the efn2 energies of the
+ * sequences folded into the target structure.
+ */
+TEST (efn2_loop_plan,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  LoopPlan plan(&u3, 1);
+  CHECK_INTS_EQUAL(u3.get_number_of_bases(),plan.get_number_of_bases());
+  CHECK(plan.get_number_of_stacks() > plan.get_number_of_loops());
+  std::string target = u3.get_dot_parens_structure(1);
+  std::vector<std::string> sequences(300, sequence_of(u3));
+  const char bases[] = "ACGU";
+  unsigned int state = 12345;
+  for (size_t s=1; s<sequences.size(); s++) {
+    for (int m=0; m<10; m++) {
+      state = state * 1103515245u + 12345u;
+      int pos = (state >> 8) % sequences[s].size();
+      sequences[s][pos] = bases[(state >> 20) % 4];
+    }
+  }
+  ThreadPool pool(3);
+  std::vector<int> energies;
+  efn2_plan_batch(dattab, plan, sequences, pool, &energies, 64);
+  CHECK_INTS_EQUAL(300,energies.size());
+  CHECK_INTS_EQUAL(-8250,energies[0]);
+  EnergyEvaluator evaluator(dattab);
+  for (size_t s=0; s<sequences.size(); s+=23) {
+    RNAStructure candidate(sequences[s], target);
+    CHECK_INTS_EQUAL(evaluator.evaluate(&candidate, 1),energies[s]);
+  }
+}
+
+/**
+ * evaluate_plan keeps the pairs of the plan and only encodes each sequence:
+ * every structure of u3 and mir283, scored for mutated sequences by one
+ * evaluator, gives the efn2 energy of each sequence on its own.
+ */
+TEST (efn2_loop_plan_each,EnergyEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  RNAStructure mir283("../testdata/mir283.ct");
+  RNAStructure *targets[] = { &u3, &mir283 };
+  EnergyEvaluator planned(dattab);
+  EnergyEvaluator single(dattab);
+  const char bases[] = "ACGU";
+  unsigned int state = 4711;
+  int differ = 0, scored = 0;
+  for (int t=0; t<2; t++) {
+    for (int structnum=1; structnum<=targets[t]->get_number_of_structures(); structnum++) {
+      LoopPlan plan(targets[t], structnum);
+      std::vector<std::string> sequences(40, sequence_of(*targets[t]));
+      for (size_t s=1; s<sequences.size(); s++) {
+	for (int m=0; m<5; m++) {
+	  state = state * 1103515245u + 12345u;
+	  int pos = (state >> 8) % sequences[s].size();
+	  sequences[s][pos] = bases[(state >> 20) % 4];
+	}
+      }
+      std::vector<int> energies(sequences.size());
+      planned.evaluate_plan(plan, &sequences[0], static_cast<int>(sequences.size()), &energies[0]);
+      for (size_t s=0; s<sequences.size(); s++) {
+	RNAStructure candidate(sequences[s], plan.get_structure());
+	if (single.evaluate(&candidate, 1) != energies[s])
+	  differ++;
+	scored++;
+      }
+      CHECK_INTS_EQUAL(single.evaluate(targets[t], structnum),energies[0]);
+    }
+  }
+  CHECK_INTS_EQUAL(0,differ);
+  CHECK_INTS_EQUAL(6*40,scored);
+}
+
+/**
+ * Reading u3 two structures at a time gives the same structures and energies
+ * as loading the whole file, in a batch whose storage does not grow.
+ */
+TEST (ct_reader_batches,CTReader) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  CTReader reader("../testdata/u3.ct");
+  CHECK(reader.is_open());
+  RNAStructure batch;
+  ThreadPool pool(2);
+  int expected_sizes[] = { 2, 2, 1 };
+  int energies[] = { -8250, -8230, -8038, -7773, -7758 };
+  int s = 0;
+  size_t storage = 0;
+  for (int b=0; b<3; b++) {
+    int k = reader.next(&batch, 2);
+    CHECK_INTS_EQUAL(expected_sizes[b],k);
+    CHECK_INTS_EQUAL(k,batch.get_number_of_structures());
+    efn2_batch(dattab, &batch, pool);
+    for (int i=1; i<=k; i++) {
+      s++;
+      CHECK_INTS_EQUAL(energies[s-1],batch.get_energy(i));
+      CHECK_STRINGS_EQUAL(u3.get_ith_label(s),batch.get_ith_label(i));
+      CHECK_STRINGS_EQUAL(u3.get_dot_parens_structure(s),batch.get_dot_parens_structure(i));
+    }
+    if (b==0)
+      storage = batch.get_storage_size();
+    else
+      CHECK(batch.get_storage_size() <= storage);
+  }
+  CHECK_INTS_EQUAL(0,reader.next(&batch, 2));
+  CHECK_INTS_EQUAL(5,reader.get_number_read());
+}
@@ -0,0 +1,52 @@
+
+/**
+ * Unit tests for the binary ensemble format.
+ */
+
+/**
+ * The structures of u3, written to an ensemble file and read back, keep their
+ * pairs, energies and labels, and can be read in any order.
+ */
+TEST (ensemble_roundtrip,EnsembleReader) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  ThreadPool pool(2);
+  efn2_batch(dattab, &u3, pool);
+  const char *path = "/tmp/rnx_ensemble_test.rnxe";
+  {
+    EnsembleWriter writer(path, EnsembleWriter::sequence_of(&u3));
+    writer.add_all(&u3);
+    CHECK_INTS_EQUAL(5,writer.get_number_of_structures());
+  }
+  EnsembleReader reader(path);
+  CHECK_INTS_EQUAL(u3.get_number_of_bases(),reader.get_number_of_bases());
+  CHECK_INTS_EQUAL(5,reader.get_number_of_structures());
+  CHECK_STRINGS_EQUAL(EnsembleWriter::sequence_of(&u3),reader.get_sequence());
+  for (long k=5; k>=1; k--) {
+    CHECK_INTS_EQUAL(u3.get_energy(k),reader.get_energy(k));
+    CHECK_STRINGS_EQUAL(u3.get_ith_label(k),reader.get_label(k));
+  }
+  RNAStructure loaded;
+  reader.read(2, 3, &loaded);
+  CHECK_INTS_EQUAL(3,loaded.get_number_of_structures());
+  for (int s=1; s<=3; s++)
+    CHECK_STRINGS_EQUAL(u3.get_dot_parens_structure(s+1),loaded.get_dot_parens_structure(s));
+  EnergyEvaluator evaluator(dattab);
+  CHECK_INTS_EQUAL(-8230,evaluator.evaluate(&loaded, 1));
+  /* the pair lists take a small fraction of the CT text */
+  std::ifstream ct("../testdata/u3.ct", std::ios::binary | std::ios::ate);
+  std::ifstream bin(path, std::ios::binary | std::ios::ate);
+  CHECK(10 * static_cast<long>(bin.tellg()) < static_cast<long>(ct.tellg()));
+  remove(path);
+}
+
+/** Files that are not (complete) ensemble files are rejected. */
+TEST (ensemble_invalid,EnsembleReader) {
+  bool thrown = false;
+  try {
+    EnsembleReader reader("../testdata/u3.ct");
+  } catch (const std::runtime_error &e) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
@@ -0,0 +1,85 @@
+
+/**
+ * Unit tests for incremental energy evaluation under base-pair moves.
+ */
+
+/** The loop decomposition adds up to the efn2 energies of u3.ct. */
+TEST (incremental_initial,IncrementalEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure rnastruct("../testdata/u3.ct");
+  IncrementalEvaluator inc1(dattab, &rnastruct, 1);
+  CHECK_INTS_EQUAL(-8250,inc1.get_energy());
+  IncrementalEvaluator inc4(dattab, &rnastruct, 4);
+  CHECK_INTS_EQUAL(-7773,inc4.get_energy());
+  RNAStructure mir283("../testdata/mir283.ct");
+  IncrementalEvaluator inc(dattab, &mir283, 1);
+  CHECK_INTS_EQUAL(-3170,inc.get_energy());
+}
+
+/**
+ * Remove every fifth pair of the first u3 structure and put them back again,
+ * comparing each step with a full efn2 evaluation of the same structure.
+ */
+TEST (incremental_moves,IncrementalEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure rnastruct("../testdata/u3.ct");
+  RNAStructure mirror("../testdata/u3.ct"); /* its pairs follow the moves for the reference efn2 */
+  int *bp = mirror.basepr()[1];
+  int n = rnastruct.get_number_of_bases();
+  IncrementalEvaluator inc(dattab, &rnastruct, 1);
+  EnergyEvaluator full(dattab);
+  std::vector<int> removed;
+  int wrong = 0;
+  for (int i=1; i<=n; i++) {
+    int j = inc.get_partner(i);
+    if (j<=i || (i%5)!=0) continue;
+    int predicted = inc.delta_remove_pair(i);
+    int delta = inc.remove_pair(i);
+    if (predicted != delta) wrong++;
+    bp[i] = 0;
+    bp[j] = 0;
+    if (inc.get_energy() != full.evaluate(&mirror, 1)) wrong++;
+    removed.push_back(i);
+    removed.push_back(j);
+  }
+  CHECK(removed.size() > 10);
+  CHECK_INTS_EQUAL(0,wrong);
+  for (size_t k=removed.size(); k>0; k-=2) {
+    int i = removed[k-2], j = removed[k-1];
+    CHECK(inc.can_add_pair(i, j));
+    int predicted = inc.delta_add_pair(i, j);
+    int delta = inc.add_pair(i, j);
+    if (predicted != delta) wrong++;
+    bp[i] = j;
+    bp[j] = i;
+    if (inc.get_energy() != full.evaluate(&mirror, 1)) wrong++;
+  }
+  CHECK_INTS_EQUAL(0,wrong);
+  CHECK_INTS_EQUAL(-8250,inc.get_energy());
+}
+
+/** Pairs that would cross an existing pair, or involve a paired base, are refused. */
+TEST (incremental_crossing,IncrementalEvaluator) {
+  Datatable dattab("../dat");
+  RNAStructure rnastruct("../testdata/mir283.ct");
+  IncrementalEvaluator inc(dattab, &rnastruct, 1);
+  int n = rnastruct.get_number_of_bases();
+  int i = 1;
+  while (inc.get_partner(i)==0) i++;
+  int j = inc.get_partner(i);
+  CHECK(!inc.can_add_pair(i, n));
+  /* an unpaired base inside the helix and one outside of it */
+  int inside = i+1;
+  while (inside<j && inc.get_partner(inside)!=0) inside++;
+  int outside = j+1;
+  while (outside<=n && inc.get_partner(outside)!=0) outside++;
+  if (inside<j && outside<=n)
+    CHECK(!inc.can_add_pair(inside, outside));
+  bool thrown = false;
+  try {
+    inc.add_pair(i, n);
+  } catch (const std::invalid_argument &e) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
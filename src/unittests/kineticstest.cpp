@@ -0,0 +1,77 @@
+
+/**
+ * Unit tests for the stochastic folding simulator.
+ */
+
+TEST (ratetree,RateTree) {
+  RateTree tree(5);
+  tree.set(0, 1.0);
+  tree.set(2, 2.0);
+  tree.set(4, 0.5);
+  CHECK_DOUBLES_EQUAL(3.5,tree.total());
+  CHECK_INTS_EQUAL(0,tree.find(0.5));
+  CHECK_INTS_EQUAL(2,tree.find(1.0));
+  CHECK_INTS_EQUAL(2,tree.find(2.9));
+  CHECK_INTS_EQUAL(4,tree.find(3.2));
+  tree.set(2, 0.0);
+  CHECK_DOUBLES_EQUAL(1.5,tree.total());
+  CHECK_INTS_EQUAL(4,tree.find(1.2));
+}
+
+/**
+ * Fold mir283 from the open chain. The energy that the simulator keeps
+ * incrementally must match a fresh evaluation of each structure it visits.
+ */
+TEST (kinetics_trajectory,KineticSimulator) {
+  Datatable dattab("../dat");
+  RNAStructure rnastruct("../testdata/mir283.ct");
+  int n = rnastruct.get_number_of_bases();
+  KineticSimulator sim(dattab, &rnastruct, std::string(n, '.'), 42);
+  CHECK_INTS_EQUAL(0,sim.get_energy());
+  CHECK(sim.get_number_of_moves() > 0);
+  std::vector<TrajectoryPoint> trajectory;
+  sim.run(100.0, &trajectory);
+  CHECK(trajectory.size() > 10);
+  int wrong = 0;
+  for (size_t k=0; k<trajectory.size(); k+=10) {
+    IncrementalEvaluator check(dattab, &rnastruct,
+			       KineticSimulator::parse_dot_bracket(trajectory[k].structure, n));
+    if (check.get_energy() != trajectory[k].energy) wrong++;
+    if (k>0 && trajectory[k].time < trajectory[k-1].time) wrong++;
+  }
+  CHECK_INTS_EQUAL(0,wrong);
+  /* the simulation runs downhill from the open chain */
+  int lowest = 0;
+  for (size_t k=0; k<trajectory.size(); k++)
+    if (trajectory[k].energy < lowest) lowest = trajectory[k].energy;
+  CHECK(lowest < 0);
+}
+
+/**
+ * Opening one base pair of a helix of the mfold structure: independent
+ * trajectories find their way back, and do not depend on the thread count.
+ */
+TEST (kinetics_first_passage,KineticSimulator) {
+  Datatable dattab("../dat");
+  RNAStructure rnastruct("../testdata/mir283.ct");
+  std::string target = rnastruct.get_dot_parens_structure(1);
+  const int *bp = rnastruct.basepr()[1];
+  std::string start = target;
+  int n = rnastruct.get_number_of_bases();
+  for (int k=2; k<n; k++) {
+    if (bp[k]>k && bp[k-1]==bp[k]+1 && bp[k+1]==bp[k]-1) { /* inside a helix */
+      start[k-1] = '.';
+      start[bp[k]-1] = '.';
+      break;
+    }
+  }
+  CHECK(start != target);
+  ThreadPool pool2(2);
+  std::vector<double> t2 = run_first_passage(dattab, &rnastruct, start, target, 4, 1000.0, pool2, 7);
+  ThreadPool pool1(1);
+  std::vector<double> t1 = run_first_passage(dattab, &rnastruct, start, target, 4, 1000.0, pool1, 7);
+  for (int k=0; k<4; k++) {
+    CHECK(t2[k] >= 0.0);
+    CHECK_DOUBLES_EQUAL(t1[k],t2[k]);
+  }
+}
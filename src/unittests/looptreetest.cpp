@@ -0,0 +1,105 @@
+
+/**
+ * Unit tests for loop trees, abstract shapes and the helix tree edit distance.
+ */
+
+/** Build the loop tree of a dot-bracket structure (the sequence does not matter). */
+static void loop_tree_of(const std::string &db, LoopTree *tree) {
+  RNAStructure ct(std::string(db.size(), 'A'), db);
+  tree->assign(ct.basepr()[1], ct.get_number_of_bases());
+}
+
+/** The loops of u3 account for every pair and every unpaired base. */
+TEST (loop_tree_u3,LoopTree) {
+  RNAStructure u3("../testdata/u3.ct");
+  for (int s=1; s<=u3.get_number_of_structures(); s++) {
+    LoopTree tree(&u3, s);
+    int n = u3.get_number_of_bases();
+    int pairs = 0, unpaired = 0;
+    for (int i=1; i<=n; i++) {
+      if (u3.basepr()[s][i] > i)
+	pairs++;
+      else if (u3.basepr()[s][i] == 0)
+	unpaired++;
+    }
+    CHECK_INTS_EQUAL(pairs+1,tree.get_number_of_loops());
+    int branches = 0, free_bases = 0;
+    for (int k=0; k<tree.get_number_of_loops(); k++) {
+      branches += tree.get_number_of_branches(k);
+      free_bases += tree.get_number_of_unpaired(k);
+      if (k > 0) {
+	int p = tree.parent(k);
+	CHECK(tree.closing_i(p) < tree.closing_i(k) && tree.closing_j(k) < tree.closing_j(p));
+	CHECK_INTS_EQUAL(tree.closing_j(k),u3.basepr()[s][tree.closing_i(k)]);
+      }
+    }
+    CHECK_INTS_EQUAL(pairs,branches);
+    CHECK_INTS_EQUAL(unpaired,free_bases);
+    CHECK_INTS_EQUAL(0,LoopTree::edit_distance(tree, tree));
+  }
+  LoopTree one(&u3, 1), two(&u3, 2);
+  CHECK_INTS_EQUAL(LoopTree::edit_distance(one, two),LoopTree::edit_distance(two, one));
+  std::map<std::string, std::vector<int> > classes;
+  LoopTree::shape_classes(&u3, 5, &classes);
+  size_t grouped = 0;
+  for (std::map<std::string, std::vector<int> >::const_iterator it=classes.begin(); it!=classes.end(); ++it) {
+    grouped += it->second.size();
+    for (size_t k=0; k<it->second.size(); k++)
+      CHECK_STRINGS_EQUAL(it->first,LoopTree(&u3, it->second[k]).shape(5));
+  }
+  CHECK_INTS_EQUAL(5,grouped);
+}
+
+/** Shapes at the five levels of multiloops, internal loops and bulges. */
+TEST (loop_tree_shapes,LoopTree) {
+  LoopTree tree;
+  loop_tree_of("((..((...))..((...))..))", &tree);
+  CHECK_INTS_EQUAL(3,tree.get_number_of_helices());
+  CHECK_STRINGS_EQUAL(std::string("[_[]_[]_]"),tree.shape(1));
+  CHECK_STRINGS_EQUAL(std::string("[_[]_[]_]"),tree.shape(2));
+  CHECK_STRINGS_EQUAL(std::string("[[][]]"),tree.shape(3));
+  CHECK_STRINGS_EQUAL(std::string("[_[]_[]_]"),tree.shape(4));
+  CHECK_STRINGS_EQUAL(std::string("[[][]]"),tree.shape(5));
+  loop_tree_of(".((..((...))..)).", &tree);
+  CHECK_STRINGS_EQUAL(std::string("_[_[]_]_"),tree.shape(1));
+  CHECK_STRINGS_EQUAL(std::string("_[[]]_"),tree.shape(2));
+  CHECK_STRINGS_EQUAL(std::string("[[]]"),tree.shape(3));
+  CHECK_STRINGS_EQUAL(std::string("_[]_"),tree.shape(4));
+  CHECK_STRINGS_EQUAL(std::string("[]"),tree.shape(5));
+  loop_tree_of("((.((...))))", &tree);
+  CHECK_STRINGS_EQUAL(std::string("[_[]]"),tree.shape(1));
+  CHECK_STRINGS_EQUAL(std::string("[[]]"),tree.shape(3));
+  CHECK_STRINGS_EQUAL(std::string("[]"),tree.shape(5));
+  loop_tree_of(".....", &tree);
+  CHECK_STRINGS_EQUAL(std::string("_"),tree.shape(1));
+  CHECK_STRINGS_EQUAL(std::string(""),tree.shape(5));
+  bool thrown = false;
+  try {
+    tree.shape(6);
+  } catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+/** Helix tree edit distances and rejection of pseudoknots. */
+TEST (loop_tree_edit_distance,LoopTree) {
+  LoopTree hairpin, open, interior;
+  loop_tree_of("((((...))))", &hairpin);
+  loop_tree_of("...........", &open);
+  loop_tree_of("((..((...))..))", &interior);
+  CHECK_INTS_EQUAL(1,hairpin.get_number_of_helices());
+  CHECK_INTS_EQUAL(4,LoopTree::edit_distance(hairpin, open));
+  CHECK_INTS_EQUAL(4,LoopTree::edit_distance(open, hairpin));
+  CHECK_INTS_EQUAL(4,LoopTree::edit_distance(interior, hairpin));
+  CHECK_INTS_EQUAL(0,LoopTree::edit_distance(interior, interior));
+  int knot[] = { 0, 5, 0, 7, 0, 1, 0, 3, 0 };
+  bool thrown = false;
+  try {
+    LoopTree tree;
+    tree.assign(knot, 8);
+  } catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
@@ -0,0 +1,86 @@
+
+/**
+ * Unit tests for ensemble pair frequencies, centroid and MEA structures.
+ */
+
+/** Unweighted frequencies of u3 are counts out of its five structures. */
+TEST (pair_frequencies,PairProbability) {
+  RNAStructure u3("../testdata/u3.ct");
+  ThreadPool pool(3);
+  PairProbability prob(&u3, pool);
+  int n = u3.get_number_of_bases();
+  CHECK_INTS_EQUAL(n,prob.get_number_of_bases());
+  CHECK_INTS_EQUAL(5,prob.get_number_of_structures());
+  for (int i=1; i<=n; i++) {
+    int paired = 0;
+    for (int s=1; s<=5; s++) {
+      int j = u3.basepr()[s][i];
+      if (j == 0)
+	continue;
+      paired++;
+      int count = 0;
+      for (int t=1; t<=5; t++)
+	count += (u3.basepr()[t][i] == j);
+      CHECK(fabs(prob.probability(i, j) - count/5.0) < 1e-12);
+      CHECK(fabs(prob.probability(j, i) - count/5.0) < 1e-12);
+    }
+    CHECK(fabs(prob.unpaired(i) - (5-paired)/5.0) < 1e-12);
+  }
+  CHECK(prob.probability(1, 2) == 0.0);
+  std::vector<int> centroid(n+1);
+  prob.centroid(centroid.data());
+  for (int i=1; i<=n; i++) {
+    int count = 0;
+    for (int s=1; s<=5; s++)
+      count += (u3.basepr()[s][i] != 0 && u3.basepr()[s][i] == centroid[i]);
+    if (centroid[i] != 0)
+      CHECK(count >= 3);
+  }
+}
+
+/**
+ * The MEA structure is nested, its score is what it claims, and it scores at
+ * least as well as the centroid and every input structure.
+ */
+TEST (mea_structure,PairProbability) {
+  Datatable dattab("../dat");
+  RNAStructure u3("../testdata/u3.ct");
+  ThreadPool pool(2);
+  efn2_batch(dattab, &u3, pool);
+  PairProbability prob(&u3, dattab, pool);
+  /* the pairs of the lowest-energy structure carry the majority of the weight */
+  int n = u3.get_number_of_bases();
+  for (int i=1; i<=n; i++)
+    if (u3.basepr()[1][i] > i)
+      CHECK(prob.probability(i, u3.basepr()[1][i]) > 0.5);
+  std::vector<int> mea(n+1), centroid(n+1);
+  double score = prob.mea(mea.data());
+  prob.centroid(centroid.data());
+  std::vector<const int*> candidates;
+  candidates.push_back(centroid.data());
+  for (int s=1; s<=5; s++)
+    candidates.push_back(u3.basepr()[s]);
+  candidates.push_back(mea.data());
+  std::vector<double> accuracy;
+  for (size_t c=0; c<candidates.size(); c++) {
+    const int *pairs = candidates[c];
+    double a = 0.0;
+    for (int i=1; i<=n; i++) {
+      if (pairs[i] == 0)
+	a += prob.unpaired(i);
+      else if (pairs[i] > i)
+	a += 2.0*prob.probability(i, pairs[i]);
+    }
+    accuracy.push_back(a);
+  }
+  CHECK(fabs(accuracy.back() - score) < 1e-9);
+  for (size_t c=0; c+1<accuracy.size(); c++)
+    CHECK(accuracy[c] <= score + 1e-9);
+  for (int i=1; i<=n; i++) {
+    if (mea[i] == 0)
+      continue;
+    CHECK_INTS_EQUAL(i,mea[mea[i]]);
+    for (int k=i+1; k<mea[i]; k++)
+      CHECK(mea[k] == 0 || (mea[k] > i && mea[k] < mea[i]));
+  }
+}
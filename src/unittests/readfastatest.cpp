@@ -282,3 +282,79 @@ TESTWITHSETUP(HBBgbFixture,readgb11)
   CHECK_STRINGS_EQUAL("AACAGACACC",end5utr);
 }
 
+
+/** The mapped index gives the same records as parseFASTA. */
+TEST (fasta_index,FastaIndex) {
+  FastaIndex index("../testdata/NM_000518.fasta");
+  CHECK(index.is_open());
+  CHECK_INTS_EQUAL(1,index.get_number_of_records());
+  FastaView view = index.record(0);
+  CHECK_INTS_EQUAL(626,view.length);
+  CHECK(!view.contiguous());
+  CHECK_STRINGS_EQUAL(std::string("gi|28302128|ref|NM_000518.4| Homo sapiens hemoglobin, beta (HBB), mRNA"),
+		      view.get_header());
+  CHECK_STRINGS_EQUAL(std::string("TGACTCCTGA"),view.get_sequence().substr(60,10));
+  CHECK_STRINGS_EQUAL(std::string("UGACUCCUGA"),view.get_rna().substr(60,10));
+  bool thrown = false;
+  try {
+    index.record(1);
+  } catch (const std::out_of_range &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+/** Several records with Windows line ends, blank lines and no final line end. */
+TEST (fasta_index_records,FastaIndex) {
+  const char *path = "/tmp/rnx_fasta_index.fa";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "junk before the first record\n"
+	<< ">first record\r\nACGT\r\nacgu\r\n\r\n"
+	<< ">second\nGGGAAACCC\n"
+	<< ">empty\n"
+	<< ">last\nUUU\nAA";
+  }
+  FastaIndex index(path);
+  CHECK_INTS_EQUAL(4,index.get_number_of_records());
+  FastaView first = index.record(0);
+  CHECK_STRINGS_EQUAL(std::string("first record"),first.get_header());
+  CHECK_INTS_EQUAL(8,first.length);
+  CHECK_STRINGS_EQUAL(std::string("ACGTacgu"),first.get_sequence());
+  CHECK_STRINGS_EQUAL(std::string("ACGUACGU"),first.get_rna());
+  FastaView second = index.record(1);
+  CHECK(second.contiguous());
+  CHECK_STRINGS_EQUAL(std::string("GGGAAACCC"),std::string(second.data, second.length));
+  CHECK_INTS_EQUAL(0,index.record(2).length);
+  CHECK_STRINGS_EQUAL(std::string(""),index.record(2).get_sequence());
+  CHECK_STRINGS_EQUAL(std::string("UUUAA"),index.record(3).get_sequence());
+  std::vector<Record> records;
+  CHECK(parseFASTA(path, records));
+  CHECK_INTS_EQUAL(4,records.size());
+  CHECK_INTS_EQUAL(9,records[1].get_size());
+  CHECK_STRINGS_EQUAL(std::string("GGGAAACCC"),records[1].get_rna());
+  remove(path);
+  FastaIndex missing("/tmp/rnx_no_such_file.fa");
+  CHECK(!missing.is_open());
+  CHECK_INTS_EQUAL(0,missing.get_number_of_records());
+}
+
+/** Windows line ends with a last line of one residue: the record is not on one line. */
+TEST (fasta_index_crlf,FastaIndex) {
+  const char *path = "/tmp/rnx_fasta_crlf.fa";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << ">r1\r\nAB\r\nC\r\n"
+	<< ">r2\r\nGGC\r\n";
+  }
+  FastaIndex index(path);
+  CHECK_INTS_EQUAL(2,index.get_number_of_records());
+  FastaView first = index.record(0);
+  CHECK_INTS_EQUAL(3,first.length);
+  CHECK(!first.contiguous());
+  CHECK_STRINGS_EQUAL(std::string("ABC"),first.get_sequence());
+  FastaView second = index.record(1);
+  CHECK(second.contiguous());
+  CHECK_STRINGS_EQUAL(std::string("GGC"),second.get_sequence());
+  remove(path);
+}
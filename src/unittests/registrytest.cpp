@@ -0,0 +1,61 @@
+
+/**
+ * Unit tests for the hot-reloadable parameter registry.
+ */
+
+/** A snapshot keeps its tables, and its version, across a reload. */
+TEST (registry_snapshot,ParameterRegistry) {
+  ParameterRegistry registry("../dat");
+  CHECK_INTS_EQUAL(1,(int)registry.get_version());
+  ParameterRegistry::Snapshot old = registry.snapshot();
+  unsigned long v = registry.reload("../dat");
+  CHECK_INTS_EQUAL(2,(int)v);
+  CHECK_INTS_EQUAL(2,(int)registry.get_version());
+  CHECK_INTS_EQUAL(1,(int)old->get_version());
+  CHECK(&old->get_datatable() != &registry.snapshot()->get_datatable());
+  RNAStructure rnastruct("../testdata/u3.ct");
+  EnergyEvaluator evaluator(old->get_datatable());
+  evaluator.efn2(&rnastruct, 1);
+  CHECK_INTS_EQUAL(-8250,evaluator.get_energy(1));
+}
+
+/** A directory that cannot be read leaves the current set in place. */
+TEST (registry_failed_reload,ParameterRegistry) {
+  ParameterRegistry registry("../dat");
+  const Datatable *before = &registry.snapshot()->get_datatable();
+  bool thrown = false;
+  try {
+    registry.reload("../no_such_directory");
+  } catch (const std::exception &e) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK_INTS_EQUAL(1,(int)registry.get_version());
+  CHECK(before == &registry.snapshot()->get_datatable());
+}
+
+/** Readers evaluate structures while another thread keeps reloading the parameters. */
+TEST (registry_concurrent_reload,ParameterRegistry) {
+  ParameterRegistry registry("../dat");
+  RNAStructure rnastruct("../testdata/u3.ct");
+  const int n_threads = 4;
+  int wrong[n_threads] = {0};
+  std::vector<std::thread> readers;
+  for (int t=0; t<n_threads; ++t) {
+    readers.push_back(std::thread([&registry,&rnastruct,&wrong,t]() {
+	  for (int k=0; k<20; ++k) {
+	    ParameterRegistry::Snapshot snap = registry.snapshot();
+	    EnergyEvaluator evaluator(snap->get_datatable());
+	    evaluator.efn2(&rnastruct, 2);
+	    if (evaluator.get_energy(2) != -8230) wrong[t]++;
+	  }
+	}));
+  }
+  for (int k=0; k<3; ++k)
+    registry.reload("../dat");
+  for (int t=0; t<n_threads; ++t) {
+    readers[t].join();
+    CHECK_INTS_EQUAL(0,wrong[t]);
+  }
+  CHECK_INTS_EQUAL(4,(int)registry.get_version());
+}
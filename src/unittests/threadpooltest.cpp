@@ -0,0 +1,28 @@
+
+/**
+ * Unit tests for the worker thread pool.
+ */
+
+/** Every index is visited exactly once, and the pool can be reused. */
+TEST (threadpool_run,ThreadPool) {
+  ThreadPool pool(4);
+  CHECK_INTS_EQUAL(4,pool.size());
+  std::vector<int> visits(1000, 0);
+  std::vector<int> per_worker(pool.size(), 0);
+  for (int round=0; round<3; ++round) {
+    pool.run(1000, [&](int k, int worker) {
+	visits[k]++;
+	per_worker[worker]++; /* each worker only writes its own slot */
+      });
+  }
+  int wrong = 0;
+  for (size_t k=0; k<visits.size(); ++k)
+    if (visits[k] != 3) wrong++;
+  CHECK_INTS_EQUAL(0,wrong);
+  int total = 0;
+  for (int w=0; w<pool.size(); ++w)
+    total += per_worker[w];
+  CHECK_INTS_EQUAL(3000,total);
+  pool.run(0, [&](int k, int) { visits[k]++; });
+  CHECK_INTS_EQUAL(3,visits[0]);
+}